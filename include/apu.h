@@ -0,0 +1,27 @@
+#ifndef APU_H
+#define APU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <gb.h>
+
+#define AUDIO_SAMPLE_RATE 48000
+#define AUDIO_CHANNELS 2
+
+// The frame sequencer steps at 512 Hz
+#define APU_STEP_DOTS 8192
+
+// NR52 bits
+#define NR52_POWER 0x80
+
+void init_apu(gb_t *gb);
+void sync_apu(gb_t *gb);
+void rebase_audio(gb_t *gb);
+void set_audio_ratio(gb_t *gb, double ratio);
+void apu_event(gb_t *gb);
+uint8_t read_apu(gb_t *gb, uint16_t addr);
+void write_apu(gb_t *gb, uint16_t addr, uint8_t val);
+size_t read_audio(gb_t *gb, int16_t *out, size_t max_frames);
+
+#endif // APU_H
@@ -0,0 +1,28 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdbool.h>
+#include <gb.h>
+#include <apu.h>
+
+// Sample frames the ring between the emulation thread and the audio device
+// holds, a power of two. Anything made while it is full, e.g. when running
+// faster than real time, is dropped.
+#define AUDIO_RING_SIZE 8192
+
+// Fill the rate control keeps the ring at, about 64 ms
+#define AUDIO_TARGET_FILL 3072
+
+// Longest wait_audio() blocks on a device that stopped taking samples
+#define AUDIO_WAIT_TIMEOUT_MS 100
+
+// Largest change to the sample rate made to steer the fill, as a fraction
+#define AUDIO_MAX_RATE_DELTA 0.005
+
+bool init_audio(void);
+void free_audio(void);
+void queue_audio(gb_t *gb);
+bool wait_audio(void);
+void print_audio_stats(void);
+
+#endif // AUDIO_H
@@ -0,0 +1,12 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <gb.h>
+
+bool run_batch(char **rom_paths, size_t rom_num, size_t thread_num,
+               bool run_boot, bool accurate_ppu, size_t frame_skip,
+               const run_limits_t *limits);
+
+#endif // BATCH_H
@@ -4,22 +4,25 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <gb.h>
 
-// Type definitions
-typedef union {
-    uint16_t r16;
-    struct {
-        uint8_t l; // swapped for
-        uint8_t h; // little-endian ordering
-    } r8;
-} reg_t;
+// Kinds of operation whose flags are pending in the lazy flags state
+typedef enum {
+    FLAGS_NONE, // F is up to date
+    FLAGS_ADD,
+    FLAGS_SUB,
+    FLAGS_INC,
+    FLAGS_DEC,
+    FLAGS_AND,
+    FLAGS_OR // also xor
+} flags_op_t;
 
-// Global variables
-extern reg_t af, bc, de, hl, sp, pc;
-extern size_t dots;
-extern bool ime;
-
-void execute(void);
-void update_timer_regs(void);
+void sync_flags(gb_t *gb);
+void execute(gb_t *gb);
+void init_timer(gb_t *gb);
+void div_event(gb_t *gb);
+void sync_timer(gb_t *gb);
+void schedule_tima_event(gb_t *gb);
+void tima_event(gb_t *gb);
 
 #endif // CPU_H
\ No newline at end of file
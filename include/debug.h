@@ -2,13 +2,14 @@
 #define DEBUG_H
 
 #include <stdint.h>
+#include <gb.h>
 
 #define DEBUG_TILE_MAP_PIXEL_SIZE 2
 #define DEBUG_TILE_DATA_PIXEL_SIZE 2
 
 void init_debug(void);
 void free_debug(void);
-void update_debug(void);
+void update_debug(gb_t *gb);
 
 void get_inst_name(char *buffer, uint8_t inst);
 void get_prefix_inst_name(char *buffer, uint8_t inst);
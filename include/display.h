@@ -3,16 +3,20 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <gb.h>
 
 #define PIXEL_SIZE 4
-#define DISP_WIDTH 160
-#define DISP_HEIGHT 144
-
-extern size_t last_mode;
+#define DOTS_PER_FRAME 70224
 
 void init_display(void);
 void free_display(void);
-bool update_display(double frame_start);
-void update_stat_reg(void);
+bool update_display(gb_t *gb);
+void publish_frame(gb_t *gb);
+bool is_frame_pending(gb_t *gb);
+void present_display(gb_t *gb);
+void update_stat_reg(gb_t *gb);
+void sync_display(gb_t *gb);
+void schedule_ppu_event(gb_t *gb);
+void ppu_event(gb_t *gb);
 
 #endif // DISPLAY_H
\ No newline at end of file
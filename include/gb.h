@@ -0,0 +1,355 @@
+#ifndef GB_H
+#define GB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define CACHE_LINE_SIZE 64
+
+// Memory sizes
+#define TILE_SIZE 16
+#define MAP_SIZE 1024
+#define OBJ_SIZE 4
+
+#define VRAM_TILES_NUM 384
+#define VRAM_MAP_NUM 2
+#define OBJ_NUM 40
+#define LINE_OBJ_MAX 10
+#define WRAM_SIZE 0x2000
+#define HRAM_SIZE 0x7F
+#define IO_REG_SIZE 0x80
+#define PAGE_SIZE 0x100
+#define PAGE_NUM 0x100
+#define SERIAL_OUT_SIZE 0x1000
+#define ROM_BANK_SIZE 0x4000
+#define EXT_RAM_BANK_SIZE 0x2000
+#define EXT_RAM_MAX_SIZE 0x20000
+#define AUDIO_BUF_SIZE 4096
+
+// Display size
+#define DISP_WIDTH 160
+#define DISP_HEIGHT 144
+
+#define FRAMEBUFFER_SIZE (DISP_WIDTH * DISP_HEIGHT * sizeof(uint32_t))
+#define FRAME_FRESH 0x80
+
+#define IDLE_LOOP_CACHE_SIZE 64
+
+// Type definitions
+typedef union {
+    uint16_t r16;
+    struct {
+        uint8_t l; // swapped for
+        uint8_t h; // little-endian ordering
+    } r8;
+} reg_t;
+
+typedef uint8_t tile[TILE_SIZE];
+// A tile as 2-bit color indices, one byte per pixel, indexed [row][column]
+typedef uint8_t decoded_tile[8][8];
+typedef uint8_t map[MAP_SIZE];
+typedef uint8_t obj[OBJ_SIZE];
+
+// Events are keyed on absolute dot time. Each event is scheduled at most once;
+// scheduling it again moves it.
+typedef enum {
+    EVENT_DIV,  // next DIV increment
+    EVENT_TIMA, // next TIMA overflow
+    EVENT_PPU,  // next PPU mode transition, LY increment or VBlank
+    EVENT_SAV,  // next flush of battery-backed RAM to the save file
+    EVENT_APU,  // next step of the APU frame sequencer
+    EVENT_NUM
+} event_id_t;
+
+typedef struct {
+    uint64_t time;
+    event_id_t id;
+} event_t;
+
+// Memory bank controller of the cartridge
+typedef enum {
+    MBC_NONE,
+    MBC_1,
+    MBC_3,
+    MBC_5
+} mbc_type_t;
+
+// MBC3 clock registers, in the order they are selected (0x08-0x0C)
+typedef enum {
+    RTC_S,  // seconds
+    RTC_M,  // minutes
+    RTC_H,  // hours
+    RTC_DL, // lower 8 bits of the day counter
+    RTC_DH, // day counter bit 8, halt flag and day counter carry
+    RTC_REG_NUM
+} rtc_reg_t;
+
+// APU channels, in register order
+typedef enum {
+    APU_PULSE1,
+    APU_PULSE2,
+    APU_WAVE,
+    APU_NOISE,
+    APU_CHANNEL_NUM
+} apu_channel_id_t;
+
+// State of one APU channel behind its registers. Not every field is used by
+// every channel.
+typedef struct {
+    bool enabled;       // reported in NR52
+    bool dac_enabled;
+    uint8_t level;      // digital output, 0-15
+    uint8_t volume;     // envelope volume
+    uint8_t env_timer;  // envelope ticks to the next volume step
+    uint8_t pos;        // duty step or wave sample
+    uint16_t length;    // length ticks left
+    uint16_t lfsr;      // noise shift register
+    uint32_t period;    // dots per waveform step
+    uint32_t timer;     // dots from apu_time to the next waveform step
+} apu_channel_t;
+
+// A loaded ROM file, shared between instances (see rom.c)
+typedef struct rom_image rom_image_t;
+
+// A WAV file being written in the background (see wav.c)
+typedef struct wav_writer wav_writer_t;
+
+typedef struct {
+    const uint8_t *page; // read page of the loop, changes on bank switches
+    uint16_t branch_pc;
+    uint16_t target;
+    uint16_t cycles; // cycles per iteration, 0 if the loop isn't idle
+    uint8_t c;       // C at analysis, which decides what ldh a, [c] reads
+} idle_loop_t;
+
+// The complete state of one emulated Game Boy. Instances are independent, so
+// any number of them can run in one process. Fields touched by nearly every
+// instruction come first and share the leading cache lines.
+typedef struct {
+    // CPU registers
+    reg_t af, bc, de, hl, sp, pc;
+
+    // Lazy flags state, see sync_flags()
+    uint8_t flags_op;
+    uint8_t flags_a;
+    uint8_t flags_b;
+    uint8_t flags_carry; // carry in for add/sub, preserved carry for inc/dec
+    uint8_t flags_res;
+
+    bool set_ime;
+    bool ime;
+    bool halted;
+    bool halt_bug;
+
+    // Interrupt registers
+    uint8_t r_ie, r_if;
+
+    uint64_t dots;
+
+    // Dot time of the earliest pending event
+    uint64_t next_event_time;
+
+    // Page tables. One entry per 256-byte page; NULL marks a special page
+    // that goes through read_mem_slow/write_mem_slow.
+    uint8_t *read_pages[PAGE_NUM];
+    uint8_t *write_pages[PAGE_NUM];
+
+    // Binary min-heap of pending events, plus the heap slot of every event
+    // (heap index + 1, or 0 if it isn't scheduled)
+    event_t heap[EVENT_NUM];
+    size_t heap_size;
+    size_t heap_slot[EVENT_NUM];
+
+    // Timer state
+    uint64_t last_div_incr_time;
+    uint64_t last_tima_incr_time;
+
+    // Timer registers
+    uint8_t r_div, r_tima, r_tma, r_tac;
+
+    // LCD registers
+    uint8_t r_lcdc, r_ly, r_lyc, r_stat;
+    uint8_t r_scy, r_scx, r_wy, r_wx;
+    uint8_t r_bgp, r_obp0, r_obp1;
+    uint8_t r_dma;
+    uint8_t r_boot_rom_mapped;
+
+    // Serial Data Transfer registers
+    uint8_t r_sb, r_sc;
+
+    // Audio registers
+    uint8_t r_nr50; // Master volume & VIN panning
+    uint8_t r_nr51; // Sound panning
+    uint8_t r_nr52; // Audio master control
+    uint8_t r_nr10, r_nr11, r_nr12, r_nr13, r_nr14; // Channel 1 (Square)
+    uint8_t r_nr21, r_nr22, r_nr23, r_nr24; // Channel 2 (Square)
+    uint8_t r_nr30, r_nr31, r_nr32, r_nr33, r_nr34; // Channel 3 (Wave)
+    uint8_t m_wave[16]; // Wave pattern
+    uint8_t r_nr41, r_nr42, r_nr43, r_nr44; // Channel 4 (Noise)
+
+    // Button Inputs
+    bool b_buttons_select;
+    bool b_dpad_select;
+    bool b_left;
+    bool b_right;
+    bool b_up;
+    bool b_down;
+    bool b_a;
+    bool b_b;
+    bool b_start;
+    bool b_select;
+
+    // PPU state
+    bool req_stat_int_already;
+    bool frame_ready;
+    size_t last_mode;
+    size_t last_pixel;
+
+    // Objects on the current line, as OAM indices picked by the OAM scan and
+    // sorted by X, then OAM index, which is their DMG drawing priority
+    uint8_t line_objs[LINE_OBJ_MAX];
+    uint8_t line_obj_num;
+
+    // Idle loop detection. The last idle loop branch taken is kept to check
+    // that a full iteration ran since, with no event in between.
+    uint16_t idle_loop_pc;
+    uint64_t idle_loop_dots;
+    uint64_t idle_loop_next_event; // next_event_time at that branch
+    uint64_t idle_loop_dots_skipped;
+
+    // Cartridge
+    bool rom_loaded;
+    uint8_t cgb_flag;
+    uint8_t sgb_flag;
+    uint8_t rom_type;
+    size_t rom_size;
+    size_t ram_size;
+    size_t rom_bank_num;
+
+    // Memory bank controller state
+    mbc_type_t mbc_type;
+    bool has_rtc;
+    bool has_battery;
+    bool ram_enabled;
+    bool mbc1_mode;       // MBC1 advanced banking, also remaps 0x0000-0x3FFF
+    uint16_t rom_bank;    // bank register for 0x4000-0x7FFF
+    uint8_t ram_bank;     // also the upper ROM bank bits on MBC1, and the
+                          // clock register select on MBC3
+    size_t rom_low_bank;  // bank mapped at 0x0000-0x3FFF
+    size_t rom_high_bank; // bank mapped at 0x4000-0x7FFF
+
+    // MBC3 clock. The live registers are advanced lazily in whole seconds of
+    // emulated time; reads see the copy made by the last latch.
+    uint8_t rtc[RTC_REG_NUM];
+    uint8_t rtc_latched[RTC_REG_NUM];
+    uint8_t rtc_latch;  // last value written to the latch register
+    uint64_t rtc_dots;  // dot time the clock was last advanced to
+
+    // APU state behind the audio registers. The channels are run lazily, up
+    // to the current dot on register writes and frame sequencer steps.
+    apu_channel_t apu_ch[APU_CHANNEL_NUM];
+    uint64_t apu_time;      // dot time the channels have been run to
+    uint8_t apu_step;       // frame sequencer step, 0-7
+    bool sweep_enabled;
+    uint8_t sweep_timer;    // sweep ticks to the next period change
+    uint16_t sweep_shadow;  // period the sweep works from
+
+    // Memory
+    tile vram_tiles[VRAM_TILES_NUM];
+    map vram_maps[VRAM_MAP_NUM];
+    obj oam[OBJ_NUM];
+    uint8_t wram[WRAM_SIZE];
+    uint8_t io_reg[IO_REG_SIZE];
+    uint8_t hram[HRAM_SIZE];
+
+    // Tile data as color indices, kept in sync with vram_tiles
+    decoded_tile decoded_tiles[VRAM_TILES_NUM];
+
+    // Bytes sent over the serial port, used to match test ROM output
+    char serial_out[SERIAL_OUT_SIZE + 1];
+    size_t serial_out_len;
+
+    // Everything above is the machine state that save states copy as is,
+    // except for the page tables, which are rebuilt on load. What follows
+    // belongs to the host and is kept on load; idle_loop_cache must stay the
+    // first field here (see STATE_GB_SIZE).
+
+    // Idle loops found in ROM, keyed on the branch address
+    idle_loop_t idle_loop_cache[IDLE_LOOP_CACHE_SIZE];
+
+    // Settings
+    bool accurate_ppu;
+    bool print_serial; // also echo serial output to stdout
+    size_t frame_skip; // frames left undrawn after each drawn one by
+                       // run_headless()
+
+    // Set once the program has done something the emulator doesn't support,
+    // which stops the instance (see stop_on_error())
+    bool error;
+
+    // The frame being run writes no pixels. Its PPU timing, and so LY, STAT
+    // and the interrupts, stay exact.
+    bool skip_draw;
+
+    uint8_t *rom; // read-only, may be shared with other instances
+    rom_image_t *rom_image;
+
+    // External RAM, ram_size bytes. Battery-backed RAM can be a shared
+    // mapping of the save file, in which case a RAM page is only mapped for
+    // writing once it's dirty, so the first write after each flush goes
+    // through the slow path to mark it.
+    uint8_t *ext_ram;
+    bool sav_mapped;
+    bool ext_ram_dirty[EXT_RAM_MAX_SIZE / PAGE_SIZE];
+
+    // Band-limited synthesis of the APU output, see apu.c. Samples are only
+    // made while output_audio is set, like serial output with print_serial.
+    bool output_audio;
+    uint64_t audio_time;  // dot time at audio_pos
+    uint64_t audio_pos;   // position in audio_buf, 32.32 fixed point
+    uint64_t audio_rate;  // samples per dot, 32.32 fixed point
+    int32_t audio_mix[2]; // output level audio_buf has reached, left/right
+    float audio_sum[2];   // running sum of audio_buf up to its start
+    float audio_dc[2];    // DC level removed from the output
+    float audio_buf[2][AUDIO_BUF_SIZE];
+    wav_writer_t *wav; // receives the samples made by run_headless()
+
+    // ARGB8888 frames, triple-buffered so that completed frames can be handed
+    // to another thread without locks (see publish_frame()). The core draws
+    // into framebuffers[frame_back], the presenter shows
+    // framebuffers[frame_front], and frame_middle holds the newest complete
+    // frame, with FRAME_FRESH set until the presenter takes it.
+    uint32_t *framebuffer; // frame being drawn
+    uint32_t framebuffers[3][DISP_WIDTH * DISP_HEIGHT];
+    uint8_t frame_back;
+    uint8_t frame_front;
+    uint8_t frame_middle; // accessed atomically
+} gb_t;
+
+// Conditions that end a headless run
+typedef struct {
+    uint64_t max_frames;
+    uint64_t max_dots;
+    const char *pass_match; // serial output that ends the run as passed
+    const char *fail_match; // serial output that ends the run as failed
+} run_limits_t;
+
+typedef enum {
+    RUN_RUNNING,
+    RUN_LIMIT_REACHED,
+    RUN_PASSED,
+    RUN_FAILED,
+    RUN_ERROR // the program did something the emulator doesn't support
+} run_result_t;
+
+gb_t *init_gb(const char *rom_path, bool run_boot);
+void free_gb(gb_t *gb);
+void stop_on_error(gb_t *gb);
+bool run_frame(gb_t *gb, uint64_t dot_limit);
+run_result_t check_run_limits(gb_t *gb, const run_limits_t *limits,
+                              uint64_t frames);
+run_result_t run_headless(gb_t *gb, const run_limits_t *limits,
+                          uint64_t *frames);
+
+#endif // GB_H
@@ -0,0 +1,25 @@
+#ifndef MBC_H
+#define MBC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <gb.h>
+
+#define DOTS_PER_SECOND 4194304
+
+// MBC3 DH register bits
+#define RTC_DH_DAY_HIGH 0x01
+#define RTC_DH_HALT 0x40
+#define RTC_DH_CARRY 0x80
+
+bool init_mbc(gb_t *gb, const char *rom_path);
+void free_mbc(gb_t *gb);
+void map_rom_banks(gb_t *gb);
+void map_ext_ram(gb_t *gb);
+void write_ext_ram(gb_t *gb, uint16_t addr, uint8_t val);
+void write_mbc(gb_t *gb, uint16_t addr, uint8_t val);
+bool rtc_selected(gb_t *gb);
+uint8_t read_rtc(gb_t *gb);
+void write_rtc(gb_t *gb, uint8_t val);
+
+#endif // MBC_H
@@ -3,21 +3,8 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-
-#define TILE_SIZE 16
-#define MAP_SIZE 1024
-#define OBJ_SIZE 4
-
-#define VRAM_TILES_NUM 384
-#define VRAM_MAP_NUM 2
-#define OBJ_NUM 40
-#define WRAM_SIZE 0x2000
-#define HRAM_SIZE 0x7F
-#define IO_REG_SIZE 0x80
-
-typedef uint8_t tile[TILE_SIZE];
-typedef uint8_t map[MAP_SIZE];
-typedef uint8_t obj[OBJ_SIZE];
+#include <stddef.h>
+#include <gb.h>
 
 // Memory Ranges
 #define ROM_A 0x0000
@@ -42,44 +29,37 @@ typedef uint8_t obj[OBJ_SIZE];
 #define LCDC_OBJ_ENABLED 0x02
 #define LCDC_BG_WIN_ENABLED 0x01
 
-// Memory components
-extern tile vram_tiles[VRAM_TILES_NUM];
-extern map vram_maps[VRAM_MAP_NUM];
-extern obj oam[OBJ_NUM];
-extern uint8_t wram[WRAM_SIZE];
-extern uint8_t io_reg[IO_REG_SIZE];
-extern uint8_t hram[HRAM_SIZE];
+// Object attribute bitmasks
+#define OBJ_BG_PRIORITY 0x80
+#define OBJ_Y_FLIP 0x40
+#define OBJ_X_FLIP 0x20
+#define OBJ_PALETTE 0x10
 
-// Hardware Registers
-extern uint8_t r_sb, r_sc;
-extern uint8_t r_div, r_tima, r_tma, r_tac;
-extern uint8_t r_ie, r_if;
-extern uint8_t r_nr50, r_nr51, r_nr52;
-extern uint8_t r_nr10, r_nr11, r_nr12, r_nr13, r_nr14;
-extern uint8_t r_nr21, r_nr22, r_nr23, r_nr24;
-extern uint8_t r_nr30, r_nr31, r_nr32, r_nr33, r_nr34;
-extern uint8_t r_nr41, r_nr42, r_nr43, r_nr44;
-extern uint8_t r_lcdc, r_ly, r_lyc, r_stat;
-extern uint8_t r_scy, r_scx, r_wy, r_wx;
-extern uint8_t r_bgp, r_obp0, r_obp1;
-extern uint8_t r_dma;
-extern uint8_t r_boot_rom_mapped;
-extern uint8_t m_wave[16];
+// Function prototypes
+void init_mem(gb_t *gb);
+void update_boot_rom_page(gb_t *gb);
+uint8_t read_mem_slow(gb_t *gb, uint16_t addr);
+void write_mem_slow(gb_t *gb, uint16_t addr, uint8_t val);
+uint8_t read_io(gb_t *gb, uint16_t addr);
+void write_io(gb_t *gb, uint16_t addr, uint8_t val);
 
-// Button Inputs
-extern bool b_buttons_select;
-extern bool b_dpad_select;
-extern bool b_left;
-extern bool b_right;
-extern bool b_up;
-extern bool b_down;
-extern bool b_a;
-extern bool b_b;
-extern bool b_start;
-extern bool b_select;
+// Directly mapped pages are served by a single indexed load or store; the
+// rest fall through to the slow path.
+static inline uint8_t read_mem(gb_t *gb, uint16_t addr) {
+    const uint8_t *page = gb->read_pages[addr >> 8];
+    if (page) {
+        return page[addr & 0xFF];
+    }
+    return read_mem_slow(gb, addr);
+}
 
-// Function prototypes
-uint8_t read_mem(uint16_t addr);
-void write_mem(uint16_t addr, uint8_t val);
+static inline void write_mem(gb_t *gb, uint16_t addr, uint8_t val) {
+    uint8_t *page = gb->write_pages[addr >> 8];
+    if (page) {
+        page[addr & 0xFF] = val;
+        return;
+    }
+    write_mem_slow(gb, addr, val);
+}
 
 #endif // MEMORY_H
@@ -0,0 +1,527 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+
+// Opcode tables for the table-driven decoder in cpu.c. Each entry is
+// X(opcode, template, a, b, cycles, length), where a and b are the operand
+// indices baked into the template, cycles is the base cost in dots (taken
+// branches add the difference themselves) and length is the number of bytes
+// pc advances by before the template runs. CB-prefixed entries count from
+// the byte after 0xCB.
+
+#define MAIN_OPCODES(X) \
+    X(0x00, nop,           0,    0, 4,  1)        /* nop */ \
+    X(0x01, ld_r16_imm16,  0,    0, 12, 3)        /* ld bc, imm16 */ \
+    X(0x02, ld_r16mem_a,   0,    0, 8,  1)        /* ld [bc], a */ \
+    X(0x03, inc_r16,       0,    0, 8,  1)        /* inc bc */ \
+    X(0x04, inc_r8,        0,    0, 4,  1)        /* inc b */ \
+    X(0x05, dec_r8,        0,    0, 4,  1)        /* dec b */ \
+    X(0x06, ld_r8_imm8,    0,    0, 8,  2)        /* ld b, imm8 */ \
+    X(0x07, rlca,          0,    0, 4,  1)        /* rlca */ \
+    X(0x08, ld_imm16_sp,   0,    0, 20, 3)        /* ld [imm16], sp */ \
+    X(0x09, add_hl_r16,    0,    0, 8,  1)        /* add hl, bc */ \
+    X(0x0A, ld_a_r16mem,   0,    0, 8,  1)        /* ld a, [bc] */ \
+    X(0x0B, dec_r16,       0,    0, 8,  1)        /* dec bc */ \
+    X(0x0C, inc_r8,        1,    0, 4,  1)        /* inc c */ \
+    X(0x0D, dec_r8,        1,    0, 4,  1)        /* dec c */ \
+    X(0x0E, ld_r8_imm8,    1,    0, 8,  2)        /* ld c, imm8 */ \
+    X(0x0F, rrca,          0,    0, 4,  1)        /* rrca */ \
+    X(0x10, stop,          0,    0, 4,  2)        /* stop */ \
+    X(0x11, ld_r16_imm16,  1,    0, 12, 3)        /* ld de, imm16 */ \
+    X(0x12, ld_r16mem_a,   1,    0, 8,  1)        /* ld [de], a */ \
+    X(0x13, inc_r16,       1,    0, 8,  1)        /* inc de */ \
+    X(0x14, inc_r8,        2,    0, 4,  1)        /* inc d */ \
+    X(0x15, dec_r8,        2,    0, 4,  1)        /* dec d */ \
+    X(0x16, ld_r8_imm8,    2,    0, 8,  2)        /* ld d, imm8 */ \
+    X(0x17, rla,           0,    0, 4,  1)        /* rla */ \
+    X(0x18, jr_imm8,       0,    0, 12, 2)        /* jr imm8 */ \
+    X(0x19, add_hl_r16,    1,    0, 8,  1)        /* add hl, de */ \
+    X(0x1A, ld_a_r16mem,   1,    0, 8,  1)        /* ld a, [de] */ \
+    X(0x1B, dec_r16,       1,    0, 8,  1)        /* dec de */ \
+    X(0x1C, inc_r8,        3,    0, 4,  1)        /* inc e */ \
+    X(0x1D, dec_r8,        3,    0, 4,  1)        /* dec e */ \
+    X(0x1E, ld_r8_imm8,    3,    0, 8,  2)        /* ld e, imm8 */ \
+    X(0x1F, rra,           0,    0, 4,  1)        /* rra */ \
+    X(0x20, jr_cond,       0,    0, 8,  2)        /* jr nz, imm8 */ \
+    X(0x21, ld_r16_imm16,  2,    0, 12, 3)        /* ld hl, imm16 */ \
+    X(0x22, ld_r16mem_a,   2,    0, 8,  1)        /* ld [hl+], a */ \
+    X(0x23, inc_r16,       2,    0, 8,  1)        /* inc hl */ \
+    X(0x24, inc_r8,        4,    0, 4,  1)        /* inc h */ \
+    X(0x25, dec_r8,        4,    0, 4,  1)        /* dec h */ \
+    X(0x26, ld_r8_imm8,    4,    0, 8,  2)        /* ld h, imm8 */ \
+    X(0x27, daa,           0,    0, 4,  1)        /* daa */ \
+    X(0x28, jr_cond,       1,    0, 8,  2)        /* jr z, imm8 */ \
+    X(0x29, add_hl_r16,    2,    0, 8,  1)        /* add hl, hl */ \
+    X(0x2A, ld_a_r16mem,   2,    0, 8,  1)        /* ld a, [hl+] */ \
+    X(0x2B, dec_r16,       2,    0, 8,  1)        /* dec hl */ \
+    X(0x2C, inc_r8,        5,    0, 4,  1)        /* inc l */ \
+    X(0x2D, dec_r8,        5,    0, 4,  1)        /* dec l */ \
+    X(0x2E, ld_r8_imm8,    5,    0, 8,  2)        /* ld l, imm8 */ \
+    X(0x2F, cpl,           0,    0, 4,  1)        /* cpl */ \
+    X(0x30, jr_cond,       2,    0, 8,  2)        /* jr nc, imm8 */ \
+    X(0x31, ld_r16_imm16,  3,    0, 12, 3)        /* ld sp, imm16 */ \
+    X(0x32, ld_r16mem_a,   3,    0, 8,  1)        /* ld [hl-], a */ \
+    X(0x33, inc_r16,       3,    0, 8,  1)        /* inc sp */ \
+    X(0x34, inc_r8,        6,    0, 12, 1)        /* inc [hl] */ \
+    X(0x35, dec_r8,        6,    0, 12, 1)        /* dec [hl] */ \
+    X(0x36, ld_r8_imm8,    6,    0, 12, 2)        /* ld [hl], imm8 */ \
+    X(0x37, scf,           0,    0, 4,  1)        /* scf */ \
+    X(0x38, jr_cond,       3,    0, 8,  2)        /* jr c, imm8 */ \
+    X(0x39, add_hl_r16,    3,    0, 8,  1)        /* add hl, sp */ \
+    X(0x3A, ld_a_r16mem,   3,    0, 8,  1)        /* ld a, [hl-] */ \
+    X(0x3B, dec_r16,       3,    0, 8,  1)        /* dec sp */ \
+    X(0x3C, inc_r8,        7,    0, 4,  1)        /* inc a */ \
+    X(0x3D, dec_r8,        7,    0, 4,  1)        /* dec a */ \
+    X(0x3E, ld_r8_imm8,    7,    0, 8,  2)        /* ld a, imm8 */ \
+    X(0x3F, ccf,           0,    0, 4,  1)        /* ccf */ \
+    X(0x40, ld_r8_r8,      0,    0, 4,  1)        /* ld b, b */ \
+    X(0x41, ld_r8_r8,      0,    1, 4,  1)        /* ld b, c */ \
+    X(0x42, ld_r8_r8,      0,    2, 4,  1)        /* ld b, d */ \
+    X(0x43, ld_r8_r8,      0,    3, 4,  1)        /* ld b, e */ \
+    X(0x44, ld_r8_r8,      0,    4, 4,  1)        /* ld b, h */ \
+    X(0x45, ld_r8_r8,      0,    5, 4,  1)        /* ld b, l */ \
+    X(0x46, ld_r8_r8,      0,    6, 8,  1)        /* ld b, [hl] */ \
+    X(0x47, ld_r8_r8,      0,    7, 4,  1)        /* ld b, a */ \
+    X(0x48, ld_r8_r8,      1,    0, 4,  1)        /* ld c, b */ \
+    X(0x49, ld_r8_r8,      1,    1, 4,  1)        /* ld c, c */ \
+    X(0x4A, ld_r8_r8,      1,    2, 4,  1)        /* ld c, d */ \
+    X(0x4B, ld_r8_r8,      1,    3, 4,  1)        /* ld c, e */ \
+    X(0x4C, ld_r8_r8,      1,    4, 4,  1)        /* ld c, h */ \
+    X(0x4D, ld_r8_r8,      1,    5, 4,  1)        /* ld c, l */ \
+    X(0x4E, ld_r8_r8,      1,    6, 8,  1)        /* ld c, [hl] */ \
+    X(0x4F, ld_r8_r8,      1,    7, 4,  1)        /* ld c, a */ \
+    X(0x50, ld_r8_r8,      2,    0, 4,  1)        /* ld d, b */ \
+    X(0x51, ld_r8_r8,      2,    1, 4,  1)        /* ld d, c */ \
+    X(0x52, ld_r8_r8,      2,    2, 4,  1)        /* ld d, d */ \
+    X(0x53, ld_r8_r8,      2,    3, 4,  1)        /* ld d, e */ \
+    X(0x54, ld_r8_r8,      2,    4, 4,  1)        /* ld d, h */ \
+    X(0x55, ld_r8_r8,      2,    5, 4,  1)        /* ld d, l */ \
+    X(0x56, ld_r8_r8,      2,    6, 8,  1)        /* ld d, [hl] */ \
+    X(0x57, ld_r8_r8,      2,    7, 4,  1)        /* ld d, a */ \
+    X(0x58, ld_r8_r8,      3,    0, 4,  1)        /* ld e, b */ \
+    X(0x59, ld_r8_r8,      3,    1, 4,  1)        /* ld e, c */ \
+    X(0x5A, ld_r8_r8,      3,    2, 4,  1)        /* ld e, d */ \
+    X(0x5B, ld_r8_r8,      3,    3, 4,  1)        /* ld e, e */ \
+    X(0x5C, ld_r8_r8,      3,    4, 4,  1)        /* ld e, h */ \
+    X(0x5D, ld_r8_r8,      3,    5, 4,  1)        /* ld e, l */ \
+    X(0x5E, ld_r8_r8,      3,    6, 8,  1)        /* ld e, [hl] */ \
+    X(0x5F, ld_r8_r8,      3,    7, 4,  1)        /* ld e, a */ \
+    X(0x60, ld_r8_r8,      4,    0, 4,  1)        /* ld h, b */ \
+    X(0x61, ld_r8_r8,      4,    1, 4,  1)        /* ld h, c */ \
+    X(0x62, ld_r8_r8,      4,    2, 4,  1)        /* ld h, d */ \
+    X(0x63, ld_r8_r8,      4,    3, 4,  1)        /* ld h, e */ \
+    X(0x64, ld_r8_r8,      4,    4, 4,  1)        /* ld h, h */ \
+    X(0x65, ld_r8_r8,      4,    5, 4,  1)        /* ld h, l */ \
+    X(0x66, ld_r8_r8,      4,    6, 8,  1)        /* ld h, [hl] */ \
+    X(0x67, ld_r8_r8,      4,    7, 4,  1)        /* ld h, a */ \
+    X(0x68, ld_r8_r8,      5,    0, 4,  1)        /* ld l, b */ \
+    X(0x69, ld_r8_r8,      5,    1, 4,  1)        /* ld l, c */ \
+    X(0x6A, ld_r8_r8,      5,    2, 4,  1)        /* ld l, d */ \
+    X(0x6B, ld_r8_r8,      5,    3, 4,  1)        /* ld l, e */ \
+    X(0x6C, ld_r8_r8,      5,    4, 4,  1)        /* ld l, h */ \
+    X(0x6D, ld_r8_r8,      5,    5, 4,  1)        /* ld l, l */ \
+    X(0x6E, ld_r8_r8,      5,    6, 8,  1)        /* ld l, [hl] */ \
+    X(0x6F, ld_r8_r8,      5,    7, 4,  1)        /* ld l, a */ \
+    X(0x70, ld_r8_r8,      6,    0, 8,  1)        /* ld [hl], b */ \
+    X(0x71, ld_r8_r8,      6,    1, 8,  1)        /* ld [hl], c */ \
+    X(0x72, ld_r8_r8,      6,    2, 8,  1)        /* ld [hl], d */ \
+    X(0x73, ld_r8_r8,      6,    3, 8,  1)        /* ld [hl], e */ \
+    X(0x74, ld_r8_r8,      6,    4, 8,  1)        /* ld [hl], h */ \
+    X(0x75, ld_r8_r8,      6,    5, 8,  1)        /* ld [hl], l */ \
+    X(0x76, halt,          0,    0, 4,  1)        /* halt */ \
+    X(0x77, ld_r8_r8,      6,    7, 8,  1)        /* ld [hl], a */ \
+    X(0x78, ld_r8_r8,      7,    0, 4,  1)        /* ld a, b */ \
+    X(0x79, ld_r8_r8,      7,    1, 4,  1)        /* ld a, c */ \
+    X(0x7A, ld_r8_r8,      7,    2, 4,  1)        /* ld a, d */ \
+    X(0x7B, ld_r8_r8,      7,    3, 4,  1)        /* ld a, e */ \
+    X(0x7C, ld_r8_r8,      7,    4, 4,  1)        /* ld a, h */ \
+    X(0x7D, ld_r8_r8,      7,    5, 4,  1)        /* ld a, l */ \
+    X(0x7E, ld_r8_r8,      7,    6, 8,  1)        /* ld a, [hl] */ \
+    X(0x7F, ld_r8_r8,      7,    7, 4,  1)        /* ld a, a */ \
+    X(0x80, add_a_r8,      0,    0, 4,  1)        /* add a, b */ \
+    X(0x81, add_a_r8,      1,    0, 4,  1)        /* add a, c */ \
+    X(0x82, add_a_r8,      2,    0, 4,  1)        /* add a, d */ \
+    X(0x83, add_a_r8,      3,    0, 4,  1)        /* add a, e */ \
+    X(0x84, add_a_r8,      4,    0, 4,  1)        /* add a, h */ \
+    X(0x85, add_a_r8,      5,    0, 4,  1)        /* add a, l */ \
+    X(0x86, add_a_r8,      6,    0, 8,  1)        /* add a, [hl] */ \
+    X(0x87, add_a_r8,      7,    0, 4,  1)        /* add a, a */ \
+    X(0x88, adc_a_r8,      0,    0, 4,  1)        /* adc a, b */ \
+    X(0x89, adc_a_r8,      1,    0, 4,  1)        /* adc a, c */ \
+    X(0x8A, adc_a_r8,      2,    0, 4,  1)        /* adc a, d */ \
+    X(0x8B, adc_a_r8,      3,    0, 4,  1)        /* adc a, e */ \
+    X(0x8C, adc_a_r8,      4,    0, 4,  1)        /* adc a, h */ \
+    X(0x8D, adc_a_r8,      5,    0, 4,  1)        /* adc a, l */ \
+    X(0x8E, adc_a_r8,      6,    0, 8,  1)        /* adc a, [hl] */ \
+    X(0x8F, adc_a_r8,      7,    0, 4,  1)        /* adc a, a */ \
+    X(0x90, sub_a_r8,      0,    0, 4,  1)        /* sub a, b */ \
+    X(0x91, sub_a_r8,      1,    0, 4,  1)        /* sub a, c */ \
+    X(0x92, sub_a_r8,      2,    0, 4,  1)        /* sub a, d */ \
+    X(0x93, sub_a_r8,      3,    0, 4,  1)        /* sub a, e */ \
+    X(0x94, sub_a_r8,      4,    0, 4,  1)        /* sub a, h */ \
+    X(0x95, sub_a_r8,      5,    0, 4,  1)        /* sub a, l */ \
+    X(0x96, sub_a_r8,      6,    0, 8,  1)        /* sub a, [hl] */ \
+    X(0x97, sub_a_r8,      7,    0, 4,  1)        /* sub a, a */ \
+    X(0x98, sbc_a_r8,      0,    0, 4,  1)        /* sbc a, b */ \
+    X(0x99, sbc_a_r8,      1,    0, 4,  1)        /* sbc a, c */ \
+    X(0x9A, sbc_a_r8,      2,    0, 4,  1)        /* sbc a, d */ \
+    X(0x9B, sbc_a_r8,      3,    0, 4,  1)        /* sbc a, e */ \
+    X(0x9C, sbc_a_r8,      4,    0, 4,  1)        /* sbc a, h */ \
+    X(0x9D, sbc_a_r8,      5,    0, 4,  1)        /* sbc a, l */ \
+    X(0x9E, sbc_a_r8,      6,    0, 8,  1)        /* sbc a, [hl] */ \
+    X(0x9F, sbc_a_r8,      7,    0, 4,  1)        /* sbc a, a */ \
+    X(0xA0, and_a_r8,      0,    0, 4,  1)        /* and a, b */ \
+    X(0xA1, and_a_r8,      1,    0, 4,  1)        /* and a, c */ \
+    X(0xA2, and_a_r8,      2,    0, 4,  1)        /* and a, d */ \
+    X(0xA3, and_a_r8,      3,    0, 4,  1)        /* and a, e */ \
+    X(0xA4, and_a_r8,      4,    0, 4,  1)        /* and a, h */ \
+    X(0xA5, and_a_r8,      5,    0, 4,  1)        /* and a, l */ \
+    X(0xA6, and_a_r8,      6,    0, 8,  1)        /* and a, [hl] */ \
+    X(0xA7, and_a_r8,      7,    0, 4,  1)        /* and a, a */ \
+    X(0xA8, xor_a_r8,      0,    0, 4,  1)        /* xor a, b */ \
+    X(0xA9, xor_a_r8,      1,    0, 4,  1)        /* xor a, c */ \
+    X(0xAA, xor_a_r8,      2,    0, 4,  1)        /* xor a, d */ \
+    X(0xAB, xor_a_r8,      3,    0, 4,  1)        /* xor a, e */ \
+    X(0xAC, xor_a_r8,      4,    0, 4,  1)        /* xor a, h */ \
+    X(0xAD, xor_a_r8,      5,    0, 4,  1)        /* xor a, l */ \
+    X(0xAE, xor_a_r8,      6,    0, 8,  1)        /* xor a, [hl] */ \
+    X(0xAF, xor_a_r8,      7,    0, 4,  1)        /* xor a, a */ \
+    X(0xB0, or_a_r8,       0,    0, 4,  1)        /* or a, b */ \
+    X(0xB1, or_a_r8,       1,    0, 4,  1)        /* or a, c */ \
+    X(0xB2, or_a_r8,       2,    0, 4,  1)        /* or a, d */ \
+    X(0xB3, or_a_r8,       3,    0, 4,  1)        /* or a, e */ \
+    X(0xB4, or_a_r8,       4,    0, 4,  1)        /* or a, h */ \
+    X(0xB5, or_a_r8,       5,    0, 4,  1)        /* or a, l */ \
+    X(0xB6, or_a_r8,       6,    0, 8,  1)        /* or a, [hl] */ \
+    X(0xB7, or_a_r8,       7,    0, 4,  1)        /* or a, a */ \
+    X(0xB8, cp_a_r8,       0,    0, 4,  1)        /* cp a, b */ \
+    X(0xB9, cp_a_r8,       1,    0, 4,  1)        /* cp a, c */ \
+    X(0xBA, cp_a_r8,       2,    0, 4,  1)        /* cp a, d */ \
+    X(0xBB, cp_a_r8,       3,    0, 4,  1)        /* cp a, e */ \
+    X(0xBC, cp_a_r8,       4,    0, 4,  1)        /* cp a, h */ \
+    X(0xBD, cp_a_r8,       5,    0, 4,  1)        /* cp a, l */ \
+    X(0xBE, cp_a_r8,       6,    0, 8,  1)        /* cp a, [hl] */ \
+    X(0xBF, cp_a_r8,       7,    0, 4,  1)        /* cp a, a */ \
+    X(0xC0, ret_cond,      0,    0, 8,  1)        /* ret nz */ \
+    X(0xC1, pop_r16stk,    0,    0, 12, 1)        /* pop bc */ \
+    X(0xC2, jp_cond,       0,    0, 12, 3)        /* jp nz, imm16 */ \
+    X(0xC3, jp_imm16,      0,    0, 16, 3)        /* jp imm16 */ \
+    X(0xC4, call_cond,     0,    0, 12, 3)        /* call nz, imm16 */ \
+    X(0xC5, push_r16stk,   0,    0, 16, 1)        /* push bc */ \
+    X(0xC6, add_a_imm8,    0,    0, 8,  2)        /* add a, imm8 */ \
+    X(0xC7, rst,           0x00, 0, 16, 1)        /* rst 0x00 */ \
+    X(0xC8, ret_cond,      1,    0, 8,  1)        /* ret z */ \
+    X(0xC9, ret,           0,    0, 16, 1)        /* ret */ \
+    X(0xCA, jp_cond,       1,    0, 12, 3)        /* jp z, imm16 */ \
+    X(0xCB, prefix,        0,    0, 0,  1)        /* prefix */ \
+    X(0xCC, call_cond,     1,    0, 12, 3)        /* call z, imm16 */ \
+    X(0xCD, call_imm16,    0,    0, 24, 3)        /* call imm16 */ \
+    X(0xCE, adc_a_imm8,    0,    0, 8,  2)        /* adc a, imm8 */ \
+    X(0xCF, rst,           0x08, 0, 16, 1)        /* rst 0x08 */ \
+    X(0xD0, ret_cond,      2,    0, 8,  1)        /* ret nc */ \
+    X(0xD1, pop_r16stk,    1,    0, 12, 1)        /* pop de */ \
+    X(0xD2, jp_cond,       2,    0, 12, 3)        /* jp nc, imm16 */ \
+    X(0xD3, invalid,       0xD3, 0, 0,  1)        /* invalid */ \
+    X(0xD4, call_cond,     2,    0, 12, 3)        /* call nc, imm16 */ \
+    X(0xD5, push_r16stk,   1,    0, 16, 1)        /* push de */ \
+    X(0xD6, sub_a_imm8,    0,    0, 8,  2)        /* sub a, imm8 */ \
+    X(0xD7, rst,           0x10, 0, 16, 1)        /* rst 0x10 */ \
+    X(0xD8, ret_cond,      3,    0, 8,  1)        /* ret c */ \
+    X(0xD9, reti,          0,    0, 16, 1)        /* reti */ \
+    X(0xDA, jp_cond,       3,    0, 12, 3)        /* jp c, imm16 */ \
+    X(0xDB, invalid,       0xDB, 0, 0,  1)        /* invalid */ \
+    X(0xDC, call_cond,     3,    0, 12, 3)        /* call c, imm16 */ \
+    X(0xDD, invalid,       0xDD, 0, 0,  1)        /* invalid */ \
+    X(0xDE, sbc_a_imm8,    0,    0, 8,  2)        /* sbc a, imm8 */ \
+    X(0xDF, rst,           0x18, 0, 16, 1)        /* rst 0x18 */ \
+    X(0xE0, ldh_imm8_a,    0,    0, 12, 2)        /* ldh [imm8], a */ \
+    X(0xE1, pop_r16stk,    2,    0, 12, 1)        /* pop hl */ \
+    X(0xE2, ldh_c_a,       0,    0, 8,  1)        /* ldh [c], a */ \
+    X(0xE3, invalid,       0xE3, 0, 0,  1)        /* invalid */ \
+    X(0xE4, invalid,       0xE4, 0, 0,  1)        /* invalid */ \
+    X(0xE5, push_r16stk,   2,    0, 16, 1)        /* push hl */ \
+    X(0xE6, and_a_imm8,    0,    0, 8,  2)        /* and a, imm8 */ \
+    X(0xE7, rst,           0x20, 0, 16, 1)        /* rst 0x20 */ \
+    X(0xE8, add_sp_imm8,   0,    0, 16, 2)        /* add sp, imm8 */ \
+    X(0xE9, jp_hl,         0,    0, 4,  1)        /* jp hl */ \
+    X(0xEA, ld_imm16_a,    0,    0, 16, 3)        /* ld [imm16], a */ \
+    X(0xEB, invalid,       0xEB, 0, 0,  1)        /* invalid */ \
+    X(0xEC, invalid,       0xEC, 0, 0,  1)        /* invalid */ \
+    X(0xED, invalid,       0xED, 0, 0,  1)        /* invalid */ \
+    X(0xEE, xor_a_imm8,    0,    0, 8,  2)        /* xor a, imm8 */ \
+    X(0xEF, rst,           0x28, 0, 16, 1)        /* rst 0x28 */ \
+    X(0xF0, ldh_a_imm8,    0,    0, 12, 2)        /* ldh a, [imm8] */ \
+    X(0xF1, pop_r16stk,    3,    0, 12, 1)        /* pop af */ \
+    X(0xF2, ldh_a_c,       0,    0, 8,  1)        /* ldh a, [c] */ \
+    X(0xF3, di,            0,    0, 4,  1)        /* di */ \
+    X(0xF4, invalid,       0xF4, 0, 0,  1)        /* invalid */ \
+    X(0xF5, push_r16stk,   3,    0, 16, 1)        /* push af */ \
+    X(0xF6, or_a_imm8,     0,    0, 8,  2)        /* or a, imm8 */ \
+    X(0xF7, rst,           0x30, 0, 16, 1)        /* rst 0x30 */ \
+    X(0xF8, ld_hl_sp_imm8, 0,    0, 12, 2)        /* ld hl, sp + imm8 */ \
+    X(0xF9, ld_sp_hl,      0,    0, 8,  1)        /* ld sp, hl */ \
+    X(0xFA, ld_a_imm16,    0,    0, 16, 3)        /* ld a, [imm16] */ \
+    X(0xFB, ei,            0,    0, 4,  1)        /* ei */ \
+    X(0xFC, invalid,       0xFC, 0, 0,  1)        /* invalid */ \
+    X(0xFD, invalid,       0xFD, 0, 0,  1)        /* invalid */ \
+    X(0xFE, cp_a_imm8,     0,    0, 8,  2)        /* cp a, imm8 */ \
+    X(0xFF, rst,           0x38, 0, 16, 1)        /* rst 0x38 */
+
+#define CB_OPCODES(X) \
+    X(0x00, rlc_r8,  0,    0, 8,  1)              /* rlc b */ \
+    X(0x01, rlc_r8,  1,    0, 8,  1)              /* rlc c */ \
+    X(0x02, rlc_r8,  2,    0, 8,  1)              /* rlc d */ \
+    X(0x03, rlc_r8,  3,    0, 8,  1)              /* rlc e */ \
+    X(0x04, rlc_r8,  4,    0, 8,  1)              /* rlc h */ \
+    X(0x05, rlc_r8,  5,    0, 8,  1)              /* rlc l */ \
+    X(0x06, rlc_r8,  6,    0, 16, 1)              /* rlc [hl] */ \
+    X(0x07, rlc_r8,  7,    0, 8,  1)              /* rlc a */ \
+    X(0x08, rrc_r8,  0,    0, 8,  1)              /* rrc b */ \
+    X(0x09, rrc_r8,  1,    0, 8,  1)              /* rrc c */ \
+    X(0x0A, rrc_r8,  2,    0, 8,  1)              /* rrc d */ \
+    X(0x0B, rrc_r8,  3,    0, 8,  1)              /* rrc e */ \
+    X(0x0C, rrc_r8,  4,    0, 8,  1)              /* rrc h */ \
+    X(0x0D, rrc_r8,  5,    0, 8,  1)              /* rrc l */ \
+    X(0x0E, rrc_r8,  6,    0, 16, 1)              /* rrc [hl] */ \
+    X(0x0F, rrc_r8,  7,    0, 8,  1)              /* rrc a */ \
+    X(0x10, rl_r8,   0,    0, 8,  1)              /* rl b */ \
+    X(0x11, rl_r8,   1,    0, 8,  1)              /* rl c */ \
+    X(0x12, rl_r8,   2,    0, 8,  1)              /* rl d */ \
+    X(0x13, rl_r8,   3,    0, 8,  1)              /* rl e */ \
+    X(0x14, rl_r8,   4,    0, 8,  1)              /* rl h */ \
+    X(0x15, rl_r8,   5,    0, 8,  1)              /* rl l */ \
+    X(0x16, rl_r8,   6,    0, 16, 1)              /* rl [hl] */ \
+    X(0x17, rl_r8,   7,    0, 8,  1)              /* rl a */ \
+    X(0x18, rr_r8,   0,    0, 8,  1)              /* rr b */ \
+    X(0x19, rr_r8,   1,    0, 8,  1)              /* rr c */ \
+    X(0x1A, rr_r8,   2,    0, 8,  1)              /* rr d */ \
+    X(0x1B, rr_r8,   3,    0, 8,  1)              /* rr e */ \
+    X(0x1C, rr_r8,   4,    0, 8,  1)              /* rr h */ \
+    X(0x1D, rr_r8,   5,    0, 8,  1)              /* rr l */ \
+    X(0x1E, rr_r8,   6,    0, 16, 1)              /* rr [hl] */ \
+    X(0x1F, rr_r8,   7,    0, 8,  1)              /* rr a */ \
+    X(0x20, sla_r8,  0,    0, 8,  1)              /* sla b */ \
+    X(0x21, sla_r8,  1,    0, 8,  1)              /* sla c */ \
+    X(0x22, sla_r8,  2,    0, 8,  1)              /* sla d */ \
+    X(0x23, sla_r8,  3,    0, 8,  1)              /* sla e */ \
+    X(0x24, sla_r8,  4,    0, 8,  1)              /* sla h */ \
+    X(0x25, sla_r8,  5,    0, 8,  1)              /* sla l */ \
+    X(0x26, sla_r8,  6,    0, 16, 1)              /* sla [hl] */ \
+    X(0x27, sla_r8,  7,    0, 8,  1)              /* sla a */ \
+    X(0x28, sra_r8,  0,    0, 8,  1)              /* sra b */ \
+    X(0x29, sra_r8,  1,    0, 8,  1)              /* sra c */ \
+    X(0x2A, sra_r8,  2,    0, 8,  1)              /* sra d */ \
+    X(0x2B, sra_r8,  3,    0, 8,  1)              /* sra e */ \
+    X(0x2C, sra_r8,  4,    0, 8,  1)              /* sra h */ \
+    X(0x2D, sra_r8,  5,    0, 8,  1)              /* sra l */ \
+    X(0x2E, sra_r8,  6,    0, 16, 1)              /* sra [hl] */ \
+    X(0x2F, sra_r8,  7,    0, 8,  1)              /* sra a */ \
+    X(0x30, swap_r8, 0,    0, 8,  1)              /* swap b */ \
+    X(0x31, swap_r8, 1,    0, 8,  1)              /* swap c */ \
+    X(0x32, swap_r8, 2,    0, 8,  1)              /* swap d */ \
+    X(0x33, swap_r8, 3,    0, 8,  1)              /* swap e */ \
+    X(0x34, swap_r8, 4,    0, 8,  1)              /* swap h */ \
+    X(0x35, swap_r8, 5,    0, 8,  1)              /* swap l */ \
+    X(0x36, swap_r8, 6,    0, 16, 1)              /* swap [hl] */ \
+    X(0x37, swap_r8, 7,    0, 8,  1)              /* swap a */ \
+    X(0x38, srl_r8,  0,    0, 8,  1)              /* srl b */ \
+    X(0x39, srl_r8,  1,    0, 8,  1)              /* srl c */ \
+    X(0x3A, srl_r8,  2,    0, 8,  1)              /* srl d */ \
+    X(0x3B, srl_r8,  3,    0, 8,  1)              /* srl e */ \
+    X(0x3C, srl_r8,  4,    0, 8,  1)              /* srl h */ \
+    X(0x3D, srl_r8,  5,    0, 8,  1)              /* srl l */ \
+    X(0x3E, srl_r8,  6,    0, 16, 1)              /* srl [hl] */ \
+    X(0x3F, srl_r8,  7,    0, 8,  1)              /* srl a */ \
+    X(0x40, bit_r8,  0,    0, 8,  1)              /* bit 0, b */ \
+    X(0x41, bit_r8,  0,    1, 8,  1)              /* bit 0, c */ \
+    X(0x42, bit_r8,  0,    2, 8,  1)              /* bit 0, d */ \
+    X(0x43, bit_r8,  0,    3, 8,  1)              /* bit 0, e */ \
+    X(0x44, bit_r8,  0,    4, 8,  1)              /* bit 0, h */ \
+    X(0x45, bit_r8,  0,    5, 8,  1)              /* bit 0, l */ \
+    X(0x46, bit_r8,  0,    6, 12, 1)              /* bit 0, [hl] */ \
+    X(0x47, bit_r8,  0,    7, 8,  1)              /* bit 0, a */ \
+    X(0x48, bit_r8,  1,    0, 8,  1)              /* bit 1, b */ \
+    X(0x49, bit_r8,  1,    1, 8,  1)              /* bit 1, c */ \
+    X(0x4A, bit_r8,  1,    2, 8,  1)              /* bit 1, d */ \
+    X(0x4B, bit_r8,  1,    3, 8,  1)              /* bit 1, e */ \
+    X(0x4C, bit_r8,  1,    4, 8,  1)              /* bit 1, h */ \
+    X(0x4D, bit_r8,  1,    5, 8,  1)              /* bit 1, l */ \
+    X(0x4E, bit_r8,  1,    6, 12, 1)              /* bit 1, [hl] */ \
+    X(0x4F, bit_r8,  1,    7, 8,  1)              /* bit 1, a */ \
+    X(0x50, bit_r8,  2,    0, 8,  1)              /* bit 2, b */ \
+    X(0x51, bit_r8,  2,    1, 8,  1)              /* bit 2, c */ \
+    X(0x52, bit_r8,  2,    2, 8,  1)              /* bit 2, d */ \
+    X(0x53, bit_r8,  2,    3, 8,  1)              /* bit 2, e */ \
+    X(0x54, bit_r8,  2,    4, 8,  1)              /* bit 2, h */ \
+    X(0x55, bit_r8,  2,    5, 8,  1)              /* bit 2, l */ \
+    X(0x56, bit_r8,  2,    6, 12, 1)              /* bit 2, [hl] */ \
+    X(0x57, bit_r8,  2,    7, 8,  1)              /* bit 2, a */ \
+    X(0x58, bit_r8,  3,    0, 8,  1)              /* bit 3, b */ \
+    X(0x59, bit_r8,  3,    1, 8,  1)              /* bit 3, c */ \
+    X(0x5A, bit_r8,  3,    2, 8,  1)              /* bit 3, d */ \
+    X(0x5B, bit_r8,  3,    3, 8,  1)              /* bit 3, e */ \
+    X(0x5C, bit_r8,  3,    4, 8,  1)              /* bit 3, h */ \
+    X(0x5D, bit_r8,  3,    5, 8,  1)              /* bit 3, l */ \
+    X(0x5E, bit_r8,  3,    6, 12, 1)              /* bit 3, [hl] */ \
+    X(0x5F, bit_r8,  3,    7, 8,  1)              /* bit 3, a */ \
+    X(0x60, bit_r8,  4,    0, 8,  1)              /* bit 4, b */ \
+    X(0x61, bit_r8,  4,    1, 8,  1)              /* bit 4, c */ \
+    X(0x62, bit_r8,  4,    2, 8,  1)              /* bit 4, d */ \
+    X(0x63, bit_r8,  4,    3, 8,  1)              /* bit 4, e */ \
+    X(0x64, bit_r8,  4,    4, 8,  1)              /* bit 4, h */ \
+    X(0x65, bit_r8,  4,    5, 8,  1)              /* bit 4, l */ \
+    X(0x66, bit_r8,  4,    6, 12, 1)              /* bit 4, [hl] */ \
+    X(0x67, bit_r8,  4,    7, 8,  1)              /* bit 4, a */ \
+    X(0x68, bit_r8,  5,    0, 8,  1)              /* bit 5, b */ \
+    X(0x69, bit_r8,  5,    1, 8,  1)              /* bit 5, c */ \
+    X(0x6A, bit_r8,  5,    2, 8,  1)              /* bit 5, d */ \
+    X(0x6B, bit_r8,  5,    3, 8,  1)              /* bit 5, e */ \
+    X(0x6C, bit_r8,  5,    4, 8,  1)              /* bit 5, h */ \
+    X(0x6D, bit_r8,  5,    5, 8,  1)              /* bit 5, l */ \
+    X(0x6E, bit_r8,  5,    6, 12, 1)              /* bit 5, [hl] */ \
+    X(0x6F, bit_r8,  5,    7, 8,  1)              /* bit 5, a */ \
+    X(0x70, bit_r8,  6,    0, 8,  1)              /* bit 6, b */ \
+    X(0x71, bit_r8,  6,    1, 8,  1)              /* bit 6, c */ \
+    X(0x72, bit_r8,  6,    2, 8,  1)              /* bit 6, d */ \
+    X(0x73, bit_r8,  6,    3, 8,  1)              /* bit 6, e */ \
+    X(0x74, bit_r8,  6,    4, 8,  1)              /* bit 6, h */ \
+    X(0x75, bit_r8,  6,    5, 8,  1)              /* bit 6, l */ \
+    X(0x76, bit_r8,  6,    6, 12, 1)              /* bit 6, [hl] */ \
+    X(0x77, bit_r8,  6,    7, 8,  1)              /* bit 6, a */ \
+    X(0x78, bit_r8,  7,    0, 8,  1)              /* bit 7, b */ \
+    X(0x79, bit_r8,  7,    1, 8,  1)              /* bit 7, c */ \
+    X(0x7A, bit_r8,  7,    2, 8,  1)              /* bit 7, d */ \
+    X(0x7B, bit_r8,  7,    3, 8,  1)              /* bit 7, e */ \
+    X(0x7C, bit_r8,  7,    4, 8,  1)              /* bit 7, h */ \
+    X(0x7D, bit_r8,  7,    5, 8,  1)              /* bit 7, l */ \
+    X(0x7E, bit_r8,  7,    6, 12, 1)              /* bit 7, [hl] */ \
+    X(0x7F, bit_r8,  7,    7, 8,  1)              /* bit 7, a */ \
+    X(0x80, res_r8,  0,    0, 8,  1)              /* res 0, b */ \
+    X(0x81, res_r8,  0,    1, 8,  1)              /* res 0, c */ \
+    X(0x82, res_r8,  0,    2, 8,  1)              /* res 0, d */ \
+    X(0x83, res_r8,  0,    3, 8,  1)              /* res 0, e */ \
+    X(0x84, res_r8,  0,    4, 8,  1)              /* res 0, h */ \
+    X(0x85, res_r8,  0,    5, 8,  1)              /* res 0, l */ \
+    X(0x86, res_r8,  0,    6, 16, 1)              /* res 0, [hl] */ \
+    X(0x87, res_r8,  0,    7, 8,  1)              /* res 0, a */ \
+    X(0x88, res_r8,  1,    0, 8,  1)              /* res 1, b */ \
+    X(0x89, res_r8,  1,    1, 8,  1)              /* res 1, c */ \
+    X(0x8A, res_r8,  1,    2, 8,  1)              /* res 1, d */ \
+    X(0x8B, res_r8,  1,    3, 8,  1)              /* res 1, e */ \
+    X(0x8C, res_r8,  1,    4, 8,  1)              /* res 1, h */ \
+    X(0x8D, res_r8,  1,    5, 8,  1)              /* res 1, l */ \
+    X(0x8E, res_r8,  1,    6, 16, 1)              /* res 1, [hl] */ \
+    X(0x8F, res_r8,  1,    7, 8,  1)              /* res 1, a */ \
+    X(0x90, res_r8,  2,    0, 8,  1)              /* res 2, b */ \
+    X(0x91, res_r8,  2,    1, 8,  1)              /* res 2, c */ \
+    X(0x92, res_r8,  2,    2, 8,  1)              /* res 2, d */ \
+    X(0x93, res_r8,  2,    3, 8,  1)              /* res 2, e */ \
+    X(0x94, res_r8,  2,    4, 8,  1)              /* res 2, h */ \
+    X(0x95, res_r8,  2,    5, 8,  1)              /* res 2, l */ \
+    X(0x96, res_r8,  2,    6, 16, 1)              /* res 2, [hl] */ \
+    X(0x97, res_r8,  2,    7, 8,  1)              /* res 2, a */ \
+    X(0x98, res_r8,  3,    0, 8,  1)              /* res 3, b */ \
+    X(0x99, res_r8,  3,    1, 8,  1)              /* res 3, c */ \
+    X(0x9A, res_r8,  3,    2, 8,  1)              /* res 3, d */ \
+    X(0x9B, res_r8,  3,    3, 8,  1)              /* res 3, e */ \
+    X(0x9C, res_r8,  3,    4, 8,  1)              /* res 3, h */ \
+    X(0x9D, res_r8,  3,    5, 8,  1)              /* res 3, l */ \
+    X(0x9E, res_r8,  3,    6, 16, 1)              /* res 3, [hl] */ \
+    X(0x9F, res_r8,  3,    7, 8,  1)              /* res 3, a */ \
+    X(0xA0, res_r8,  4,    0, 8,  1)              /* res 4, b */ \
+    X(0xA1, res_r8,  4,    1, 8,  1)              /* res 4, c */ \
+    X(0xA2, res_r8,  4,    2, 8,  1)              /* res 4, d */ \
+    X(0xA3, res_r8,  4,    3, 8,  1)              /* res 4, e */ \
+    X(0xA4, res_r8,  4,    4, 8,  1)              /* res 4, h */ \
+    X(0xA5, res_r8,  4,    5, 8,  1)              /* res 4, l */ \
+    X(0xA6, res_r8,  4,    6, 16, 1)              /* res 4, [hl] */ \
+    X(0xA7, res_r8,  4,    7, 8,  1)              /* res 4, a */ \
+    X(0xA8, res_r8,  5,    0, 8,  1)              /* res 5, b */ \
+    X(0xA9, res_r8,  5,    1, 8,  1)              /* res 5, c */ \
+    X(0xAA, res_r8,  5,    2, 8,  1)              /* res 5, d */ \
+    X(0xAB, res_r8,  5,    3, 8,  1)              /* res 5, e */ \
+    X(0xAC, res_r8,  5,    4, 8,  1)              /* res 5, h */ \
+    X(0xAD, res_r8,  5,    5, 8,  1)              /* res 5, l */ \
+    X(0xAE, res_r8,  5,    6, 16, 1)              /* res 5, [hl] */ \
+    X(0xAF, res_r8,  5,    7, 8,  1)              /* res 5, a */ \
+    X(0xB0, res_r8,  6,    0, 8,  1)              /* res 6, b */ \
+    X(0xB1, res_r8,  6,    1, 8,  1)              /* res 6, c */ \
+    X(0xB2, res_r8,  6,    2, 8,  1)              /* res 6, d */ \
+    X(0xB3, res_r8,  6,    3, 8,  1)              /* res 6, e */ \
+    X(0xB4, res_r8,  6,    4, 8,  1)              /* res 6, h */ \
+    X(0xB5, res_r8,  6,    5, 8,  1)              /* res 6, l */ \
+    X(0xB6, res_r8,  6,    6, 16, 1)              /* res 6, [hl] */ \
+    X(0xB7, res_r8,  6,    7, 8,  1)              /* res 6, a */ \
+    X(0xB8, res_r8,  7,    0, 8,  1)              /* res 7, b */ \
+    X(0xB9, res_r8,  7,    1, 8,  1)              /* res 7, c */ \
+    X(0xBA, res_r8,  7,    2, 8,  1)              /* res 7, d */ \
+    X(0xBB, res_r8,  7,    3, 8,  1)              /* res 7, e */ \
+    X(0xBC, res_r8,  7,    4, 8,  1)              /* res 7, h */ \
+    X(0xBD, res_r8,  7,    5, 8,  1)              /* res 7, l */ \
+    X(0xBE, res_r8,  7,    6, 16, 1)              /* res 7, [hl] */ \
+    X(0xBF, res_r8,  7,    7, 8,  1)              /* res 7, a */ \
+    X(0xC0, set_r8,  0,    0, 8,  1)              /* set 0, b */ \
+    X(0xC1, set_r8,  0,    1, 8,  1)              /* set 0, c */ \
+    X(0xC2, set_r8,  0,    2, 8,  1)              /* set 0, d */ \
+    X(0xC3, set_r8,  0,    3, 8,  1)              /* set 0, e */ \
+    X(0xC4, set_r8,  0,    4, 8,  1)              /* set 0, h */ \
+    X(0xC5, set_r8,  0,    5, 8,  1)              /* set 0, l */ \
+    X(0xC6, set_r8,  0,    6, 16, 1)              /* set 0, [hl] */ \
+    X(0xC7, set_r8,  0,    7, 8,  1)              /* set 0, a */ \
+    X(0xC8, set_r8,  1,    0, 8,  1)              /* set 1, b */ \
+    X(0xC9, set_r8,  1,    1, 8,  1)              /* set 1, c */ \
+    X(0xCA, set_r8,  1,    2, 8,  1)              /* set 1, d */ \
+    X(0xCB, set_r8,  1,    3, 8,  1)              /* set 1, e */ \
+    X(0xCC, set_r8,  1,    4, 8,  1)              /* set 1, h */ \
+    X(0xCD, set_r8,  1,    5, 8,  1)              /* set 1, l */ \
+    X(0xCE, set_r8,  1,    6, 16, 1)              /* set 1, [hl] */ \
+    X(0xCF, set_r8,  1,    7, 8,  1)              /* set 1, a */ \
+    X(0xD0, set_r8,  2,    0, 8,  1)              /* set 2, b */ \
+    X(0xD1, set_r8,  2,    1, 8,  1)              /* set 2, c */ \
+    X(0xD2, set_r8,  2,    2, 8,  1)              /* set 2, d */ \
+    X(0xD3, set_r8,  2,    3, 8,  1)              /* set 2, e */ \
+    X(0xD4, set_r8,  2,    4, 8,  1)              /* set 2, h */ \
+    X(0xD5, set_r8,  2,    5, 8,  1)              /* set 2, l */ \
+    X(0xD6, set_r8,  2,    6, 16, 1)              /* set 2, [hl] */ \
+    X(0xD7, set_r8,  2,    7, 8,  1)              /* set 2, a */ \
+    X(0xD8, set_r8,  3,    0, 8,  1)              /* set 3, b */ \
+    X(0xD9, set_r8,  3,    1, 8,  1)              /* set 3, c */ \
+    X(0xDA, set_r8,  3,    2, 8,  1)              /* set 3, d */ \
+    X(0xDB, set_r8,  3,    3, 8,  1)              /* set 3, e */ \
+    X(0xDC, set_r8,  3,    4, 8,  1)              /* set 3, h */ \
+    X(0xDD, set_r8,  3,    5, 8,  1)              /* set 3, l */ \
+    X(0xDE, set_r8,  3,    6, 16, 1)              /* set 3, [hl] */ \
+    X(0xDF, set_r8,  3,    7, 8,  1)              /* set 3, a */ \
+    X(0xE0, set_r8,  4,    0, 8,  1)              /* set 4, b */ \
+    X(0xE1, set_r8,  4,    1, 8,  1)              /* set 4, c */ \
+    X(0xE2, set_r8,  4,    2, 8,  1)              /* set 4, d */ \
+    X(0xE3, set_r8,  4,    3, 8,  1)              /* set 4, e */ \
+    X(0xE4, set_r8,  4,    4, 8,  1)              /* set 4, h */ \
+    X(0xE5, set_r8,  4,    5, 8,  1)              /* set 4, l */ \
+    X(0xE6, set_r8,  4,    6, 16, 1)              /* set 4, [hl] */ \
+    X(0xE7, set_r8,  4,    7, 8,  1)              /* set 4, a */ \
+    X(0xE8, set_r8,  5,    0, 8,  1)              /* set 5, b */ \
+    X(0xE9, set_r8,  5,    1, 8,  1)              /* set 5, c */ \
+    X(0xEA, set_r8,  5,    2, 8,  1)              /* set 5, d */ \
+    X(0xEB, set_r8,  5,    3, 8,  1)              /* set 5, e */ \
+    X(0xEC, set_r8,  5,    4, 8,  1)              /* set 5, h */ \
+    X(0xED, set_r8,  5,    5, 8,  1)              /* set 5, l */ \
+    X(0xEE, set_r8,  5,    6, 16, 1)              /* set 5, [hl] */ \
+    X(0xEF, set_r8,  5,    7, 8,  1)              /* set 5, a */ \
+    X(0xF0, set_r8,  6,    0, 8,  1)              /* set 6, b */ \
+    X(0xF1, set_r8,  6,    1, 8,  1)              /* set 6, c */ \
+    X(0xF2, set_r8,  6,    2, 8,  1)              /* set 6, d */ \
+    X(0xF3, set_r8,  6,    3, 8,  1)              /* set 6, e */ \
+    X(0xF4, set_r8,  6,    4, 8,  1)              /* set 6, h */ \
+    X(0xF5, set_r8,  6,    5, 8,  1)              /* set 6, l */ \
+    X(0xF6, set_r8,  6,    6, 16, 1)              /* set 6, [hl] */ \
+    X(0xF7, set_r8,  6,    7, 8,  1)              /* set 6, a */ \
+    X(0xF8, set_r8,  7,    0, 8,  1)              /* set 7, b */ \
+    X(0xF9, set_r8,  7,    1, 8,  1)              /* set 7, c */ \
+    X(0xFA, set_r8,  7,    2, 8,  1)              /* set 7, d */ \
+    X(0xFB, set_r8,  7,    3, 8,  1)              /* set 7, e */ \
+    X(0xFC, set_r8,  7,    4, 8,  1)              /* set 7, h */ \
+    X(0xFD, set_r8,  7,    5, 8,  1)              /* set 7, l */ \
+    X(0xFE, set_r8,  7,    6, 16, 1)              /* set 7, [hl] */ \
+    X(0xFF, set_r8,  7,    7, 8,  1)              /* set 7, a */
+
+#endif // OPCODES_H
\ No newline at end of file
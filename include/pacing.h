@@ -0,0 +1,48 @@
+#ifndef PACING_H
+#define PACING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Speeds selectable at runtime, as indices into the table in pacing.c
+#define PACING_SPEED_NUM 6
+#define PACING_NORMAL_SPEED 2
+#define PACING_UNCAPPED_SPEED (PACING_SPEED_NUM - 1)
+
+// Waits are ended by spinning rather than sleeping within this window
+// before the deadline. It starts here and adapts to how far sleeps
+// overshoot on the host.
+#define PACING_SPIN_NS 1000000
+#define PACING_MIN_SPIN_NS 200000
+#define PACING_MAX_SPIN_NS 4000000
+
+// Falling further behind than this gives up on catching up
+#define PACING_MAX_LAG_NS 100000000
+
+// Keeps a run to the frame rate of the real hardware, times a speed
+// multiplier. Frames are due on a fixed schedule of absolute deadlines, so
+// a late frame is made up by the ones after it rather than lost.
+typedef struct {
+    uint64_t freq;     // performance counter ticks per second
+    size_t speed;      // index into the speed table
+    uint64_t frame_ns; // time per frame at the speed, 0 if uncapped
+    uint64_t deadline; // time the current frame is due
+    uint64_t spin_ns;
+    bool late;         // the last frame ended after it was due
+
+    // Jitter stats, for waits that reached their deadline
+    uint64_t waits;
+    uint64_t late_ns_total; // how long after the deadline waits returned
+    uint64_t late_ns_max;
+    uint64_t resyncs;       // times the schedule was reset after lagging
+} pacer_t;
+
+pacer_t *init_pacer(void);
+void free_pacer(pacer_t *pacer);
+void set_pacer_speed(pacer_t *pacer, size_t speed);
+double get_pacer_speed(const pacer_t *pacer);
+void pace_frame(pacer_t *pacer);
+void print_pacer_stats(const pacer_t *pacer);
+
+#endif // PACING_H
@@ -0,0 +1,39 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <gb.h>
+
+// Frames between keyframes. Every frame is stored as a delta against the
+// last keyframe, so this bounds how much a delta accumulates. Tetris in play
+// averages about 150 bytes per frame at this interval, about 33 MiB an hour.
+#define REWIND_KEY_INTERVAL 8
+
+#define REWIND_DEFAULT_SIZE (64 << 20)
+
+// History of recent frames, as run-length encoded XOR deltas of save states
+// in a ring buffer. The oldest frames are dropped when it fills up.
+typedef struct {
+    uint8_t *buf;
+    size_t capacity;
+    size_t head;    // offset of the oldest record
+    size_t tail;    // offset the next record goes to
+    size_t newest;  // offset of the newest record
+    size_t wrap;    // end of the data before tail wrapped around to 0
+    bool wrapped;   // tail is before head
+    size_t count;   // number of records
+
+    size_t state_size;
+    uint8_t *key;   // save state of the last keyframe
+    uint8_t *cur;   // save state being recorded or restored
+    uint8_t *delta; // encoded delta being recorded
+} rewind_t;
+
+rewind_t *init_rewind(gb_t *gb, size_t capacity);
+void free_rewind(rewind_t *rw);
+void record_frame(rewind_t *rw, gb_t *gb);
+bool rewind_frame(rewind_t *rw, gb_t *gb);
+
+#endif // REWIND_H
@@ -0,0 +1,18 @@
+#ifndef RUNAHEAD_H
+#define RUNAHEAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <gb.h>
+
+typedef struct {
+    size_t frames;  // frames to run ahead
+    size_t state_size;
+    uint8_t *state; // state to return to
+} run_ahead_t;
+
+run_ahead_t *init_run_ahead(gb_t *gb, size_t frames);
+void free_run_ahead(run_ahead_t *ra);
+void run_ahead(run_ahead_t *ra, gb_t *gb);
+
+#endif // RUNAHEAD_H
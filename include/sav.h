@@ -0,0 +1,16 @@
+#ifndef SAV_H
+#define SAV_H
+
+#include <stdbool.h>
+#include <gb.h>
+#include <mbc.h>
+
+// Dirty battery RAM is written back once per second of emulated time
+#define SAV_FLUSH_DOTS DOTS_PER_SECOND
+
+bool open_sav(gb_t *gb, const char *rom_path);
+void flush_sav(gb_t *gb, bool wait);
+void close_sav(gb_t *gb);
+void sav_event(gb_t *gb);
+
+#endif // SAV_H
@@ -0,0 +1,11 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include <gb.h>
+
+void schedule_event(gb_t *gb, event_id_t id, uint64_t time);
+void cancel_event(gb_t *gb, event_id_t id);
+void run_events(gb_t *gb);
+
+#endif // SCHEDULER_H
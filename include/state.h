@@ -0,0 +1,34 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <gb.h>
+
+#define STATE_MAGIC "GBSTATE"
+// Bump whenever the layout of the saved part of gb_t changes
+#define STATE_VERSION 5
+
+// Size of the part of gb_t that is saved
+#define STATE_GB_SIZE offsetof(gb_t, idle_loop_cache)
+
+// A save state is this header, the first STATE_GB_SIZE bytes of gb_t and
+// then ram_size bytes of external RAM
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t gb_size;  // catches builds where gb_t is laid out differently
+    uint64_t ram_size;
+    uint8_t rom_title[16];
+    uint16_t rom_checksum; // global checksum from the ROM header
+} state_header_t;
+
+size_t get_state_size(gb_t *gb);
+void save_state(gb_t *gb, uint8_t *state);
+bool load_state(gb_t *gb, const uint8_t *state, size_t size);
+bool save_state_file(gb_t *gb, const char *path);
+bool load_state_file(gb_t *gb, const char *path);
+
+#endif // STATE_H
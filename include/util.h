@@ -1,12 +1,16 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <gb.h>
+
 int ultoa_hex(unsigned long value, char *buf);
 int utoa_hex(unsigned int value, char *buf);
 int ultoa_dec(unsigned long value, char *buf);
 int utoa_dec(unsigned int value, char *buf);
-void dump_cpu_state(void);
-void signal_safe_dump_cpu_state(void);
-void dump_cpu_state_gameboy_doctor(void);
+void dump_cpu_state(gb_t *gb);
+void signal_safe_dump_cpu_state(gb_t *gb);
+void dump_cpu_state_gameboy_doctor(gb_t *gb);
+void print_stats(gb_t *gb);
+char *replace_extension(const char *path, const char *ext);
 
 #endif // UTIL_H
\ No newline at end of file
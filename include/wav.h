@@ -0,0 +1,19 @@
+#ifndef WAV_H
+#define WAV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <gb.h>
+
+// Sample frames per block handed to the writer thread, about 340 ms
+#define WAV_BLOCK_FRAMES 16384
+
+#define WAV_HEADER_SIZE 44
+
+wav_writer_t *open_wav(const char *path);
+void write_wav(wav_writer_t *wav, const int16_t *samples, size_t frames);
+void capture_audio(wav_writer_t *wav, gb_t *gb);
+bool close_wav(wav_writer_t *wav);
+
+#endif // WAV_H
@@ -0,0 +1,611 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <apu.h>
+#include <mbc.h>
+#include <scheduler.h>
+
+// Channels only change their output on waveform steps, so instead of
+// sampling them at the dot rate, every change is added to audio_buf as a
+// band-limited step: an impulse spread over BLIP_WIDTH samples by a windowed
+// sinc kernel, which the output integrates. The cost follows the number of
+// changes rather than the number of dots or samples.
+#define BLIP_WIDTH 16
+#define BLIP_PHASE_BITS 5
+#define BLIP_PHASES (1 << BLIP_PHASE_BITS)
+#define BLIP_CUTOFF 0.4 // of the sample rate
+
+// Output of all channels at full volume is 4 * 15 * 8 = 480
+#define AUDIO_GAIN 64.0f
+
+// Per sample; a first order high-pass like the capacitor on the real output
+#define AUDIO_DC_DECAY 0.004f
+
+// Pulse waveforms, one bit per duty step
+static const uint8_t duty_table[4] = {0x80, 0x81, 0xE1, 0x7E};
+
+// Noise divisors in dots, before the shift
+static const uint8_t noise_divisors[8] = {8, 16, 32, 48, 64, 80, 96, 112};
+
+// Bits that read back as 1, from NR10 to NR52
+static const uint8_t read_masks[0x17] = {
+    0x80, 0x3F, 0x00, 0xFF, 0xBF, // NR10-NR14
+    0xFF, 0x3F, 0x00, 0xFF, 0xBF, // unused, NR21-NR24
+    0x7F, 0xFF, 0x9F, 0xFF, 0xBF, // NR30-NR34
+    0xFF, 0xFF, 0x00, 0x00, 0xBF, // unused, NR41-NR44
+    0x00, 0x00, 0x70,             // NR50-NR52
+};
+
+static float blip_kernel[BLIP_PHASES][BLIP_WIDTH];
+static pthread_once_t blip_kernel_once = PTHREAD_ONCE_INIT;
+
+// Builds the Blackman-windowed sinc impulse for every fractional position.
+// Each phase sums to 1, so integrating a delta gives a step of that size.
+static void init_blip_kernel(void) {
+    for (size_t p = 0; p < BLIP_PHASES; p++) {
+        double frac = (double)p / BLIP_PHASES;
+        double sum = 0;
+        for (size_t k = 0; k < BLIP_WIDTH; k++) {
+            double t = k - frac - (BLIP_WIDTH / 2 - 1);
+            double x = 2 * BLIP_CUTOFF * t;
+            double sinc = x == 0 ? 1 : sin(M_PI * x) / (M_PI * x);
+            double w = (k + 1 - frac) / (BLIP_WIDTH + 1);
+            double window = 0.42 - 0.5 * cos(2 * M_PI * w) +
+                            0.08 * cos(4 * M_PI * w);
+            blip_kernel[p][k] = (float)(sinc * window);
+            sum += blip_kernel[p][k];
+        }
+        for (size_t k = 0; k < BLIP_WIDTH; k++) {
+            blip_kernel[p][k] = (float)(blip_kernel[p][k] / sum);
+        }
+    }
+}
+
+// Adds a step to the output at a dot time at or after audio_time. Steps
+// past the end of audio_buf are dropped, which only happens when the output
+// isn't read.
+static void add_step(gb_t *gb, uint64_t time, int32_t left, int32_t right) {
+    uint64_t pos = gb->audio_pos + (time - gb->audio_time) * gb->audio_rate;
+    size_t i = pos >> 32;
+    if (i + BLIP_WIDTH > AUDIO_BUF_SIZE) {
+        return;
+    }
+    const float *kernel =
+        blip_kernel[(pos >> (32 - BLIP_PHASE_BITS)) & (BLIP_PHASES - 1)];
+    float *out_left = &gb->audio_buf[0][i];
+    float *out_right = &gb->audio_buf[1][i];
+    for (size_t k = 0; k < BLIP_WIDTH; k++) {
+        out_left[k] += left * kernel[k];
+        out_right[k] += right * kernel[k];
+    }
+    gb->audio_mix[0] += left;
+    gb->audio_mix[1] += right;
+}
+
+// Changes the output level of a channel at a dot time
+static void set_level(gb_t *gb, size_t c, uint64_t time, uint8_t level) {
+    apu_channel_t *ch = &gb->apu_ch[c];
+    if (level == ch->level) {
+        return;
+    }
+    int32_t delta = level - ch->level;
+    ch->level = level;
+    int32_t left = 0;
+    int32_t right = 0;
+    if (gb->r_nr51 & (0x10 << c)) {
+        left = delta * (((gb->r_nr50 >> 4) & 0x7) + 1);
+    }
+    if (gb->r_nr51 & (0x01 << c)) {
+        right = delta * ((gb->r_nr50 & 0x7) + 1);
+    }
+    if (gb->output_audio && (left || right)) {
+        add_step(gb, time, left, right);
+    }
+}
+
+// Adds a step from the level audio_buf is at to what the channels put out
+// now, after a change to the mixer or to the whole state
+static void update_mix(gb_t *gb) {
+    int32_t mix[2] = {0, 0};
+    for (size_t c = 0; c < APU_CHANNEL_NUM; c++) {
+        if (gb->r_nr51 & (0x10 << c)) {
+            mix[0] += gb->apu_ch[c].level;
+        }
+        if (gb->r_nr51 & (0x01 << c)) {
+            mix[1] += gb->apu_ch[c].level;
+        }
+    }
+    mix[0] *= ((gb->r_nr50 >> 4) & 0x7) + 1;
+    mix[1] *= (gb->r_nr50 & 0x7) + 1;
+    if (gb->output_audio &&
+        (mix[0] != gb->audio_mix[0] || mix[1] != gb->audio_mix[1])) {
+        add_step(gb, gb->apu_time, mix[0] - gb->audio_mix[0],
+                 mix[1] - gb->audio_mix[1]);
+    }
+}
+
+// Output level of a channel for its current waveform position
+static uint8_t get_level(gb_t *gb, size_t c) {
+    apu_channel_t *ch = &gb->apu_ch[c];
+    if (!ch->enabled) {
+        return 0;
+    }
+    switch (c) {
+        case APU_PULSE1:
+        case APU_PULSE2: {
+            uint8_t duty = (c == APU_PULSE1 ? gb->r_nr11 : gb->r_nr21) >> 6;
+            return (duty_table[duty] >> ch->pos) & 1 ? ch->volume : 0;
+        }
+        case APU_WAVE: {
+            uint8_t shift = (gb->r_nr32 >> 5) & 0x3;
+            if (shift == 0) {
+                return 0;
+            }
+            uint8_t sample = gb->m_wave[ch->pos / 2];
+            sample = ch->pos & 1 ? sample & 0xF : sample >> 4;
+            return sample >> (shift - 1);
+        }
+        default:
+            return ch->lfsr & 1 ? 0 : ch->volume;
+    }
+}
+
+static void update_level(gb_t *gb, size_t c) {
+    set_level(gb, c, gb->apu_time, get_level(gb, c));
+}
+
+// Steps the waveform of an enabled channel through every timer expiry up to
+// the given dot time
+static void run_channel(gb_t *gb, size_t c, uint64_t until) {
+    apu_channel_t *ch = &gb->apu_ch[c];
+    uint64_t time = gb->apu_time + ch->timer;
+    while (time <= until) {
+        switch (c) {
+            case APU_PULSE1:
+            case APU_PULSE2:
+                ch->pos = (ch->pos + 1) & 0x7;
+                break;
+            case APU_WAVE:
+                ch->pos = (ch->pos + 1) & 0x1F;
+                break;
+            default: {
+                uint16_t bit = (ch->lfsr ^ (ch->lfsr >> 1)) & 1;
+                ch->lfsr = (ch->lfsr >> 1) | (bit << 14);
+                if (gb->r_nr43 & 0x08) {
+                    ch->lfsr = (ch->lfsr & ~0x40) | (bit << 6);
+                }
+                break;
+            }
+        }
+        set_level(gb, c, time, get_level(gb, c));
+        time += ch->period;
+    }
+    ch->timer = time - until;
+}
+
+// Runs the channels up to the current dot. Without audio output, the
+// waveforms aren't observable, so they are left where they are.
+void sync_apu(gb_t *gb) {
+    if (gb->output_audio) {
+        for (size_t c = 0; c < APU_CHANNEL_NUM; c++) {
+            if (gb->apu_ch[c].enabled) {
+                run_channel(gb, c, gb->dots);
+            }
+        }
+    }
+    gb->apu_time = gb->dots;
+}
+
+// Keeps the output going from the same sample after the dot time jumps,
+// e.g. on loading a state
+void rebase_audio(gb_t *gb) {
+    gb->audio_time = gb->apu_time;
+    update_mix(gb);
+}
+
+// Scales the output sample rate, for callers that steer how fast samples are
+// made. Must come right after read_audio(), which brings audio_time up to
+// date.
+void set_audio_ratio(gb_t *gb, double ratio) {
+    gb->audio_rate = (uint64_t)((double)((uint64_t)AUDIO_SAMPLE_RATE << 32) /
+                                DOTS_PER_SECOND * ratio);
+}
+
+static void schedule_apu_event(gb_t *gb) {
+    uint64_t next = (gb->dots / APU_STEP_DOTS + 1) * APU_STEP_DOTS;
+    schedule_event(gb, EVENT_APU, next);
+}
+
+void init_apu(gb_t *gb) {
+    pthread_once(&blip_kernel_once, init_blip_kernel);
+    set_audio_ratio(gb, 1.0);
+    gb->apu_time = gb->dots;
+    gb->audio_time = gb->dots;
+
+    // The boot ROM leaves the chime on channel 1 faded out
+    apu_channel_t *ch = &gb->apu_ch[APU_PULSE1];
+    ch->enabled = gb->r_nr52 & 0x01;
+    ch->dac_enabled = gb->r_nr12 & 0xF8;
+    for (size_t c = 0; c < APU_CHANNEL_NUM; c++) {
+        gb->apu_ch[c].period = 8192;
+        gb->apu_ch[c].timer = 8192;
+    }
+    schedule_apu_event(gb);
+}
+
+static void disable_channel(gb_t *gb, size_t c) {
+    gb->apu_ch[c].enabled = false;
+    update_level(gb, c);
+}
+
+// The 11-bit period value of a pulse or wave channel
+static uint16_t get_period_value(gb_t *gb, size_t c) {
+    switch (c) {
+        case APU_PULSE1:
+            return gb->r_nr13 | ((gb->r_nr14 & 0x7) << 8);
+        case APU_PULSE2:
+            return gb->r_nr23 | ((gb->r_nr24 & 0x7) << 8);
+        default:
+            return gb->r_nr33 | ((gb->r_nr34 & 0x7) << 8);
+    }
+}
+
+// Recomputes the timer period of a channel from its registers. It takes
+// effect on the next timer expiry.
+static void update_period(gb_t *gb, size_t c) {
+    apu_channel_t *ch = &gb->apu_ch[c];
+    switch (c) {
+        case APU_PULSE1:
+        case APU_PULSE2:
+            ch->period = (2048 - get_period_value(gb, c)) * 4;
+            break;
+        case APU_WAVE:
+            ch->period = (2048 - get_period_value(gb, c)) * 2;
+            break;
+        default: {
+            uint8_t shift = gb->r_nr43 >> 4;
+            // The shift register isn't clocked at all with shifts of 14
+            // and 15, so the period is just made too long to matter
+            ch->period = shift >= 14 ? UINT32_MAX / 2 :
+                (uint32_t)noise_divisors[gb->r_nr43 & 0x7] << shift;
+            break;
+        }
+    }
+}
+
+// Applies a sweep step to the shadow period, returning the new period.
+// Overflowing disables channel 1.
+static uint16_t sweep_period(gb_t *gb) {
+    uint16_t delta = gb->sweep_shadow >> (gb->r_nr10 & 0x7);
+    if (gb->r_nr10 & 0x08) {
+        return gb->sweep_shadow - delta;
+    }
+    uint16_t period = gb->sweep_shadow + delta;
+    if (period > 2047) {
+        disable_channel(gb, APU_PULSE1);
+    }
+    return period;
+}
+
+static void trigger_channel(gb_t *gb, size_t c) {
+    apu_channel_t *ch = &gb->apu_ch[c];
+    ch->enabled = ch->dac_enabled;
+    update_period(gb, c);
+    ch->timer = ch->period;
+    if (ch->length == 0) {
+        ch->length = c == APU_WAVE ? 256 : 64;
+    }
+
+    uint8_t envelope = 0;
+    switch (c) {
+        case APU_PULSE1:
+            envelope = gb->r_nr12;
+            gb->sweep_shadow = get_period_value(gb, c);
+            gb->sweep_timer = (gb->r_nr10 >> 4) & 0x7;
+            if (gb->sweep_timer == 0) {
+                gb->sweep_timer = 8;
+            }
+            gb->sweep_enabled = gb->r_nr10 & 0x77;
+            if (gb->r_nr10 & 0x07) {
+                sweep_period(gb);
+            }
+            break;
+        case APU_PULSE2:
+            envelope = gb->r_nr22;
+            break;
+        case APU_WAVE:
+            ch->pos = 0;
+            break;
+        default:
+            envelope = gb->r_nr42;
+            ch->lfsr = 0x7FFF;
+            break;
+    }
+    ch->volume = envelope >> 4;
+    ch->env_timer = envelope & 0x7;
+    update_level(gb, c);
+}
+
+static void clock_length(gb_t *gb) {
+    const uint8_t *controls[APU_CHANNEL_NUM] = {
+        &gb->r_nr14, &gb->r_nr24, &gb->r_nr34, &gb->r_nr44
+    };
+    for (size_t c = 0; c < APU_CHANNEL_NUM; c++) {
+        apu_channel_t *ch = &gb->apu_ch[c];
+        if ((*controls[c] & 0x40) && ch->length > 0 && --ch->length == 0) {
+            disable_channel(gb, c);
+        }
+    }
+}
+
+static void clock_sweep(gb_t *gb) {
+    if (--gb->sweep_timer > 0) {
+        return;
+    }
+    uint8_t pace = (gb->r_nr10 >> 4) & 0x7;
+    gb->sweep_timer = pace ? pace : 8;
+    if (!gb->sweep_enabled || pace == 0) {
+        return;
+    }
+    uint16_t period = sweep_period(gb);
+    if (period <= 2047 && (gb->r_nr10 & 0x07)) {
+        gb->sweep_shadow = period;
+        gb->r_nr13 = period & 0xFF;
+        gb->r_nr14 = (gb->r_nr14 & ~0x7) | (period >> 8);
+        update_period(gb, APU_PULSE1);
+        sweep_period(gb);
+    }
+}
+
+static void clock_envelope(gb_t *gb) {
+    const uint8_t *envelopes[APU_CHANNEL_NUM] = {
+        &gb->r_nr12, &gb->r_nr22, NULL, &gb->r_nr42
+    };
+    for (size_t c = 0; c < APU_CHANNEL_NUM; c++) {
+        apu_channel_t *ch = &gb->apu_ch[c];
+        if (!envelopes[c] || (*envelopes[c] & 0x7) == 0) {
+            continue;
+        }
+        if (ch->env_timer > 0 && --ch->env_timer > 0) {
+            continue;
+        }
+        ch->env_timer = *envelopes[c] & 0x7;
+        if ((*envelopes[c] & 0x08) && ch->volume < 15) {
+            ch->volume++;
+        } else if (!(*envelopes[c] & 0x08) && ch->volume > 0) {
+            ch->volume--;
+        }
+        update_level(gb, c);
+    }
+}
+
+// Steps the frame sequencer: length timers on even steps, the sweep on
+// steps 2 and 6 and the envelopes on step 7
+void apu_event(gb_t *gb) {
+    sync_apu(gb);
+    if (gb->r_nr52 & NR52_POWER) {
+        if ((gb->apu_step & 1) == 0) {
+            clock_length(gb);
+        }
+        if (gb->apu_step == 2 || gb->apu_step == 6) {
+            clock_sweep(gb);
+        }
+        if (gb->apu_step == 7) {
+            clock_envelope(gb);
+        }
+        gb->apu_step = (gb->apu_step + 1) & 0x7;
+    }
+    schedule_apu_event(gb);
+}
+
+uint8_t read_apu(gb_t *gb, uint16_t addr) {
+    if (addr >= 0xFF30) {
+        return gb->m_wave[addr - 0xFF30];
+    }
+    if (addr > 0xFF26) {
+        return 0xFF;
+    }
+    if (addr == 0xFF26) {
+        uint8_t status = gb->r_nr52 & NR52_POWER;
+        for (size_t c = 0; c < APU_CHANNEL_NUM; c++) {
+            status |= gb->apu_ch[c].enabled << c;
+        }
+        return status | read_masks[addr - 0xFF10];
+    }
+    const uint8_t *regs[0x16] = {
+        &gb->r_nr10, &gb->r_nr11, &gb->r_nr12, &gb->r_nr13, &gb->r_nr14,
+        NULL, &gb->r_nr21, &gb->r_nr22, &gb->r_nr23, &gb->r_nr24,
+        &gb->r_nr30, &gb->r_nr31, &gb->r_nr32, &gb->r_nr33, &gb->r_nr34,
+        NULL, &gb->r_nr41, &gb->r_nr42, &gb->r_nr43, &gb->r_nr44,
+        &gb->r_nr50, &gb->r_nr51,
+    };
+    const uint8_t *reg = regs[addr - 0xFF10];
+    return (reg ? *reg : 0xFF) | read_masks[addr - 0xFF10];
+}
+
+// Clears every register and silences the channels
+static void power_off(gb_t *gb) {
+    for (size_t c = 0; c < APU_CHANNEL_NUM; c++) {
+        gb->apu_ch[c].dac_enabled = false;
+        disable_channel(gb, c);
+    }
+    gb->r_nr10 = gb->r_nr11 = gb->r_nr12 = gb->r_nr13 = gb->r_nr14 = 0;
+    gb->r_nr21 = gb->r_nr22 = gb->r_nr23 = gb->r_nr24 = 0;
+    gb->r_nr30 = gb->r_nr31 = gb->r_nr32 = gb->r_nr33 = gb->r_nr34 = 0;
+    gb->r_nr41 = gb->r_nr42 = gb->r_nr43 = gb->r_nr44 = 0;
+    gb->r_nr50 = gb->r_nr51 = 0;
+    update_mix(gb);
+}
+
+// Sets the DAC of a pulse or noise channel from its envelope register
+static void write_envelope(gb_t *gb, size_t c, uint8_t val) {
+    gb->apu_ch[c].dac_enabled = val & 0xF8;
+    if (!gb->apu_ch[c].dac_enabled) {
+        disable_channel(gb, c);
+    }
+}
+
+static void write_control(gb_t *gb, size_t c, uint8_t val) {
+    if (c != APU_NOISE) {
+        update_period(gb, c);
+    }
+    if (val & 0x80) {
+        trigger_channel(gb, c);
+    }
+}
+
+void write_apu(gb_t *gb, uint16_t addr, uint8_t val) {
+    sync_apu(gb);
+    if (addr >= 0xFF30) {
+        gb->m_wave[addr - 0xFF30] = val;
+        update_level(gb, APU_WAVE);
+        return;
+    }
+    if (addr == 0xFF26) {
+        if (!(val & NR52_POWER) && (gb->r_nr52 & NR52_POWER)) {
+            power_off(gb);
+        } else if ((val & NR52_POWER) && !(gb->r_nr52 & NR52_POWER)) {
+            gb->apu_step = 0;
+        }
+        gb->r_nr52 = val & NR52_POWER;
+        return;
+    }
+    // Only NR52 can be written while the APU is off
+    if (!(gb->r_nr52 & NR52_POWER)) {
+        return;
+    }
+
+    switch (addr) {
+        case 0xFF10:
+            gb->r_nr10 = val;
+            return;
+        case 0xFF11:
+            gb->r_nr11 = val;
+            gb->apu_ch[APU_PULSE1].length = 64 - (val & 0x3F);
+            update_level(gb, APU_PULSE1);
+            return;
+        case 0xFF12:
+            gb->r_nr12 = val;
+            write_envelope(gb, APU_PULSE1, val);
+            return;
+        case 0xFF13:
+            gb->r_nr13 = val;
+            update_period(gb, APU_PULSE1);
+            return;
+        case 0xFF14:
+            gb->r_nr14 = val;
+            write_control(gb, APU_PULSE1, val);
+            return;
+        case 0xFF16:
+            gb->r_nr21 = val;
+            gb->apu_ch[APU_PULSE2].length = 64 - (val & 0x3F);
+            update_level(gb, APU_PULSE2);
+            return;
+        case 0xFF17:
+            gb->r_nr22 = val;
+            write_envelope(gb, APU_PULSE2, val);
+            return;
+        case 0xFF18:
+            gb->r_nr23 = val;
+            update_period(gb, APU_PULSE2);
+            return;
+        case 0xFF19:
+            gb->r_nr24 = val;
+            write_control(gb, APU_PULSE2, val);
+            return;
+        case 0xFF1A:
+            gb->r_nr30 = val;
+            gb->apu_ch[APU_WAVE].dac_enabled = val & 0x80;
+            if (!(val & 0x80)) {
+                disable_channel(gb, APU_WAVE);
+            }
+            return;
+        case 0xFF1B:
+            gb->r_nr31 = val;
+            gb->apu_ch[APU_WAVE].length = 256 - val;
+            return;
+        case 0xFF1C:
+            gb->r_nr32 = val;
+            update_level(gb, APU_WAVE);
+            return;
+        case 0xFF1D:
+            gb->r_nr33 = val;
+            update_period(gb, APU_WAVE);
+            return;
+        case 0xFF1E:
+            gb->r_nr34 = val;
+            write_control(gb, APU_WAVE, val);
+            return;
+        case 0xFF20:
+            gb->r_nr41 = val;
+            gb->apu_ch[APU_NOISE].length = 64 - (val & 0x3F);
+            return;
+        case 0xFF21:
+            gb->r_nr42 = val;
+            write_envelope(gb, APU_NOISE, val);
+            return;
+        case 0xFF22:
+            gb->r_nr43 = val;
+            update_period(gb, APU_NOISE);
+            return;
+        case 0xFF23:
+            gb->r_nr44 = val;
+            write_control(gb, APU_NOISE, val);
+            return;
+        case 0xFF24:
+            gb->r_nr50 = val;
+            update_mix(gb);
+            return;
+        case 0xFF25:
+            gb->r_nr51 = val;
+            update_mix(gb);
+            return;
+    }
+}
+
+// Moves up to max_frames finished stereo samples out of audio_buf into out,
+// as interleaved 16-bit PCM. Returns the number of frames written.
+size_t read_audio(gb_t *gb, int16_t *out, size_t max_frames) {
+    sync_apu(gb);
+    update_mix(gb);
+
+    // Fold the time since audio_time into audio_pos. Samples before the
+    // current position can't be touched by later steps any more.
+    gb->audio_pos += (gb->apu_time - gb->audio_time) * gb->audio_rate;
+    gb->audio_time = gb->apu_time;
+    size_t count = gb->audio_pos >> 32;
+    size_t used = count + BLIP_WIDTH;
+    if (used > AUDIO_BUF_SIZE) {
+        used = AUDIO_BUF_SIZE;
+        count = AUDIO_BUF_SIZE - BLIP_WIDTH;
+    }
+    if (count > max_frames) {
+        count = max_frames;
+    }
+
+    for (size_t s = 0; s < AUDIO_CHANNELS; s++) {
+        float sum = gb->audio_sum[s];
+        float dc = gb->audio_dc[s];
+        for (size_t i = 0; i < count; i++) {
+            sum += gb->audio_buf[s][i];
+            dc += (sum - dc) * AUDIO_DC_DECAY;
+            float sample = (sum - dc) * AUDIO_GAIN;
+            if (sample > INT16_MAX) {
+                sample = INT16_MAX;
+            } else if (sample < INT16_MIN) {
+                sample = INT16_MIN;
+            }
+            out[i * AUDIO_CHANNELS + s] = (int16_t)sample;
+        }
+        gb->audio_sum[s] = sum;
+        gb->audio_dc[s] = dc;
+
+        memmove(gb->audio_buf[s], gb->audio_buf[s] + count,
+                (used - count) * sizeof(float));
+        memset(gb->audio_buf[s] + used - count, 0, count * sizeof(float));
+    }
+    gb->audio_pos -= (uint64_t)count << 32;
+    return count;
+}
@@ -0,0 +1,204 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <audio.h>
+#include <apu.h>
+#include <SDL3/SDL.h>
+
+#define AUDIO_FRAME_SIZE (AUDIO_CHANNELS * sizeof(int16_t))
+
+// Samples pass from the emulation thread to the audio callback through a
+// single-producer single-consumer ring. Each side only advances its own
+// index, so neither ever waits for the other. The indices count frames
+// from the start and are wrapped on access.
+typedef struct {
+    int16_t samples[AUDIO_RING_SIZE * AUDIO_CHANNELS];
+    size_t head; // written by the emulation thread
+    char head_pad[CACHE_LINE_SIZE - sizeof(size_t)];
+    size_t tail; // written by the audio callback
+    char tail_pad[CACHE_LINE_SIZE - sizeof(size_t)];
+
+    // Stats, counted atomically
+    uint64_t underruns;  // callbacks that found too few samples
+    uint64_t overruns;   // queue_audio() calls that found too little room
+    uint64_t fill_total; // sum of the fill seen by queue_audio()
+    uint64_t fill_count;
+    uint64_t waits;      // wait_audio() calls that blocked
+
+    bool waiting; // wait_audio() wants to hear about the next callback
+} audio_ring_t;
+
+static SDL_AudioStream *stream = NULL;
+static SDL_Semaphore *drained = NULL; // signaled for wait_audio()
+static audio_ring_t ring;
+
+static size_t get_fill(void) {
+    return __atomic_load_n(&ring.head, __ATOMIC_RELAXED) -
+           __atomic_load_n(&ring.tail, __ATOMIC_SEQ_CST);
+}
+
+// Called from SDL's audio thread whenever the device needs more data. What
+// the ring can't provide is filled with silence.
+static void SDLCALL audio_callback(void *userdata, SDL_AudioStream *s,
+                                   int additional, int total) {
+    size_t wanted = additional / AUDIO_FRAME_SIZE;
+    size_t tail = ring.tail;
+    size_t head = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+    size_t count = head - tail < wanted ? head - tail : wanted;
+
+    size_t start = tail & (AUDIO_RING_SIZE - 1);
+    size_t first = count < AUDIO_RING_SIZE - start ?
+                   count : AUDIO_RING_SIZE - start;
+    SDL_PutAudioStreamData(s, &ring.samples[start * AUDIO_CHANNELS],
+                           (int)(first * AUDIO_FRAME_SIZE));
+    if (count > first) {
+        SDL_PutAudioStreamData(s, ring.samples,
+                               (int)((count - first) * AUDIO_FRAME_SIZE));
+    }
+    // Sequentially consistent with the waiting flag, see wait_audio()
+    __atomic_store_n(&ring.tail, tail + count, __ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&ring.waiting, false, __ATOMIC_SEQ_CST)) {
+        SDL_SignalSemaphore(drained);
+    }
+
+    if (count < wanted) {
+        __atomic_fetch_add(&ring.underruns, 1, __ATOMIC_RELAXED);
+        static const int16_t silence[256 * AUDIO_CHANNELS];
+        for (size_t left = wanted - count; left > 0;) {
+            size_t n = left < 256 ? left : 256;
+            SDL_PutAudioStreamData(s, silence, (int)(n * AUDIO_FRAME_SIZE));
+            left -= n;
+        }
+    }
+}
+
+// Opens the default playback device. Returns false, after saying why, if
+// there is none, in which case the run goes on without sound.
+bool init_audio(void) {
+    if (!SDL_InitSubSystem(SDL_INIT_AUDIO)) {
+        fprintf(stderr, "SDL audio init failed: %s\n", SDL_GetError());
+        return false;
+    }
+    SDL_AudioSpec spec = {
+        .format = SDL_AUDIO_S16,
+        .channels = AUDIO_CHANNELS,
+        .freq = AUDIO_SAMPLE_RATE,
+    };
+    memset(&ring, 0, sizeof(ring));
+    drained = SDL_CreateSemaphore(0);
+    if (!drained) {
+        fprintf(stderr, "SDL semaphore creation failed: %s\n",
+                SDL_GetError());
+        exit(1);
+    }
+    stream = SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK,
+                                       &spec, audio_callback, NULL);
+    if (!stream) {
+        fprintf(stderr, "SDL audio init failed: %s\n", SDL_GetError());
+        SDL_DestroySemaphore(drained);
+        drained = NULL;
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return false;
+    }
+    SDL_ResumeAudioStreamDevice(stream);
+    return true;
+}
+
+void free_audio(void) {
+    SDL_DestroyAudioStream(stream);
+    stream = NULL;
+    SDL_DestroySemaphore(drained);
+    drained = NULL;
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+}
+
+// Moves the samples an instance has made so far into the ring, then steers
+// its sample rate by up to AUDIO_MAX_RATE_DELTA to bring the fill back to
+// AUDIO_TARGET_FILL. This absorbs the drift between the frame timer that
+// paces the video and the clock of the audio device.
+void queue_audio(gb_t *gb) {
+    int16_t samples[AUDIO_BUF_SIZE * AUDIO_CHANNELS];
+    size_t count = read_audio(gb, samples, AUDIO_BUF_SIZE);
+
+    size_t head = ring.head;
+    size_t tail = __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE);
+    size_t room = AUDIO_RING_SIZE - (head - tail);
+    if (count > room) {
+        __atomic_fetch_add(&ring.overruns, 1, __ATOMIC_RELAXED);
+        count = room;
+    }
+    size_t start = head & (AUDIO_RING_SIZE - 1);
+    size_t first = count < AUDIO_RING_SIZE - start ?
+                   count : AUDIO_RING_SIZE - start;
+    memcpy(&ring.samples[start * AUDIO_CHANNELS], samples,
+           first * AUDIO_FRAME_SIZE);
+    memcpy(ring.samples, &samples[first * AUDIO_CHANNELS],
+           (count - first) * AUDIO_FRAME_SIZE);
+    __atomic_store_n(&ring.head, head + count, __ATOMIC_RELEASE);
+
+    size_t fill = head + count - tail;
+    __atomic_fetch_add(&ring.fill_total, fill, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ring.fill_count, 1, __ATOMIC_RELAXED);
+
+    double error = ((double)fill - AUDIO_TARGET_FILL) / AUDIO_TARGET_FILL;
+    if (error > 1) {
+        error = 1;
+    } else if (error < -1) {
+        error = -1;
+    }
+    set_audio_ratio(gb, 1 - (AUDIO_MAX_RATE_DELTA * error));
+}
+
+// Blocks until the device has played the ring down to AUDIO_TARGET_FILL,
+// which lets the audio clock pace the run instead of a timer. Returns true
+// if the ring was already below half of that, i.e. the run is falling
+// behind the device. Gives up after AUDIO_WAIT_TIMEOUT_MS if the device
+// stops asking for samples.
+bool wait_audio(void) {
+    size_t fill = get_fill();
+    if (fill < AUDIO_TARGET_FILL / 2) {
+        return true;
+    }
+    bool blocked = false;
+    while (fill > AUDIO_TARGET_FILL) {
+        // The flag is set before checking again, so a callback that drains
+        // the ring in between either is seen here or signals
+        __atomic_store_n(&ring.waiting, true, __ATOMIC_SEQ_CST);
+        fill = get_fill();
+        if (fill <= AUDIO_TARGET_FILL) {
+            break;
+        }
+        blocked = true;
+        if (!SDL_WaitSemaphoreTimeout(drained, AUDIO_WAIT_TIMEOUT_MS)) {
+            break;
+        }
+        fill = get_fill();
+    }
+    // A signal left over from a wakeup not waited for is harmless, as it
+    // only makes the next wait check the fill again
+    __atomic_store_n(&ring.waiting, false, __ATOMIC_RELAXED);
+    if (blocked) {
+        __atomic_fetch_add(&ring.waits, 1, __ATOMIC_RELAXED);
+    }
+    return false;
+}
+
+void print_audio_stats(void) {
+    size_t fill = get_fill();
+    uint64_t fill_count = __atomic_load_n(&ring.fill_count, __ATOMIC_RELAXED);
+    double mean_fill = fill_count ?
+        (double)__atomic_load_n(&ring.fill_total, __ATOMIC_RELAXED) /
+        fill_count : 0.0;
+    fprintf(stderr, "Audio buffer: %zu frames now, %.0f on average "
+            "(target %d of %d)\n", fill, mean_fill, AUDIO_TARGET_FILL,
+            AUDIO_RING_SIZE);
+    fprintf(stderr, "Audio underruns: %lu, overruns: %lu\n",
+            __atomic_load_n(&ring.underruns, __ATOMIC_RELAXED),
+            __atomic_load_n(&ring.overruns, __ATOMIC_RELAXED));
+    uint64_t waits = __atomic_load_n(&ring.waits, __ATOMIC_RELAXED);
+    if (waits) {
+        fprintf(stderr, "Audio sync waits: %lu\n", waits);
+    }
+}
@@ -0,0 +1,272 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <batch.h>
+#include <gb.h>
+
+// Outcome of running one ROM
+typedef struct {
+    const char *status; // passed, failed, limit or error
+    uint64_t frames;
+    uint64_t dots;
+    char *serial_out;
+    uint64_t framebuffer_hash;
+    double wall_time;
+    bool done;
+} batch_result_t;
+
+// Jobs owned by one worker. The owner takes jobs from the tail while other
+// workers steal from the head, so they rarely contend for the same end.
+typedef struct {
+    pthread_mutex_t lock;
+    size_t *jobs;
+    size_t head;
+    size_t tail;
+} job_queue_t;
+
+typedef struct {
+    char **rom_paths;
+    size_t rom_num;
+    size_t thread_num;
+    bool run_boot;
+    bool accurate_ppu;
+    size_t frame_skip;
+    const run_limits_t *limits;
+    job_queue_t *queues;
+    batch_result_t *results;
+
+    // Results are printed in ROM order as soon as they and every one before
+    // them are done
+    pthread_mutex_t print_lock;
+    size_t next_print;
+    bool all_passed;
+} batch_t;
+
+typedef struct {
+    batch_t *batch;
+    size_t id;
+} worker_t;
+
+static bool pop_job(job_queue_t *queue, size_t *job) {
+    pthread_mutex_lock(&queue->lock);
+    bool found = queue->head < queue->tail;
+    if (found) {
+        *job = queue->jobs[--queue->tail];
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+static bool steal_job(job_queue_t *queue, size_t *job) {
+    pthread_mutex_lock(&queue->lock);
+    bool found = queue->head < queue->tail;
+    if (found) {
+        *job = queue->jobs[queue->head++];
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+// Takes the next job of a worker, stealing from the others once its own
+// queue is empty. No jobs are added while running, so the batch is done once
+// every queue is empty.
+static bool take_job(batch_t *batch, size_t id, size_t *job) {
+    if (pop_job(&batch->queues[id], job)) {
+        return true;
+    }
+    for (size_t i = 1; i < batch->thread_num; i++) {
+        size_t victim = (id + i) % batch->thread_num;
+        if (steal_job(&batch->queues[victim], job)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static double get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+// 64-bit FNV-1a
+static uint64_t hash_bytes(const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    uint64_t hash = 0xCBF29CE484222325;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3;
+    }
+    return hash;
+}
+
+static void run_job(batch_t *batch, size_t job) {
+    batch_result_t *result = &batch->results[job];
+    double start = get_time();
+
+    // No save file is attached, so instances of the same battery-backed
+    // cart don't share their RAM
+    gb_t *gb = init_gb(batch->rom_paths[job], batch->run_boot);
+    if (!gb) {
+        result->status = "error";
+        result->wall_time = get_time() - start;
+        return;
+    }
+    gb->print_serial = false;
+    gb->accurate_ppu = batch->accurate_ppu;
+    gb->frame_skip = batch->frame_skip;
+
+    switch (run_headless(gb, batch->limits, &result->frames)) {
+        case RUN_PASSED:
+            result->status = "passed";
+            break;
+        case RUN_FAILED:
+            result->status = "failed";
+            break;
+        case RUN_ERROR:
+            result->status = "error";
+            break;
+        case RUN_RUNNING:
+        case RUN_LIMIT_REACHED:
+            // Without a pass condition, running to the limit is a pass
+            result->status = batch->limits->pass_match ? "limit" : "passed";
+            break;
+    }
+    result->dots = gb->dots;
+    result->serial_out = strdup(gb->serial_out);
+    result->framebuffer_hash =
+        hash_bytes(gb->framebuffer, FRAMEBUFFER_SIZE);
+
+    free_gb(gb);
+    result->wall_time = get_time() - start;
+}
+
+static void print_json_string(const char *str) {
+    putchar('"');
+    for (const unsigned char *c = (const unsigned char *)str; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            printf("\\%c", *c);
+        } else if (*c == '\n') {
+            printf("\\n");
+        } else if (*c < 0x20 || *c >= 0x7F) {
+            printf("\\u%04X", *c);
+        } else {
+            putchar(*c);
+        }
+    }
+    putchar('"');
+}
+
+static void print_result(const char *rom_path, const batch_result_t *result) {
+    printf("{\"rom\": ");
+    print_json_string(rom_path);
+    printf(", \"status\": \"%s\"", result->status);
+    printf(", \"frames\": %lu", result->frames);
+    printf(", \"dots\": %lu", result->dots);
+    printf(", \"serial\": ");
+    print_json_string(result->serial_out ? result->serial_out : "");
+    printf(", \"framebuffer_hash\": \"%016lX\"", result->framebuffer_hash);
+    printf(", \"wall_time\": %.6f}\n", result->wall_time);
+}
+
+// Marks a job done and prints every result that is now next in line, so the
+// finished ones are out even if a later ROM takes the process down
+static void finish_job(batch_t *batch, size_t job) {
+    pthread_mutex_lock(&batch->print_lock);
+    batch->results[job].done = true;
+    while (batch->next_print < batch->rom_num &&
+           batch->results[batch->next_print].done) {
+        batch_result_t *result = &batch->results[batch->next_print];
+        print_result(batch->rom_paths[batch->next_print], result);
+        if (strcmp(result->status, "passed") != 0) {
+            batch->all_passed = false;
+        }
+        free(result->serial_out);
+        result->serial_out = NULL;
+        batch->next_print++;
+    }
+    fflush(stdout);
+    pthread_mutex_unlock(&batch->print_lock);
+}
+
+static void *worker_main(void *arg) {
+    worker_t *worker = arg;
+    size_t job;
+    while (take_job(worker->batch, worker->id, &job)) {
+        run_job(worker->batch, job);
+        finish_job(worker->batch, job);
+    }
+    return NULL;
+}
+
+// Runs every ROM headlessly on a pool of worker threads and prints one JSON
+// object per ROM, in the order given, as the results come in. Returns true
+// if all of them passed.
+bool run_batch(char **rom_paths, size_t rom_num, size_t thread_num,
+               bool run_boot, bool accurate_ppu, size_t frame_skip,
+               const run_limits_t *limits) {
+    if (thread_num > rom_num) {
+        thread_num = rom_num;
+    }
+
+    batch_t batch = {
+        .rom_paths = rom_paths,
+        .rom_num = rom_num,
+        .thread_num = thread_num,
+        .run_boot = run_boot,
+        .accurate_ppu = accurate_ppu,
+        .frame_skip = frame_skip,
+        .limits = limits,
+        .queues = calloc(thread_num, sizeof(job_queue_t)),
+        .results = calloc(rom_num, sizeof(batch_result_t)),
+        .all_passed = true,
+    };
+    worker_t *workers = calloc(thread_num, sizeof(worker_t));
+    pthread_t *threads = calloc(thread_num, sizeof(pthread_t));
+    size_t *jobs = calloc(rom_num, sizeof(size_t));
+    if (!batch.queues || !batch.results || !workers || !threads || !jobs) {
+        fprintf(stderr, "Failed to allocate batch state, exiting...\n");
+        exit(1);
+    }
+
+    pthread_mutex_init(&batch.print_lock, NULL);
+
+    // Give every worker a contiguous share of the ROMs up front
+    for (size_t i = 0; i < rom_num; i++) {
+        jobs[i] = i;
+    }
+    for (size_t i = 0; i < thread_num; i++) {
+        job_queue_t *queue = &batch.queues[i];
+        pthread_mutex_init(&queue->lock, NULL);
+        queue->jobs = jobs;
+        queue->head = (i * rom_num) / thread_num;
+        queue->tail = ((i + 1) * rom_num) / thread_num;
+    }
+
+    for (size_t i = 0; i < thread_num; i++) {
+        workers[i].batch = &batch;
+        workers[i].id = i;
+        if (pthread_create(&threads[i], NULL, worker_main, &workers[i])) {
+            fprintf(stderr, "Failed to create worker thread, exiting...\n");
+            exit(1);
+        }
+    }
+    for (size_t i = 0; i < thread_num; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (size_t i = 0; i < thread_num; i++) {
+        pthread_mutex_destroy(&batch.queues[i].lock);
+    }
+    pthread_mutex_destroy(&batch.print_lock);
+    free(jobs);
+    free(threads);
+    free(workers);
+    free(batch.results);
+    free(batch.queues);
+    return batch.all_passed;
+}
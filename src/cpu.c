@@ -5,214 +5,259 @@
 #include <stdlib.h>
 #include <mem.h>
 #include <cpu.h>
-
-// CPU state
-
-reg_t af = {0};
-reg_t bc = {0};
-reg_t de = {0};
-reg_t hl = {0};
-reg_t sp = {0};
-reg_t pc = {0};
-
-uint64_t dots = 0;
-
-bool set_ime = false;
-bool ime = false;
+#include <opcodes.h>
+#include <scheduler.h>
 
 // Timer variables
 
 const uint64_t div_incr_interval = 256;
-uint64_t last_div_incr_time = 0;
 
 const uint64_t tima_00_incr_interval = 1024;
 const uint64_t tima_01_incr_interval = 16;
 const uint64_t tima_10_incr_interval = 64;
 const uint64_t tima_11_incr_interval = 256;
-uint64_t last_tima_incr_time = 0;
 
-uint16_t read_imm16(uint16_t addr) {
+uint16_t read_imm16(gb_t *gb, uint16_t addr) {
     // Little endian
-    return (((uint16_t)read_mem(addr + 1)) << 8) | (uint16_t)read_mem(addr);
+    return (((uint16_t)read_mem(gb, addr + 1)) << 8) |
+           (uint16_t)read_mem(gb, addr);
 }
 
-void write_imm16(uint16_t addr, uint16_t val) {
+void write_imm16(gb_t *gb, uint16_t addr, uint16_t val) {
     // Little endian
-    write_mem(addr, (uint8_t)(val & 0xFF));
-    write_mem(addr + 1, (uint8_t)(val >> 8));
+    write_mem(gb, addr, (uint8_t)(val & 0xFF));
+    write_mem(gb, addr + 1, (uint8_t)(val >> 8));
 }
 
-uint8_t read_r8(uint8_t idx) {
+uint8_t read_r8(gb_t *gb, uint8_t idx) {
     switch (idx) {
         case 0:
-            return bc.r8.h;
+            return gb->bc.r8.h;
         case 1:
-            return bc.r8.l;
+            return gb->bc.r8.l;
         case 2:
-            return de.r8.h;
+            return gb->de.r8.h;
         case 3:
-            return de.r8.l;
+            return gb->de.r8.l;
         case 4:
-            return hl.r8.h;
+            return gb->hl.r8.h;
         case 5:
-            return hl.r8.l;
+            return gb->hl.r8.l;
         case 6:
-            return read_mem(hl.r16);
+            return read_mem(gb, gb->hl.r16);
         case 7:
-            return af.r8.h;
+            return gb->af.r8.h;
     }
     fprintf(stderr, "Invalid read to r8 index %d, exiting...\n", idx);
     exit(1);
 }
 
-void write_r8(uint8_t idx, uint8_t val) {
+void write_r8(gb_t *gb, uint8_t idx, uint8_t val) {
     switch (idx) {
         case 0:
-            bc.r8.h = val;
+            gb->bc.r8.h = val;
             return;
         case 1:
-            bc.r8.l = val;
+            gb->bc.r8.l = val;
             return;
         case 2:
-            de.r8.h = val;
+            gb->de.r8.h = val;
             return;
         case 3:
-            de.r8.l = val;
+            gb->de.r8.l = val;
             return;
         case 4:
-            hl.r8.h = val;
+            gb->hl.r8.h = val;
             return;
         case 5:
-            hl.r8.l = val;
+            gb->hl.r8.l = val;
             return;
         case 6:
-            write_mem(hl.r16, val);
+            write_mem(gb, gb->hl.r16, val);
             return;
         case 7:
-            af.r8.h = val;
+            gb->af.r8.h = val;
             return;
     }
     fprintf(stderr, "Invalid write to r8 index %d, exiting...\n", idx);
     exit(1);
 }
 
-uint16_t read_r16(uint8_t idx) {
+uint16_t read_r16(gb_t *gb, uint8_t idx) {
     switch (idx) {
         case 0:
-            return bc.r16;
+            return gb->bc.r16;
         case 1:
-            return de.r16;
+            return gb->de.r16;
         case 2:
-            return hl.r16;
+            return gb->hl.r16;
         case 3:
-            return sp.r16;
+            return gb->sp.r16;
     }
     fprintf(stderr, "Invalid read to r16 index %d, exiting...\n", idx);
     exit(1);
 }
 
-void write_r16(uint8_t idx, uint16_t val) {
+void write_r16(gb_t *gb, uint8_t idx, uint16_t val) {
     switch (idx) {
         case 0:
-            bc.r16 = val;
+            gb->bc.r16 = val;
             return;
         case 1:
-            de.r16 = val;
+            gb->de.r16 = val;
             return;
         case 2:
-            hl.r16 = val;
+            gb->hl.r16 = val;
             return;
         case 3:
-            sp.r16 = val;
+            gb->sp.r16 = val;
             return;
     }
     fprintf(stderr, "Invalid write to r16 index %d, exiting...\n", idx);
     exit(1);
 }
 
-uint16_t read_r16stk(uint8_t idx) {
+uint16_t read_r16stk(gb_t *gb, uint8_t idx) {
     switch (idx) {
         case 0:
-            return bc.r16;
+            return gb->bc.r16;
         case 1:
-            return de.r16;
+            return gb->de.r16;
         case 2:
-            return hl.r16;
+            return gb->hl.r16;
         case 3:
-            return af.r16;
+            sync_flags(gb);
+            return gb->af.r16;
     }
     fprintf(stderr, "Invalid read to r16stk index %d, exiting...\n", idx);
     exit(1);
 }
 
-void write_r16stk(uint8_t idx, uint16_t val) {
+void write_r16stk(gb_t *gb, uint8_t idx, uint16_t val) {
     switch (idx) {
         case 0:
-            bc.r16 = val;
+            gb->bc.r16 = val;
             return;
         case 1:
-            de.r16 = val;
+            gb->de.r16 = val;
             return;
         case 2:
-            hl.r16 = val;
+            gb->hl.r16 = val;
             return;
         case 3:
-            af.r16 = val;
-            af.r8.l &= 0xF0; // clear lower nibble of flags reg
+            gb->af.r16 = val;
+            gb->af.r8.l &= 0xF0; // clear lower nibble of flags reg
+            gb->flags_op = FLAGS_NONE;
             return;
     }
     fprintf(stderr, "Invalid write to r16stk index %d, exiting...\n", idx);
     exit(1);
 }
 
-uint8_t read_r16mem(uint8_t idx) {
+uint8_t read_r16mem(gb_t *gb, uint8_t idx) {
     switch (idx) {
         case 0:
-            return read_mem(bc.r16);
+            return read_mem(gb, gb->bc.r16);
         case 1:
-            return read_mem(de.r16);
+            return read_mem(gb, gb->de.r16);
         case 2:
-            return read_mem(hl.r16++);
+            return read_mem(gb, gb->hl.r16++);
         case 3:
-            return read_mem(hl.r16--);
+            return read_mem(gb, gb->hl.r16--);
     }
     fprintf(stderr, "Invalid read to r16mem index %d, exiting...\n", idx);
     exit(1);
 }
 
-void write_r16mem(uint8_t idx, uint8_t val) {
+void write_r16mem(gb_t *gb, uint8_t idx, uint8_t val) {
     switch (idx) {
         case 0:
-            write_mem(bc.r16, val);
+            write_mem(gb, gb->bc.r16, val);
             return;
         case 1:
-            write_mem(de.r16, val);
+            write_mem(gb, gb->de.r16, val);
             return;
         case 2:
-            write_mem(hl.r16++, val);
+            write_mem(gb, gb->hl.r16++, val);
             return;
         case 3:
-            write_mem(hl.r16--, val);
+            write_mem(gb, gb->hl.r16--, val);
             return;
     }
     fprintf(stderr, "Invalid write to r16mem index %d, exiting...\n", idx);
     exit(1);
 }
 
-uint8_t get_z_flag(void) {
-    return (af.r8.l >> 7) & 0x1;
+// Lazy flags. The 8-bit ALU and inc/dec only record their operands and
+// result; F is materialized by sync_flags() when something needs all of it.
+// Z and C can be derived without a full sync, which is all conditional
+// branches need.
+
+void sync_flags(gb_t *gb) {
+    uint8_t n = 0, h = 0, c = 0;
+    switch (gb->flags_op) {
+        case FLAGS_NONE:
+            return;
+        case FLAGS_ADD:
+            h = ((gb->flags_a & 0xF) + (gb->flags_b & 0xF) + gb->flags_carry)
+                > 0xF;
+            c = (gb->flags_a + gb->flags_b + gb->flags_carry) > 0xFF;
+            break;
+        case FLAGS_SUB:
+            n = 1;
+            h = (gb->flags_a & 0xF) < ((gb->flags_b & 0xF) + gb->flags_carry);
+            c = gb->flags_a < (gb->flags_b + gb->flags_carry);
+            break;
+        case FLAGS_INC:
+            h = (gb->flags_res & 0xF) == 0;
+            c = gb->flags_carry;
+            break;
+        case FLAGS_DEC:
+            n = 1;
+            h = (gb->flags_res & 0xF) == 0xF;
+            c = gb->flags_carry;
+            break;
+        case FLAGS_AND:
+            h = 1;
+            break;
+        case FLAGS_OR:
+            break;
+    }
+    uint8_t z = gb->flags_res == 0;
+    gb->af.r8.l = (uint8_t)(((((z << 1) | n) << 2) | ((h << 1) | c)) << 4);
+    gb->flags_op = FLAGS_NONE;
+}
+
+uint8_t get_z_flag(gb_t *gb) {
+    if (gb->flags_op != FLAGS_NONE) {
+        return gb->flags_res == 0;
+    }
+    return (gb->af.r8.l >> 7) & 0x1;
 }
 
-uint8_t get_n_flag(void) {
-    return (af.r8.l >> 6) & 0x1;
+uint8_t get_n_flag(gb_t *gb) {
+    sync_flags(gb);
+    return (gb->af.r8.l >> 6) & 0x1;
 }
 
-uint8_t get_h_flag(void) {
-    return (af.r8.l >> 5) & 0x1;
+uint8_t get_h_flag(gb_t *gb) {
+    sync_flags(gb);
+    return (gb->af.r8.l >> 5) & 0x1;
 }
 
-uint8_t get_c_flag(void) {
-    return (af.r8.l >> 4) & 0x1;
+uint8_t get_c_flag(gb_t *gb) {
+    switch (gb->flags_op) {
+        case FLAGS_NONE:
+            return (gb->af.r8.l >> 4) & 0x1;
+        case FLAGS_ADD:
+            return (gb->flags_a + gb->flags_b + gb->flags_carry) > 0xFF;
+        case FLAGS_SUB:
+            return gb->flags_a < (gb->flags_b + gb->flags_carry);
+        case FLAGS_INC:
+        case FLAGS_DEC:
+            return gb->flags_carry;
+    }
+    return 0;
 }
 
 typedef enum {
@@ -221,7 +266,8 @@ typedef enum {
     LEAVE
 } set_flag_t;
 
-void update_flags(set_flag_t z, set_flag_t n, set_flag_t h, set_flag_t c) {
+void update_flags(gb_t *gb, set_flag_t z, set_flag_t n, set_flag_t h,
+                  set_flag_t c) {
     uint8_t zb = 0, nb = 0, hb = 0, cb = 0;
     switch (z) {
         case SET_0:
@@ -231,7 +277,7 @@ void update_flags(set_flag_t z, set_flag_t n, set_flag_t h, set_flag_t c) {
             zb = 1;
             break;
         case LEAVE:
-            zb = get_z_flag();
+            zb = get_z_flag(gb);
             break;
     }
     switch (n) {
@@ -242,7 +288,7 @@ void update_flags(set_flag_t z, set_flag_t n, set_flag_t h, set_flag_t c) {
             nb = 1;
             break;
         case LEAVE:
-            nb = get_n_flag();
+            nb = get_n_flag(gb);
             break;
     }
     switch (h) {
@@ -253,7 +299,7 @@ void update_flags(set_flag_t z, set_flag_t n, set_flag_t h, set_flag_t c) {
             hb = 1;
             break;
         case LEAVE:
-            hb = get_h_flag();
+            hb = get_h_flag(gb);
             break;
     }
     switch (c) {
@@ -264,58 +310,851 @@ void update_flags(set_flag_t z, set_flag_t n, set_flag_t h, set_flag_t c) {
             cb = 1;
             break;
         case LEAVE:
-            cb = get_c_flag();
+            cb = get_c_flag(gb);
             break;
     }
-    af.r8.l = (uint8_t)(((((zb << 1) | nb) << 2) | ((hb << 1) | cb)) << 4);
+    gb->af.r8.l = (uint8_t)(((((zb << 1) | nb) << 2) | ((hb << 1) | cb)) << 4);
+    gb->flags_op = FLAGS_NONE;
 }
 
-bool check_cond(uint8_t idx) {
+// With IME clear and an interrupt already pending, HALT doesn't halt and the
+// next opcode byte is read twice instead
+void halt(gb_t *gb) {
+    if (!gb->ime && (gb->r_ie & gb->r_if & 0x1F)) {
+        gb->halt_bug = true;
+    } else {
+        gb->halted = true;
+    }
+}
+
+bool check_cond(gb_t *gb, uint8_t idx) {
     switch (idx) {
         case 0: // nz
-            return !get_z_flag();
+            return !get_z_flag(gb);
         case 1: // z
-            return get_z_flag();
+            return get_z_flag(gb);
         case 2: // nc
-            return !get_c_flag();
+            return !get_c_flag(gb);
         case 3: // c
-            return get_c_flag();
+            return get_c_flag(gb);
     }
     fprintf(stderr, "Invalid condition index %d, exiting...\n", idx);
     exit(1);
 }
 
-void execute(void) {
+typedef struct {
+    uint8_t cycles;
+    uint8_t length;
+} opcode_t;
+
+#define OPCODE_INFO(op, name, a, b, cycles, length) [op] = {cycles, length},
+static const opcode_t main_opcodes[256] = { MAIN_OPCODES(OPCODE_INFO) };
+static const opcode_t cb_opcodes[256] = { CB_OPCODES(OPCODE_INFO) };
+#undef OPCODE_INFO
+
+/* Idle loop detection */
+
+// Registers tracked by the idle loop analysis, indexed like read_r8 plus the
+// two flags a branch can test
+#define IDLE_REG(idx) (1 << (idx))
+#define IDLE_REG_A IDLE_REG(7)
+#define IDLE_FLAG_Z (1 << 8)
+#define IDLE_FLAG_C (1 << 9)
+
+#define IDLE_LOOP_MAX_LEN 16
+// I/O registers that only change when an event runs
+bool is_idle_loop_io(uint16_t addr) {
+    switch (addr) {
+        case 0xFF00: // JOYP
+        case 0xFF04: // DIV
+        case 0xFF0F: // IF
+        case 0xFF41: // STAT
+        case 0xFF44: // LY
+            return true;
+    }
+    return false;
+}
+
+// Returns the cycles per iteration of the loop from target up to and
+// including the taken branch at branch_pc, or 0 unless the loop only reads
+// registers and idle I/O registers. Every register the loop reads must either
+// stay untouched or be written earlier in the same iteration, so that once one
+// iteration has run, every further one until the next event does the same.
+uint16_t analyze_idle_loop(gb_t *gb, uint16_t target, uint16_t branch_pc) {
+    uint16_t written = 0;
+    uint16_t read_first = 0;
+    uint16_t cycles = 0;
+    uint16_t addr = target;
+
+    while (addr != branch_pc) {
+        uint8_t inst = read_mem(gb, addr);
+        uint8_t src = inst & 0x7;
+        uint8_t dst = (inst >> 3) & 0x7;
+        uint16_t reads = 0;
+        uint16_t writes = 0;
+        uint8_t length = main_opcodes[inst].length;
+        cycles += main_opcodes[inst].cycles;
+
+        if (inst == 0x00) { // nop
+        } else if ((inst & 0xC0) == 0x40 && inst != 0x76) { // ld r8, r8
+            if (src == 6 || dst == 6) {
+                return 0;
+            }
+            reads = IDLE_REG(src);
+            writes = IDLE_REG(dst);
+        } else if ((inst & 0xF8) == 0x90 || (inst & 0xE0) == 0xA0) {
+            // sub, and, xor, or, cp a, r8
+            if (src == 6) {
+                return 0;
+            }
+            reads = IDLE_REG_A | IDLE_REG(src);
+            writes = IDLE_FLAG_Z | IDLE_FLAG_C;
+            if ((inst & 0xF8) != 0xB8) { // everything but cp stores to a
+                writes |= IDLE_REG_A;
+            }
+        } else if (inst == 0xD6 || inst == 0xE6 || inst == 0xEE ||
+                   inst == 0xF6 || inst == 0xFE) {
+            // sub, and, xor, or, cp a, imm8
+            reads = IDLE_REG_A;
+            writes = IDLE_FLAG_Z | IDLE_FLAG_C;
+            if (inst != 0xFE) {
+                writes |= IDLE_REG_A;
+            }
+        } else if (inst == 0xF0) { // ldh a, [imm8]
+            if (!is_idle_loop_io(0xFF00 | read_mem(gb, addr + 1))) {
+                return 0;
+            }
+            writes = IDLE_REG_A;
+        } else if (inst == 0xF2) { // ldh a, [c]
+            // C is checked as it is now, so it must not change before this
+            // within the loop. The cache is keyed on it for the same reason.
+            if ((written & IDLE_REG(1)) ||
+                !is_idle_loop_io(0xFF00 | gb->bc.r8.l)) {
+                return 0;
+            }
+            reads = IDLE_REG(1);
+            writes = IDLE_REG_A;
+        } else if (inst == 0xFA) { // ld a, [imm16]
+            if (!is_idle_loop_io(read_imm16(gb, addr + 1))) {
+                return 0;
+            }
+            writes = IDLE_REG_A;
+        } else if (inst == 0xCB) { // bit b3, r8
+            uint8_t inst2 = read_mem(gb, addr + 1);
+            if ((inst2 & 0xC0) != 0x40 || (inst2 & 0x7) == 6) {
+                return 0;
+            }
+            reads = IDLE_REG(inst2 & 0x7);
+            writes = IDLE_FLAG_Z;
+            length += cb_opcodes[inst2].length;
+            cycles += cb_opcodes[inst2].cycles;
+        } else {
+            return 0;
+        }
+
+        read_first |= reads & ~written;
+        written |= writes;
+        addr += length;
+        if ((uint16_t)(addr - target) > IDLE_LOOP_MAX_LEN) {
+            return 0;
+        }
+    }
+
+    // The branch itself, taken
+    uint8_t inst = read_mem(gb, branch_pc);
+    cycles += main_opcodes[inst].cycles;
+    if (inst != 0x18 && inst != 0xC3) { // conditional
+        read_first |= (((inst >> 4) & 1) ? IDLE_FLAG_C : IDLE_FLAG_Z) &
+                      ~written;
+        cycles += 4;
+    }
+
+    if (read_first & written) {
+        return 0;
+    }
+    return cycles;
+}
+
+// Called after a jr or jp at branch_pc jumps backwards, with the part of its
+// cycles not yet added to dots. If the branch closes an idle loop that has
+// just run a full iteration, skip as many iterations as fit before the next
+// event: none of them can change anything. An event during the iteration
+// could have changed what it read after the read, e.g. the STAT mode, so the
+// iteration only counts if none ran. Running an event always moves
+// next_event_time, since the event is removed or rescheduled later.
+void check_idle_loop(gb_t *gb, uint16_t branch_pc, uint8_t pending) {
+    uint16_t target = gb->pc.r16;
+    uint16_t cycles;
+
+    // Only loops within a single page of ROM or WRAM are considered. ROM
+    // loops are cached, along with the C they were analyzed with, since that
+    // decides which register ldh a, [c] reads; WRAM may have been rewritten
+    // since, so those loops are analyzed every time.
+    if ((target ^ branch_pc) & 0xFF00) {
+        return;
+    }
+    if (branch_pc < VRAM_TILES_A) {
+        idle_loop_t *loop =
+            &gb->idle_loop_cache[branch_pc % IDLE_LOOP_CACHE_SIZE];
+        const uint8_t *page = gb->read_pages[branch_pc >> 8];
+        if (loop->page != page || loop->branch_pc != branch_pc ||
+            loop->target != target || loop->c != gb->bc.r8.l) {
+            loop->page = page;
+            loop->branch_pc = branch_pc;
+            loop->target = target;
+            loop->c = gb->bc.r8.l;
+            loop->cycles = analyze_idle_loop(gb, target, branch_pc);
+        }
+        cycles = loop->cycles;
+    } else if (WRAM_A <= branch_pc && branch_pc < ECHO_RAM_A) {
+        cycles = analyze_idle_loop(gb, target, branch_pc);
+    } else {
+        return;
+    }
+    if (!cycles) {
+        return;
+    }
+
+    uint64_t now = gb->dots + pending;
+    bool full_iteration = gb->idle_loop_pc == branch_pc &&
+                          now - gb->idle_loop_dots == cycles &&
+                          gb->idle_loop_next_event == gb->next_event_time;
+    bool interrupt_pending = (gb->ime || gb->set_ime) &&
+                             (gb->r_ie & gb->r_if & 0x1F);
+    if (full_iteration && !interrupt_pending && now < gb->next_event_time) {
+        uint64_t skipped = ((gb->next_event_time - now) / cycles) * cycles;
+        gb->dots += skipped;
+        gb->idle_loop_dots_skipped += skipped;
+        now += skipped;
+    }
+
+    gb->idle_loop_pc = branch_pc;
+    gb->idle_loop_dots = now;
+    gb->idle_loop_next_event = gb->next_event_time;
+}
+
+#ifndef GBEMU_LEGACY_DECODER
+
+// Instruction templates. The tables in opcodes.h expand each of these once
+// per opcode with its operand indices as constants, which lets the compiler
+// fold away the register switches above. By the time a template runs, pc
+// already points past the instruction. Its base cycle cost is added to dots
+// after it runs, so that memory accesses see the time the instruction started
+// at, as they do with the legacy decoder.
+
+uint8_t read_imm8_operand(gb_t *gb) {
+    return read_mem(gb, gb->pc.r16 - 1);
+}
+
+uint16_t read_imm16_operand(gb_t *gb) {
+    return read_imm16(gb, gb->pc.r16 - 2);
+}
+
+static inline void set_lazy_flags(gb_t *gb, uint8_t op, uint8_t a, uint8_t b,
+                                  uint8_t carry, uint8_t res) {
+    gb->flags_op = op;
+    gb->flags_a = a;
+    gb->flags_b = b;
+    gb->flags_carry = carry;
+    gb->flags_res = res;
+}
+
+static inline void alu_add(gb_t *gb, uint8_t val) {
+    uint8_t res = gb->af.r8.h + val;
+    set_lazy_flags(gb, FLAGS_ADD, gb->af.r8.h, val, 0, res);
+    gb->af.r8.h = res;
+}
+
+static inline void alu_adc(gb_t *gb, uint8_t val) {
+    uint8_t c = get_c_flag(gb);
+    uint8_t res = gb->af.r8.h + val + c;
+    set_lazy_flags(gb, FLAGS_ADD, gb->af.r8.h, val, c, res);
+    gb->af.r8.h = res;
+}
+
+static inline void alu_sub(gb_t *gb, uint8_t val) {
+    uint8_t res = gb->af.r8.h - val;
+    set_lazy_flags(gb, FLAGS_SUB, gb->af.r8.h, val, 0, res);
+    gb->af.r8.h = res;
+}
+
+static inline void alu_sbc(gb_t *gb, uint8_t val) {
+    uint8_t c = get_c_flag(gb);
+    uint8_t res = gb->af.r8.h - val - c;
+    set_lazy_flags(gb, FLAGS_SUB, gb->af.r8.h, val, c, res);
+    gb->af.r8.h = res;
+}
+
+static inline void alu_and(gb_t *gb, uint8_t val) {
+    gb->af.r8.h &= val;
+    set_lazy_flags(gb, FLAGS_AND, 0, 0, 0, gb->af.r8.h);
+}
+
+static inline void alu_xor(gb_t *gb, uint8_t val) {
+    gb->af.r8.h ^= val;
+    set_lazy_flags(gb, FLAGS_OR, 0, 0, 0, gb->af.r8.h);
+}
+
+static inline void alu_or(gb_t *gb, uint8_t val) {
+    gb->af.r8.h |= val;
+    set_lazy_flags(gb, FLAGS_OR, 0, 0, 0, gb->af.r8.h);
+}
+
+static inline void alu_cp(gb_t *gb, uint8_t val) {
+    set_lazy_flags(gb, FLAGS_SUB, gb->af.r8.h, val, 0, gb->af.r8.h - val);
+}
+
+static inline uint16_t sp_plus_imm8(gb_t *gb) {
+    uint16_t offset = (uint16_t)(int16_t)(int8_t)read_imm8_operand(gb);
+    uint16_t res = gb->sp.r16 + offset;
+    update_flags(gb,
+        SET_0,
+        SET_0,
+        ((res ^ gb->sp.r16 ^ offset) & 0x10) != 0,
+        ((res ^ gb->sp.r16 ^ offset) & 0x100) != 0
+    );
+    return res;
+}
+
+static inline void call(gb_t *gb, uint16_t addr) {
+    gb->sp.r16 -= 2;
+    write_imm16(gb, gb->sp.r16, gb->pc.r16);
+    gb->pc.r16 = addr;
+}
+
+static inline void op_nop(gb_t *gb, uint8_t a, uint8_t b) {
+}
+
+static inline void op_invalid(gb_t *gb, uint8_t a, uint8_t b) {
+    fprintf(stderr, "Invalid opcode 0x%X, stopping...\n", a);
+    stop_on_error(gb);
+}
+
+static inline void op_stop(gb_t *gb, uint8_t a, uint8_t b) {
+    fprintf(stderr, "Reached STOP opcode!\n");
+    fprintf(stderr, "Unimplemented instruction, stopping...\n");
+    stop_on_error(gb);
+}
+
+static inline void op_halt(gb_t *gb, uint8_t a, uint8_t b) {
+    halt(gb);
+}
+
+static inline void op_ld_r16_imm16(gb_t *gb, uint8_t a, uint8_t b) {
+    write_r16(gb, a, read_imm16_operand(gb));
+}
+
+static inline void op_ld_r16mem_a(gb_t *gb, uint8_t a, uint8_t b) {
+    write_r16mem(gb, a, gb->af.r8.h);
+}
+
+static inline void op_ld_a_r16mem(gb_t *gb, uint8_t a, uint8_t b) {
+    gb->af.r8.h = read_r16mem(gb, a);
+}
+
+static inline void op_inc_r16(gb_t *gb, uint8_t a, uint8_t b) {
+    write_r16(gb, a, read_r16(gb, a) + 1);
+}
+
+static inline void op_dec_r16(gb_t *gb, uint8_t a, uint8_t b) {
+    write_r16(gb, a, read_r16(gb, a) - 1);
+}
+
+static inline void op_add_hl_r16(gb_t *gb, uint8_t a, uint8_t b) {
+    uint16_t r16 = read_r16(gb, a);
+    uint16_t res = gb->hl.r16 + r16;
+    update_flags(gb,
+        LEAVE,
+        SET_0,
+        ((res ^ gb->hl.r16 ^ r16) & 0x1000) != 0,
+        (res < gb->hl.r16) || (res < r16)
+    );
+    gb->hl.r16 = res;
+}
+
+static inline void op_inc_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    uint8_t res = read_r8(gb, a) + 1;
+    set_lazy_flags(gb, FLAGS_INC, 0, 0, get_c_flag(gb), res);
+    write_r8(gb, a, res);
+}
+
+static inline void op_dec_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    uint8_t res = read_r8(gb, a) - 1;
+    set_lazy_flags(gb, FLAGS_DEC, 0, 0, get_c_flag(gb), res);
+    write_r8(gb, a, res);
+}
+
+static inline void op_ld_r8_imm8(gb_t *gb, uint8_t a, uint8_t b) {
+    write_r8(gb, a, read_imm8_operand(gb));
+}
+
+static inline void op_ld_imm16_sp(gb_t *gb, uint8_t a, uint8_t b) {
+    write_imm16(gb, read_imm16_operand(gb), gb->sp.r16);
+}
+
+static inline void op_rlca(gb_t *gb, uint8_t a, uint8_t b) {
+    uint8_t left_set = gb->af.r8.h >> 7;
+    gb->af.r8.h = (gb->af.r8.h << 1) | left_set;
+    update_flags(gb, SET_0, SET_0, SET_0, left_set);
+}
+
+static inline void op_rrca(gb_t *gb, uint8_t a, uint8_t b) {
+    uint8_t right_set = gb->af.r8.h & 1;
+    gb->af.r8.h = (gb->af.r8.h >> 1) | (right_set << 7);
+    update_flags(gb, SET_0, SET_0, SET_0, right_set);
+}
+
+static inline void op_rla(gb_t *gb, uint8_t a, uint8_t b) {
+    uint8_t left_set = gb->af.r8.h >> 7;
+    gb->af.r8.h = (gb->af.r8.h << 1) | get_c_flag(gb);
+    update_flags(gb, SET_0, SET_0, SET_0, left_set);
+}
+
+static inline void op_rra(gb_t *gb, uint8_t a, uint8_t b) {
+    uint8_t right_set = gb->af.r8.h & 1;
+    gb->af.r8.h = (gb->af.r8.h >> 1) | (get_c_flag(gb) << 7);
+    update_flags(gb, SET_0, SET_0, SET_0, right_set);
+}
+
+static inline void op_daa(gb_t *gb, uint8_t a, uint8_t b) {
+    uint8_t res = gb->af.r8.h;
+    uint8_t adj = 0;
+    bool carry = false;
+
+    if (!get_n_flag(gb)) {
+        if (get_h_flag(gb) || (res & 0xF) > 0x9) {
+            adj |= 0x06;
+        }
+        if (get_c_flag(gb) || res > 0x99) {
+            adj |= 0x60;
+            carry = true;
+        }
+        res += adj;
+    } else {
+        if (get_h_flag(gb)) {
+            adj |= 0x06;
+        }
+        if (get_c_flag(gb)) {
+            adj |= 0x60;
+            carry = true;
+        }
+        res -= adj;
+    }
+
+    gb->af.r8.h = res;
+    update_flags(gb, res == 0, LEAVE, SET_0, carry ? SET_1 : LEAVE);
+}
+
+static inline void op_cpl(gb_t *gb, uint8_t a, uint8_t b) {
+    gb->af.r8.h = ~gb->af.r8.h;
+    update_flags(gb, LEAVE, SET_1, SET_1, LEAVE);
+}
+
+static inline void op_scf(gb_t *gb, uint8_t a, uint8_t b) {
+    update_flags(gb, LEAVE, SET_0, SET_0, SET_1);
+}
+
+static inline void op_ccf(gb_t *gb, uint8_t a, uint8_t b) {
+    update_flags(gb, LEAVE, SET_0, SET_0, !get_c_flag(gb));
+}
+
+static inline void op_jr_imm8(gb_t *gb, uint8_t a, uint8_t b) {
+    int8_t offset = (int8_t)read_imm8_operand(gb);
+    gb->pc.r16 += (uint16_t)(int16_t)offset;
+    if (offset < 0) {
+        check_idle_loop(gb, gb->pc.r16 - offset - 2,
+                        main_opcodes[0x18].cycles);
+    }
+}
+
+static inline void op_jr_cond(gb_t *gb, uint8_t a, uint8_t b) {
+    if (check_cond(gb, a)) {
+        int8_t offset = (int8_t)read_imm8_operand(gb);
+        gb->pc.r16 += (uint16_t)(int16_t)offset;
+        gb->dots += 4;
+        if (offset < 0) {
+            check_idle_loop(gb, gb->pc.r16 - offset - 2,
+                            main_opcodes[0x20].cycles);
+        }
+    }
+}
+
+static inline void op_ld_r8_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    write_r8(gb, a, read_r8(gb, b));
+}
+
+static inline void op_add_a_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    alu_add(gb, read_r8(gb, a));
+}
+
+static inline void op_adc_a_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    alu_adc(gb, read_r8(gb, a));
+}
+
+static inline void op_sub_a_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    alu_sub(gb, read_r8(gb, a));
+}
+
+static inline void op_sbc_a_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    alu_sbc(gb, read_r8(gb, a));
+}
+
+static inline void op_and_a_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    alu_and(gb, read_r8(gb, a));
+}
+
+static inline void op_xor_a_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    alu_xor(gb, read_r8(gb, a));
+}
+
+static inline void op_or_a_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    alu_or(gb, read_r8(gb, a));
+}
+
+static inline void op_cp_a_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    alu_cp(gb, read_r8(gb, a));
+}
+
+static inline void op_add_a_imm8(gb_t *gb, uint8_t a, uint8_t b) {
+    alu_add(gb, read_imm8_operand(gb));
+}
+
+static inline void op_adc_a_imm8(gb_t *gb, uint8_t a, uint8_t b) {
+    alu_adc(gb, read_imm8_operand(gb));
+}
+
+static inline void op_sub_a_imm8(gb_t *gb, uint8_t a, uint8_t b) {
+    alu_sub(gb, read_imm8_operand(gb));
+}
+
+static inline void op_sbc_a_imm8(gb_t *gb, uint8_t a, uint8_t b) {
+    alu_sbc(gb, read_imm8_operand(gb));
+}
+
+static inline void op_and_a_imm8(gb_t *gb, uint8_t a, uint8_t b) {
+    alu_and(gb, read_imm8_operand(gb));
+}
+
+static inline void op_xor_a_imm8(gb_t *gb, uint8_t a, uint8_t b) {
+    alu_xor(gb, read_imm8_operand(gb));
+}
+
+static inline void op_or_a_imm8(gb_t *gb, uint8_t a, uint8_t b) {
+    alu_or(gb, read_imm8_operand(gb));
+}
+
+static inline void op_cp_a_imm8(gb_t *gb, uint8_t a, uint8_t b) {
+    alu_cp(gb, read_imm8_operand(gb));
+}
+
+static inline void op_ret_cond(gb_t *gb, uint8_t a, uint8_t b) {
+    if (check_cond(gb, a)) {
+        gb->pc.r16 = read_imm16(gb, gb->sp.r16);
+        gb->sp.r16 += 2;
+        gb->dots += 12;
+    }
+}
+
+static inline void op_jp_cond(gb_t *gb, uint8_t a, uint8_t b) {
+    if (check_cond(gb, a)) {
+        uint16_t branch_pc = gb->pc.r16 - 3;
+        gb->pc.r16 = read_imm16_operand(gb);
+        gb->dots += 4;
+        if (gb->pc.r16 < branch_pc) {
+            check_idle_loop(gb, branch_pc, main_opcodes[0xC2].cycles);
+        }
+    }
+}
+
+static inline void op_call_cond(gb_t *gb, uint8_t a, uint8_t b) {
+    if (check_cond(gb, a)) {
+        call(gb, read_imm16_operand(gb));
+        gb->dots += 12;
+    }
+}
+
+static inline void op_rst(gb_t *gb, uint8_t a, uint8_t b) {
+    call(gb, a);
+}
+
+static inline void op_pop_r16stk(gb_t *gb, uint8_t a, uint8_t b) {
+    write_r16stk(gb, a, read_imm16(gb, gb->sp.r16));
+    gb->sp.r16 += 2;
+}
+
+static inline void op_push_r16stk(gb_t *gb, uint8_t a, uint8_t b) {
+    gb->sp.r16 -= 2;
+    write_imm16(gb, gb->sp.r16, read_r16stk(gb, a));
+}
+
+static inline void op_ret(gb_t *gb, uint8_t a, uint8_t b) {
+    gb->pc.r16 = read_imm16(gb, gb->sp.r16);
+    gb->sp.r16 += 2;
+}
+
+static inline void op_reti(gb_t *gb, uint8_t a, uint8_t b) {
+    gb->pc.r16 = read_imm16(gb, gb->sp.r16);
+    gb->sp.r16 += 2;
+    gb->ime = true;
+}
+
+static inline void op_jp_imm16(gb_t *gb, uint8_t a, uint8_t b) {
+    uint16_t branch_pc = gb->pc.r16 - 3;
+    gb->pc.r16 = read_imm16_operand(gb);
+    if (gb->pc.r16 < branch_pc) {
+        check_idle_loop(gb, branch_pc, main_opcodes[0xC3].cycles);
+    }
+}
+
+static inline void op_jp_hl(gb_t *gb, uint8_t a, uint8_t b) {
+    gb->pc.r16 = gb->hl.r16;
+}
+
+static inline void op_call_imm16(gb_t *gb, uint8_t a, uint8_t b) {
+    call(gb, read_imm16_operand(gb));
+}
+
+static inline void op_ldh_c_a(gb_t *gb, uint8_t a, uint8_t b) {
+    write_mem(gb, 0xFF00 | gb->bc.r8.l, gb->af.r8.h);
+}
+
+static inline void op_ldh_imm8_a(gb_t *gb, uint8_t a, uint8_t b) {
+    write_mem(gb, 0xFF00 | read_imm8_operand(gb), gb->af.r8.h);
+}
+
+static inline void op_ld_imm16_a(gb_t *gb, uint8_t a, uint8_t b) {
+    write_mem(gb, read_imm16_operand(gb), gb->af.r8.h);
+}
+
+static inline void op_ldh_a_c(gb_t *gb, uint8_t a, uint8_t b) {
+    gb->af.r8.h = read_mem(gb, 0xFF00 | gb->bc.r8.l);
+}
+
+static inline void op_ldh_a_imm8(gb_t *gb, uint8_t a, uint8_t b) {
+    gb->af.r8.h = read_mem(gb, 0xFF00 | read_imm8_operand(gb));
+}
+
+static inline void op_ld_a_imm16(gb_t *gb, uint8_t a, uint8_t b) {
+    gb->af.r8.h = read_mem(gb, read_imm16_operand(gb));
+}
+
+static inline void op_add_sp_imm8(gb_t *gb, uint8_t a, uint8_t b) {
+    gb->sp.r16 = sp_plus_imm8(gb);
+}
+
+static inline void op_ld_hl_sp_imm8(gb_t *gb, uint8_t a, uint8_t b) {
+    gb->hl.r16 = sp_plus_imm8(gb);
+}
+
+static inline void op_ld_sp_hl(gb_t *gb, uint8_t a, uint8_t b) {
+    gb->sp.r16 = gb->hl.r16;
+}
+
+static inline void op_di(gb_t *gb, uint8_t a, uint8_t b) {
+    gb->ime = false;
+}
+
+static inline void op_ei(gb_t *gb, uint8_t a, uint8_t b) {
+    gb->set_ime = true;
+}
+
+static inline void op_rlc_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    uint8_t r8 = read_r8(gb, a);
+    uint8_t left_set = r8 >> 7;
+    uint8_t res = (r8 << 1) | left_set;
+    update_flags(gb, res == 0, SET_0, SET_0, left_set);
+    write_r8(gb, a, res);
+}
+
+static inline void op_rrc_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    uint8_t r8 = read_r8(gb, a);
+    uint8_t right_set = r8 & 1;
+    uint8_t res = (r8 >> 1) | (right_set << 7);
+    update_flags(gb, res == 0, SET_0, SET_0, right_set);
+    write_r8(gb, a, res);
+}
+
+static inline void op_rl_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    uint8_t r8 = read_r8(gb, a);
+    uint8_t left_set = r8 >> 7;
+    uint8_t res = (r8 << 1) | get_c_flag(gb);
+    update_flags(gb, res == 0, SET_0, SET_0, left_set);
+    write_r8(gb, a, res);
+}
+
+static inline void op_rr_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    uint8_t r8 = read_r8(gb, a);
+    uint8_t right_set = r8 & 1;
+    uint8_t res = (r8 >> 1) | (get_c_flag(gb) << 7);
+    update_flags(gb, res == 0, SET_0, SET_0, right_set);
+    write_r8(gb, a, res);
+}
+
+static inline void op_sla_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    uint8_t r8 = read_r8(gb, a);
+    uint8_t left_set = r8 >> 7;
+    uint8_t res = r8 << 1;
+    update_flags(gb, res == 0, SET_0, SET_0, left_set);
+    write_r8(gb, a, res);
+}
+
+static inline void op_sra_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    uint8_t r8 = read_r8(gb, a);
+    uint8_t right_set = r8 & 1;
+    uint8_t res = (uint8_t)(((int8_t)r8) >> 1);
+    update_flags(gb, res == 0, SET_0, SET_0, right_set);
+    write_r8(gb, a, res);
+}
+
+static inline void op_swap_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    uint8_t r8 = read_r8(gb, a);
+    uint8_t res = (r8 >> 4) | (r8 << 4);
+    update_flags(gb, res == 0, SET_0, SET_0, SET_0);
+    write_r8(gb, a, res);
+}
+
+static inline void op_srl_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    uint8_t r8 = read_r8(gb, a);
+    uint8_t right_set = r8 & 1;
+    uint8_t res = r8 >> 1;
+    update_flags(gb, res == 0, SET_0, SET_0, right_set);
+    write_r8(gb, a, res);
+}
+
+static inline void op_bit_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    update_flags(gb, ((read_r8(gb, b) >> a) & 1) == 0, SET_0, SET_1, LEAVE);
+}
+
+static inline void op_res_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    write_r8(gb, b, read_r8(gb, b) & ~(1 << a));
+}
+
+static inline void op_set_r8(gb_t *gb, uint8_t a, uint8_t b) {
+    write_r8(gb, b, read_r8(gb, b) | (1 << a));
+}
+
+#if defined(__GNUC__)
+
+// Computed goto: every opcode gets its own label inside the dispatch
+// function, so decoding an instruction is a single indirect jump.
+#define OPCODE_LABEL(op, name, a, b, cycles, length) \
+    [op] = __extension__ &&op_label_##op,
+#define OPCODE_CASE(op, name, a, b, cycles, length) \
+    op_label_##op: op_##name(gb, a, b); gb->dots += cycles; return;
+
+static void execute_cb(gb_t *gb) {
+    static void *const labels[256] = { CB_OPCODES(OPCODE_LABEL) };
+    uint8_t inst = read_mem(gb, gb->pc.r16);
+    gb->pc.r16 += cb_opcodes[inst].length;
+    __extension__ ({ goto *labels[inst]; });
+    CB_OPCODES(OPCODE_CASE)
+}
+
+static inline void op_prefix(gb_t *gb, uint8_t a, uint8_t b) {
+    execute_cb(gb);
+}
+
+static void dispatch(gb_t *gb, uint8_t inst) {
+    static void *const labels[256] = { MAIN_OPCODES(OPCODE_LABEL) };
+    gb->pc.r16 += main_opcodes[inst].length;
+    __extension__ ({ goto *labels[inst]; });
+    MAIN_OPCODES(OPCODE_CASE)
+}
+
+#undef OPCODE_LABEL
+#undef OPCODE_CASE
+
+#else
+
+// Portable fallback: one specialized handler function per opcode, called
+// through a table of function pointers.
+#define OPCODE_HANDLER(op, name, a, b, cycles, length) \
+    static void handle_##op(gb_t *gb) { op_##name(gb, a, b); }
+#define OPCODE_POINTER(op, name, a, b, cycles, length) [op] = handle_##op,
+#define CB_OPCODE_HANDLER(op, name, a, b, cycles, length) \
+    static void handle_cb_##op(gb_t *gb) { op_##name(gb, a, b); }
+#define CB_OPCODE_POINTER(op, name, a, b, cycles, length) \
+    [op] = handle_cb_##op,
+
+CB_OPCODES(CB_OPCODE_HANDLER)
+
+static void (*const cb_handlers[256])(gb_t *gb) = {
+    CB_OPCODES(CB_OPCODE_POINTER)
+};
+
+static void execute_cb(gb_t *gb) {
+    uint8_t inst = read_mem(gb, gb->pc.r16);
+    gb->pc.r16 += cb_opcodes[inst].length;
+    cb_handlers[inst](gb);
+    gb->dots += cb_opcodes[inst].cycles;
+}
+
+static inline void op_prefix(gb_t *gb, uint8_t a, uint8_t b) {
+    execute_cb(gb);
+}
+
+MAIN_OPCODES(OPCODE_HANDLER)
+
+static void (*const main_handlers[256])(gb_t *gb) = {
+    MAIN_OPCODES(OPCODE_POINTER)
+};
+
+static void dispatch(gb_t *gb, uint8_t inst) {
+    gb->pc.r16 += main_opcodes[inst].length;
+    main_handlers[inst](gb);
+    gb->dots += main_opcodes[inst].cycles;
+}
+
+#undef OPCODE_HANDLER
+#undef OPCODE_POINTER
+#undef CB_OPCODE_HANDLER
+#undef CB_OPCODE_POINTER
+
+#endif // defined(__GNUC__)
+
+#endif // GBEMU_LEGACY_DECODER
+
+void execute(gb_t *gb) {
     // Set IME if EI instruction ran last time
-    if (set_ime) {
-        ime = true;
-        set_ime = false;
+    if (gb->set_ime) {
+        gb->ime = true;
+        gb->set_ime = false;
+    }
+
+    // Stay halted until an interrupt is pending, even if IME is clear. Nothing
+    // can request one before the next event, so skip straight to it.
+    if (gb->halted) {
+        if (!(gb->r_ie & gb->r_if & 0x1F)) {
+            gb->dots = gb->next_event_time;
+            return;
+        }
+        gb->halted = false;
     }
 
     // Service Interrupts
-    if (ime) {
+    if (gb->ime) {
         for (int i = 1; i != 0x20; i <<= 1) { // loop over bitmasks
-            if ((r_ie & i) && (r_if & i)) {
-                r_if &= ~i;
-                ime = false;
-                sp.r16 -= 2;
-                write_imm16(sp.r16, pc.r16);
-                dots += 20;
+            if ((gb->r_ie & i) && (gb->r_if & i)) {
+                gb->r_if &= ~i;
+                gb->ime = false;
+                gb->sp.r16 -= 2;
+                write_imm16(gb, gb->sp.r16, gb->pc.r16);
+                gb->dots += 20;
                 switch (i) {
                     case 0x01: // VBlank
-                        pc.r16 = 0x40; 
+                        gb->pc.r16 = 0x40; 
                         break;
                     case 0x02: // STAT
-                        pc.r16 = 0x48; 
+                        gb->pc.r16 = 0x48; 
                         break; 
                     case 0x04: // Timer
-                        pc.r16 = 0x50; 
+                        gb->pc.r16 = 0x50; 
                         break; 
                     case 0x08: // Serial
-                        pc.r16 = 0x58; 
+                        gb->pc.r16 = 0x58; 
                         break; 
                     case 0x10: // Joypad
-                        pc.r16 = 0x60; 
+                        gb->pc.r16 = 0x60; 
                         break; 
                 }
                 return;
@@ -323,245 +1162,268 @@ void execute(void) {
         }
     }
 
-    uint8_t inst = read_mem(pc.r16);
+    uint8_t inst = read_mem(gb, gb->pc.r16);
+
+    // HALT bug: pc isn't incremented after this fetch
+    if (gb->halt_bug) {
+        gb->halt_bug = false;
+        gb->pc.r16--;
+    }
 
+#ifndef GBEMU_LEGACY_DECODER
+    dispatch(gb, inst);
+#else
     switch (inst & 0xC0) {
     
     case 0x0:
         switch (inst & 0xF) {
             case 0x1: // ld r16, imm16
-                write_r16((inst & 0x30) >> 4, read_imm16(pc.r16 + 1));
-                dots += 12;
-                pc.r16 += 3;
+                write_r16(gb, (inst & 0x30) >> 4,
+                          read_imm16(gb, gb->pc.r16 + 1));
+                gb->dots += 12;
+                gb->pc.r16 += 3;
                 return;
             case 0x2: // ld [r16mem], a
-                write_r16mem((inst & 0x30) >> 4, af.r8.h);
-                dots += 8;
-                pc.r16++;
+                write_r16mem(gb, (inst & 0x30) >> 4, gb->af.r8.h);
+                gb->dots += 8;
+                gb->pc.r16++;
                 return;
             case 0xA: // ld a, [r16mem]
-                af.r8.h = read_r16mem((inst & 0x30) >> 4);
-                dots += 8;
-                pc.r16++;
+                gb->af.r8.h = read_r16mem(gb, (inst & 0x30) >> 4);
+                gb->dots += 8;
+                gb->pc.r16++;
                 return;
             case 0x3: { // inc r16
                 uint8_t idx = (inst & 0x30) >> 4;
-                write_r16(idx, read_r16(idx) + 1);
-                dots += 8;
-                pc.r16++;
+                write_r16(gb, idx, read_r16(gb, idx) + 1);
+                gb->dots += 8;
+                gb->pc.r16++;
                 return;
             }
             case 0xB: { // dec r16
                 uint8_t idx = (inst & 0x30) >> 4;
-                write_r16(idx, read_r16(idx) - 1);
-                dots += 8;
-                pc.r16++;
+                write_r16(gb, idx, read_r16(gb, idx) - 1);
+                gb->dots += 8;
+                gb->pc.r16++;
                 return;
             }
             case 0x9: { // add hl, r16
                 uint8_t idx = (inst & 0x30) >> 4;
-                uint16_t r16 = read_r16(idx);
-                uint16_t res = hl.r16 + r16;
-                update_flags(
+                uint16_t r16 = read_r16(gb, idx);
+                uint16_t res = gb->hl.r16 + r16;
+                update_flags(gb,
                     LEAVE,
                     SET_0,
-                    ((res ^ hl.r16 ^ r16) & 0x1000) != 0,
-                    (res < hl.r16) || (res < r16)
+                    ((res ^ gb->hl.r16 ^ r16) & 0x1000) != 0,
+                    (res < gb->hl.r16) || (res < r16)
                 );
-                hl.r16 = res;
-                dots += 8;
-                pc.r16++;
+                gb->hl.r16 = res;
+                gb->dots += 8;
+                gb->pc.r16++;
                 return;
             }
         }
         switch (inst & 0x7) {
             case 0x4: { // inc r8
                 uint8_t idx = (inst & 0x38) >> 3;
-                uint8_t r8 = read_r8(idx);
+                uint8_t r8 = read_r8(gb, idx);
                 uint8_t res = r8 + 1;
-                update_flags(
+                update_flags(gb,
                     res == 0,
                     SET_0,
                     ((res ^ r8 ^ 1) & 0x10) != 0,
                     LEAVE
                 );
-                write_r8(idx, res);
+                write_r8(gb, idx, res);
                 if (idx == 6) {
-                    dots += 12;
+                    gb->dots += 12;
                 } else {
-                    dots += 4;
+                    gb->dots += 4;
                 }  
-                pc.r16++;
+                gb->pc.r16++;
                 return;
             }
             case 0x5: { // dec r8
                 uint8_t idx = (inst & 0x38) >> 3;
-                uint8_t r8 = read_r8(idx);
+                uint8_t r8 = read_r8(gb, idx);
                 uint8_t res = r8 - 1;
-                update_flags(
+                update_flags(gb,
                     res == 0,
                     SET_1,
                     ((res ^ r8 ^ 1) & 0x10) != 0,
                     LEAVE
                 );
-                write_r8(idx, res);
+                write_r8(gb, idx, res);
                 if (idx == 6) {
-                    dots += 12;
+                    gb->dots += 12;
                 } else {
-                    dots += 4;
+                    gb->dots += 4;
                 }  
-                pc.r16++;
+                gb->pc.r16++;
                 return;
             }
             case 0x6: // ld r8, imm8
-                write_r8((inst & 0x38) >> 3, read_mem(pc.r16 + 1));
+                write_r8(gb, (inst & 0x38) >> 3, read_mem(gb, gb->pc.r16 + 1));
                 if (((inst & 0x38) >> 3) == 6) {
-                    dots += 12;
+                    gb->dots += 12;
                 } else {
-                    dots += 8;
+                    gb->dots += 8;
                 }
-                pc.r16 += 2;
+                gb->pc.r16 += 2;
                 return;
         }
         if ((inst & 0x27) == 0x20) { // jr cond, imm8
             uint8_t idx = (inst & 0x18) >> 3;
-            if (check_cond(idx)) {
-                int16_t jump_offset = (int16_t)(int8_t)read_mem(pc.r16 + 1);
-                dots += 12;
-                pc.r16 += (uint16_t)jump_offset;
-                pc.r16 += 2;
+            if (check_cond(gb, idx)) {
+                int16_t jump_offset =
+                    (int16_t)(int8_t)read_mem(gb, gb->pc.r16 + 1);
+                uint16_t branch_pc = gb->pc.r16;
+                gb->dots += 12;
+                gb->pc.r16 += (uint16_t)jump_offset;
+                gb->pc.r16 += 2;
+                if (jump_offset < 0) {
+                    check_idle_loop(gb, branch_pc, 0);
+                }
             } else {
-                dots += 8;
-                pc.r16 += 2;
+                gb->dots += 8;
+                gb->pc.r16 += 2;
             }
             return;
         }
         switch (inst) {
             case 0x0: // nop
-                dots += 4;
-                pc.r16++;
+                gb->dots += 4;
+                gb->pc.r16++;
                 return;
             case 0x8: // ld [imm16], sp
-                write_imm16(read_imm16(pc.r16 + 1), sp.r16);
-                dots += 20;
-                pc.r16 += 3;
+                write_imm16(gb, read_imm16(gb, gb->pc.r16 + 1), gb->sp.r16);
+                gb->dots += 20;
+                gb->pc.r16 += 3;
                 return;
             case 0x7: { // rlca
-                uint8_t left_set = af.r8.h >> 7;
-                af.r8.h = (af.r8.h << 1) | left_set;
-                update_flags(SET_0, SET_0, SET_0, left_set);
-                dots += 4;
-                pc.r16++;
+                uint8_t left_set = gb->af.r8.h >> 7;
+                gb->af.r8.h = (gb->af.r8.h << 1) | left_set;
+                update_flags(gb, SET_0, SET_0, SET_0, left_set);
+                gb->dots += 4;
+                gb->pc.r16++;
                 return;
             }
             case 0xF: { // rrca
-                uint8_t right_set = af.r8.h & 1;
-                af.r8.h = (af.r8.h >> 1) | (right_set << 7);
-                update_flags(SET_0, SET_0, SET_0, right_set);
-                dots += 4;
-                pc.r16++;
+                uint8_t right_set = gb->af.r8.h & 1;
+                gb->af.r8.h = (gb->af.r8.h >> 1) | (right_set << 7);
+                update_flags(gb, SET_0, SET_0, SET_0, right_set);
+                gb->dots += 4;
+                gb->pc.r16++;
                 return;
             }
             case 0x17: { // rla
-                uint8_t left_set = af.r8.h >> 7;
-                af.r8.h = (af.r8.h << 1) | get_c_flag();
-                update_flags(SET_0, SET_0, SET_0, left_set);
-                dots += 4;
-                pc.r16++;
+                uint8_t left_set = gb->af.r8.h >> 7;
+                gb->af.r8.h = (gb->af.r8.h << 1) | get_c_flag(gb);
+                update_flags(gb, SET_0, SET_0, SET_0, left_set);
+                gb->dots += 4;
+                gb->pc.r16++;
                 return;
             }
             case 0x1F: { // rra
-                uint8_t right_set = af.r8.h & 1;
-                af.r8.h = (af.r8.h >> 1) | (get_c_flag() << 7);
-                update_flags(SET_0, SET_0, SET_0, right_set);
-                dots += 4;
-                pc.r16++;
+                uint8_t right_set = gb->af.r8.h & 1;
+                gb->af.r8.h = (gb->af.r8.h >> 1) | (get_c_flag(gb) << 7);
+                update_flags(gb, SET_0, SET_0, SET_0, right_set);
+                gb->dots += 4;
+                gb->pc.r16++;
                 return;
             }
             case 0x27: { // daa
-                uint8_t res = af.r8.h;
+                uint8_t res = gb->af.r8.h;
                 uint8_t adj = 0;
                 bool carry = false;
 
-                if (!get_n_flag()) {
-                    if (get_h_flag() || (res & 0xF) > 0x9) {
+                if (!get_n_flag(gb)) {
+                    if (get_h_flag(gb) || (res & 0xF) > 0x9) {
                         adj |= 0x06;
                     }
-                    if (get_c_flag() || res > 0x99) {
+                    if (get_c_flag(gb) || res > 0x99) {
                         adj |= 0x60;
                         carry = true;
                     }
                     res += adj;
                 } else {
-                    if (get_h_flag()) {
+                    if (get_h_flag(gb)) {
                         adj |= 0x06;
                     }
-                    if (get_c_flag()) {
+                    if (get_c_flag(gb)) {
                         adj |= 0x60;
                         carry = true;
                     }
                     res -= adj;
                 }
 
-                af.r8.h = res;
-                update_flags(
+                gb->af.r8.h = res;
+                update_flags(gb,
                     res == 0,
                     LEAVE,
                     SET_0,
                     carry ? SET_1 : LEAVE
                 );
 
-                dots += 4;
-                pc.r16++;
+                gb->dots += 4;
+                gb->pc.r16++;
                 return;
             }
             case 0x2F: // cpl
-                af.r8.h = ~af.r8.h;
-                update_flags(LEAVE, SET_1, SET_1, LEAVE);
-                dots += 4;
-                pc.r16++;
+                gb->af.r8.h = ~gb->af.r8.h;
+                update_flags(gb, LEAVE, SET_1, SET_1, LEAVE);
+                gb->dots += 4;
+                gb->pc.r16++;
                 return;
             case 0x37: // scf
-                update_flags(LEAVE, SET_0, SET_0, SET_1);
-                dots += 4;
-                pc.r16++;
+                update_flags(gb, LEAVE, SET_0, SET_0, SET_1);
+                gb->dots += 4;
+                gb->pc.r16++;
                 return;
             case 0x3F: // ccf
-                update_flags(LEAVE, SET_0, SET_0, !get_c_flag());
-                dots += 4;
-                pc.r16++;
+                update_flags(gb, LEAVE, SET_0, SET_0, !get_c_flag(gb));
+                gb->dots += 4;
+                gb->pc.r16++;
                 return;
             case 0x18: { // jr imm8
-                int16_t jump_offset = (int16_t)(int8_t)read_mem(pc.r16 + 1);
-                dots += 12;
-                pc.r16 += (uint16_t)jump_offset;
-                pc.r16 += 2;
+                int16_t jump_offset =
+                    (int16_t)(int8_t)read_mem(gb, gb->pc.r16 + 1);
+                uint16_t branch_pc = gb->pc.r16;
+                gb->dots += 12;
+                gb->pc.r16 += (uint16_t)jump_offset;
+                gb->pc.r16 += 2;
+                if (jump_offset < 0) {
+                    check_idle_loop(gb, branch_pc, 0);
+                }
                 return;
             }
             case 0x10: { // stop
                 fprintf(stderr, "Reached STOP opcode!\n");
-                fprintf(stderr, "Unimplemented instruction, exiting...\n");
-                exit(1);
+                fprintf(stderr, "Unimplemented instruction, stopping...\n");
+                stop_on_error(gb);
+                gb->dots += 4;
+                return;
             }
         }
         break;
     
     case 0x40: {
         if (inst == 0x76) { // halt
-            fprintf(stderr, "Reached HALT opcode!\n");
-            fprintf(stderr, "Unimplemented instruction, exiting...\n");
-            exit(1);
+            halt(gb);
+            gb->dots += 4;
+            gb->pc.r16++;
+            return;
         }
         // ld r8, r8
         uint8_t dst = (inst >> 3) & 0x7;
         uint8_t src = inst & 0x7;
-        write_r8(dst, read_r8(src));
+        write_r8(gb, dst, read_r8(gb, src));
         if (dst == 6 || src == 6) {
-            dots += 8;
+            gb->dots += 8;
         } else {
-            dots += 4;
+            gb->dots += 4;
         }
-        pc.r16++;
+        gb->pc.r16++;
         return;
     }
 
@@ -569,139 +1431,139 @@ void execute(void) {
         switch (inst & 0x38) {
             case 0x0: { // add a, r8
                 uint8_t idx = inst & 0x7;
-                uint8_t r8 = read_r8(idx);
-                uint8_t res = af.r8.h + r8;
-                update_flags(
+                uint8_t r8 = read_r8(gb, idx);
+                uint8_t res = gb->af.r8.h + r8;
+                update_flags(gb,
                     res == 0,
                     SET_0,
-                    ((res ^ af.r8.h ^ r8) & 0x10) != 0,
-                    (res < af.r8.h) || (res < r8)
+                    ((res ^ gb->af.r8.h ^ r8) & 0x10) != 0,
+                    (res < gb->af.r8.h) || (res < r8)
                 );
-                af.r8.h = res;
+                gb->af.r8.h = res;
                 if (idx == 6) {
-                    dots += 8;
+                    gb->dots += 8;
                 } else {
-                    dots += 4;
+                    gb->dots += 4;
                 }
-                pc.r16++;
+                gb->pc.r16++;
                 return;
             }
             case 0x8: { // adc a, r8
                 uint8_t idx = inst & 0x7;
-                uint8_t a = af.r8.h;
-                uint8_t r8 = read_r8(idx);
-                uint8_t c = get_c_flag();
+                uint8_t a = gb->af.r8.h;
+                uint8_t r8 = read_r8(gb, idx);
+                uint8_t c = get_c_flag(gb);
                 uint8_t res = a + r8 + c;
-                update_flags(
+                update_flags(gb,
                     res == 0,
                     SET_0,
                     ((a & 0xF) + (r8 & 0xF) + c) > 0xF,
                     (uint16_t)a + (uint16_t)r8 + (uint16_t)c > 0xFF
                 );
-                af.r8.h = res;
+                gb->af.r8.h = res;
                 if (idx == 6) {
-                    dots += 8;
+                    gb->dots += 8;
                 } else {
-                    dots += 4;
+                    gb->dots += 4;
                 }              
-                pc.r16++;
+                gb->pc.r16++;
                 return;
             }
             case 0x10: { // sub a, r8
                 uint8_t idx = inst & 0x7;
-                uint8_t r8 = read_r8(idx);
-                uint8_t res = af.r8.h - r8;
-                update_flags(
+                uint8_t r8 = read_r8(gb, idx);
+                uint8_t res = gb->af.r8.h - r8;
+                update_flags(gb,
                     res == 0,
                     SET_1,
-                    ((res ^ af.r8.h ^ r8) & 0x10) != 0,
-                    r8 > af.r8.h
+                    ((res ^ gb->af.r8.h ^ r8) & 0x10) != 0,
+                    r8 > gb->af.r8.h
                 );
-                af.r8.h = res;
+                gb->af.r8.h = res;
                 if (idx == 6) {
-                    dots += 8;
+                    gb->dots += 8;
                 } else {
-                    dots += 4;
+                    gb->dots += 4;
                 }  
-                pc.r16++;
+                gb->pc.r16++;
                 return;
             }
             case 0x18: { // sbc a, r8
                 uint8_t idx = inst & 0x7;
-                uint8_t a = af.r8.h;
-                uint8_t r8 = read_r8(idx);
-                uint8_t c = get_c_flag();
-                uint8_t res = af.r8.h - (uint8_t)(r8 + c);
-                update_flags(
+                uint8_t a = gb->af.r8.h;
+                uint8_t r8 = read_r8(gb, idx);
+                uint8_t c = get_c_flag(gb);
+                uint8_t res = gb->af.r8.h - (uint8_t)(r8 + c);
+                update_flags(gb,
                     res == 0,
                     SET_1,
                     ((a ^ r8 ^ c ^ res) & 0x10) != 0,
                     a < (r8 + c)
                 );
-                af.r8.h = res;
+                gb->af.r8.h = res;
                 if (idx == 6) {
-                    dots += 8;
+                    gb->dots += 8;
                 } else {
-                    dots += 4;
+                    gb->dots += 4;
                 }  
-                pc.r16++;
+                gb->pc.r16++;
                 return;
             }
             case 0x20: { // and a, r8
                 uint8_t idx = inst & 0x7;
-                uint8_t r8 = read_r8(idx);
-                af.r8.h &= r8;
-                update_flags(af.r8.h == 0, SET_0, SET_1, SET_0);
+                uint8_t r8 = read_r8(gb, idx);
+                gb->af.r8.h &= r8;
+                update_flags(gb, gb->af.r8.h == 0, SET_0, SET_1, SET_0);
                 if (idx == 6) {
-                    dots += 8;
+                    gb->dots += 8;
                 } else {
-                    dots += 4;
+                    gb->dots += 4;
                 }  
-                pc.r16++;
+                gb->pc.r16++;
                 return;
             }
             case 0x28: { // xor a, r8
                 uint8_t idx = inst & 0x7;
-                uint8_t r8 = read_r8(idx);
-                af.r8.h ^= r8;
-                update_flags(af.r8.h == 0, SET_0, SET_0, SET_0);
+                uint8_t r8 = read_r8(gb, idx);
+                gb->af.r8.h ^= r8;
+                update_flags(gb, gb->af.r8.h == 0, SET_0, SET_0, SET_0);
                 if (idx == 6) {
-                    dots += 8;
+                    gb->dots += 8;
                 } else {
-                    dots += 4;
+                    gb->dots += 4;
                 }  
-                pc.r16++;
+                gb->pc.r16++;
                 return;
             }
             case 0x30: { // or a, r8
                 uint8_t idx = inst & 0x7;
-                uint8_t r8 = read_r8(idx);
-                af.r8.h |= r8;
-                update_flags(af.r8.h == 0, SET_0, SET_0, SET_0);
+                uint8_t r8 = read_r8(gb, idx);
+                gb->af.r8.h |= r8;
+                update_flags(gb, gb->af.r8.h == 0, SET_0, SET_0, SET_0);
                 if (idx == 6) {
-                    dots += 8;
+                    gb->dots += 8;
                 } else {
-                    dots += 4;
+                    gb->dots += 4;
                 }  
-                pc.r16++;
+                gb->pc.r16++;
                 return;
             }
             case 0x38: { // cp a, r8
                 uint8_t idx = inst & 0x7;
-                uint8_t r8 = read_r8(idx);
-                uint8_t res = af.r8.h - r8;
-                update_flags(
+                uint8_t r8 = read_r8(gb, idx);
+                uint8_t res = gb->af.r8.h - r8;
+                update_flags(gb,
                     res == 0,
                     SET_1,
-                    ((res ^ af.r8.h ^ r8) & 0x10) != 0,
-                    r8 > af.r8.h
+                    ((res ^ gb->af.r8.h ^ r8) & 0x10) != 0,
+                    r8 > gb->af.r8.h
                 );
                 if (idx == 6) {
-                    dots += 8;
+                    gb->dots += 8;
                 } else {
-                    dots += 4;
+                    gb->dots += 4;
                 }  
-                pc.r16++;
+                gb->pc.r16++;
                 return;
             }
         }
@@ -712,394 +1574,405 @@ void execute(void) {
         switch (inst & 0x27) {
             case 0x0: { // ret cond
                 uint8_t idx = (inst & 0x18) >> 3;
-                if (check_cond(idx)) {
-                    dots += 20;
-                    pc.r16 = read_imm16(sp.r16);
-                    sp.r16 += 2;
+                if (check_cond(gb, idx)) {
+                    gb->dots += 20;
+                    gb->pc.r16 = read_imm16(gb, gb->sp.r16);
+                    gb->sp.r16 += 2;
                 } else {
-                    dots += 8;
-                    pc.r16++;
+                    gb->dots += 8;
+                    gb->pc.r16++;
                 }
                 return;
             }
             case 0x2: { // jp cond, imm16
                 uint8_t idx = (inst & 0x18) >> 3;
-                if (check_cond(idx)) {
-                    dots += 16;
-                    pc.r16 = read_imm16(pc.r16 + 1);
+                if (check_cond(gb, idx)) {
+                    uint16_t branch_pc = gb->pc.r16;
+                    gb->dots += 16;
+                    gb->pc.r16 = read_imm16(gb, gb->pc.r16 + 1);
+                    if (gb->pc.r16 < branch_pc) {
+                        check_idle_loop(gb, branch_pc, 0);
+                    }
                 } else {
-                    dots += 12;
-                    pc.r16 += 3;
+                    gb->dots += 12;
+                    gb->pc.r16 += 3;
                 }
                 return;
             }
             case 0x4: { // call cond, imm16
                 uint8_t idx = (inst & 0x18) >> 3;
-                if (check_cond(idx)) {
-                    uint16_t ret_addr = pc.r16 + 3;
-                    sp.r16 -= 2;
-                    write_imm16(sp.r16, ret_addr);
-                    dots += 24;
-                    pc.r16 = read_imm16(pc.r16 + 1);
+                if (check_cond(gb, idx)) {
+                    uint16_t ret_addr = gb->pc.r16 + 3;
+                    gb->sp.r16 -= 2;
+                    write_imm16(gb, gb->sp.r16, ret_addr);
+                    gb->dots += 24;
+                    gb->pc.r16 = read_imm16(gb, gb->pc.r16 + 1);
                 } else {
-                    dots += 12;
-                    pc.r16 += 3;
+                    gb->dots += 12;
+                    gb->pc.r16 += 3;
                 }
                 return;
             }
         }
         if ((inst & 0x7) == 0x7) { // rst tgt3
-            uint16_t ret_addr = pc.r16 + 1;
-            sp.r16 -= 2;
-            write_imm16(sp.r16, ret_addr);
-            dots += 16;
-            pc.r16 = inst & 0x38;
+            uint16_t ret_addr = gb->pc.r16 + 1;
+            gb->sp.r16 -= 2;
+            write_imm16(gb, gb->sp.r16, ret_addr);
+            gb->dots += 16;
+            gb->pc.r16 = inst & 0x38;
             return;
         }
         switch (inst & 0xF) {
             case 0x1: { // pop r16stk
                 uint8_t idx = (inst & 0x30) >> 4;
-                write_r16stk(idx, read_imm16(sp.r16));
-                sp.r16 += 2;
-                dots += 12;
-                pc.r16++;
+                write_r16stk(gb, idx, read_imm16(gb, gb->sp.r16));
+                gb->sp.r16 += 2;
+                gb->dots += 12;
+                gb->pc.r16++;
                 return;
             }
             case 0x5: { // push r16stk
                 uint8_t idx = (inst & 0x30) >> 4;
-                sp.r16 -= 2;
-                write_imm16(sp.r16, read_r16stk(idx));
-                dots += 16;
-                pc.r16++;
+                gb->sp.r16 -= 2;
+                write_imm16(gb, gb->sp.r16, read_r16stk(gb, idx));
+                gb->dots += 16;
+                gb->pc.r16++;
                 return;
             }
         }
         switch (inst) {
             case 0xC6: { // add a, imm8
-                uint8_t imm8 = read_mem(pc.r16 + 1);
-                uint8_t res = af.r8.h + imm8;
-                update_flags(
+                uint8_t imm8 = read_mem(gb, gb->pc.r16 + 1);
+                uint8_t res = gb->af.r8.h + imm8;
+                update_flags(gb,
                     res == 0,
                     SET_0,
-                    ((res ^ af.r8.h ^ imm8) & 0x10) != 0,
-                    (res < af.r8.h) || (res < imm8)
+                    ((res ^ gb->af.r8.h ^ imm8) & 0x10) != 0,
+                    (res < gb->af.r8.h) || (res < imm8)
                 );
-                af.r8.h = res;
-                dots += 8;
-                pc.r16 += 2;
+                gb->af.r8.h = res;
+                gb->dots += 8;
+                gb->pc.r16 += 2;
                 return;
             }
             case 0xCE: { // adc a, imm8
-                uint8_t imm8 = read_mem(pc.r16 + 1);
-                uint8_t a = af.r8.h;
-                uint8_t c = get_c_flag();
+                uint8_t imm8 = read_mem(gb, gb->pc.r16 + 1);
+                uint8_t a = gb->af.r8.h;
+                uint8_t c = get_c_flag(gb);
                 uint8_t res = a + imm8 + c;
-                update_flags(
+                update_flags(gb,
                     res == 0,
                     SET_0,
                     ((a & 0xF) + (imm8 & 0xF) + c) > 0xF,
                     (uint16_t)a + (uint16_t)imm8 + (uint16_t)c > 0xFF
                 );
-                af.r8.h = res;
-                dots += 8;
-                pc.r16 += 2;
+                gb->af.r8.h = res;
+                gb->dots += 8;
+                gb->pc.r16 += 2;
                 return;
             }
             case 0xD6: { // sub a, imm8
-                uint8_t imm8 = read_mem(pc.r16 + 1);
-                uint8_t res = af.r8.h - imm8;
-                update_flags(
+                uint8_t imm8 = read_mem(gb, gb->pc.r16 + 1);
+                uint8_t res = gb->af.r8.h - imm8;
+                update_flags(gb,
                     res == 0,
                     SET_1,
-                    ((res ^ af.r8.h ^ imm8) & 0x10) != 0,
-                    imm8 > af.r8.h
+                    ((res ^ gb->af.r8.h ^ imm8) & 0x10) != 0,
+                    imm8 > gb->af.r8.h
                 );
-                af.r8.h = res;
-                dots += 8;
-                pc.r16 += 2;
+                gb->af.r8.h = res;
+                gb->dots += 8;
+                gb->pc.r16 += 2;
                 return;
             }
             case 0xDE: { // sbc a, imm8
-                uint8_t imm8 = read_mem(pc.r16 + 1);
-                uint8_t a = af.r8.h;
-                uint8_t c = get_c_flag();
+                uint8_t imm8 = read_mem(gb, gb->pc.r16 + 1);
+                uint8_t a = gb->af.r8.h;
+                uint8_t c = get_c_flag(gb);
                 uint8_t res = a - (uint8_t)(imm8 + c);
-                update_flags(
+                update_flags(gb,
                     res == 0,
                     SET_1,
                     ((a ^ imm8 ^ c ^ res) & 0x10) != 0,
                     a < (imm8 + c)
                 );
-                af.r8.h = res;
-                dots += 8;
-                pc.r16 += 2;
+                gb->af.r8.h = res;
+                gb->dots += 8;
+                gb->pc.r16 += 2;
                 return;
             }
             case 0xE6: { // and a, imm8
-                uint8_t imm8 = read_mem(pc.r16 + 1);
-                af.r8.h &= imm8;
-                update_flags(af.r8.h == 0, SET_0, SET_1, SET_0);
-                dots += 8;
-                pc.r16 += 2;
+                uint8_t imm8 = read_mem(gb, gb->pc.r16 + 1);
+                gb->af.r8.h &= imm8;
+                update_flags(gb, gb->af.r8.h == 0, SET_0, SET_1, SET_0);
+                gb->dots += 8;
+                gb->pc.r16 += 2;
                 return;
             }
             case 0xEE: { // xor a, imm8
-                uint8_t imm8 = read_mem(pc.r16 + 1);
-                af.r8.h ^= imm8;
-                update_flags(af.r8.h == 0, SET_0, SET_0, SET_0);
-                dots += 8;
-                pc.r16 += 2;
+                uint8_t imm8 = read_mem(gb, gb->pc.r16 + 1);
+                gb->af.r8.h ^= imm8;
+                update_flags(gb, gb->af.r8.h == 0, SET_0, SET_0, SET_0);
+                gb->dots += 8;
+                gb->pc.r16 += 2;
                 return;
             }
             case 0xF6: { // or a, imm8
-                uint8_t imm8 = read_mem(pc.r16 + 1);
-                af.r8.h |= imm8;
-                update_flags(af.r8.h == 0, SET_0, SET_0, SET_0);
-                dots += 8;
-                pc.r16 += 2;
+                uint8_t imm8 = read_mem(gb, gb->pc.r16 + 1);
+                gb->af.r8.h |= imm8;
+                update_flags(gb, gb->af.r8.h == 0, SET_0, SET_0, SET_0);
+                gb->dots += 8;
+                gb->pc.r16 += 2;
                 return;
             }
             case 0xFE: { // cp a, imm8
-                uint8_t imm8 = read_mem(pc.r16 + 1);
-                uint8_t res = af.r8.h - imm8;
-                update_flags(
+                uint8_t imm8 = read_mem(gb, gb->pc.r16 + 1);
+                uint8_t res = gb->af.r8.h - imm8;
+                update_flags(gb,
                     res == 0,
                     SET_1,
-                    ((res ^ af.r8.h ^ imm8) & 0x10) != 0,
-                    imm8 > af.r8.h
+                    ((res ^ gb->af.r8.h ^ imm8) & 0x10) != 0,
+                    imm8 > gb->af.r8.h
                 );
-                dots += 8;
-                pc.r16 += 2;
+                gb->dots += 8;
+                gb->pc.r16 += 2;
                 return;
             }
             case 0xC9: // ret
-                dots += 16;
-                pc.r16 = read_imm16(sp.r16);
-                sp.r16 += 2;
+                gb->dots += 16;
+                gb->pc.r16 = read_imm16(gb, gb->sp.r16);
+                gb->sp.r16 += 2;
                 return;
             case 0xD9: // reti
-                dots += 16;
-                pc.r16 = read_imm16(sp.r16);
-                sp.r16 += 2;
-                ime = true;
+                gb->dots += 16;
+                gb->pc.r16 = read_imm16(gb, gb->sp.r16);
+                gb->sp.r16 += 2;
+                gb->ime = true;
                 return;
-            case 0xC3: // jp imm16
-                dots += 16;
-                pc.r16 = read_imm16(pc.r16 + 1);
+            case 0xC3: { // jp imm16
+                uint16_t branch_pc = gb->pc.r16;
+                gb->dots += 16;
+                gb->pc.r16 = read_imm16(gb, gb->pc.r16 + 1);
+                if (gb->pc.r16 < branch_pc) {
+                    check_idle_loop(gb, branch_pc, 0);
+                }
                 return;
+            }
             case 0xE9: // jp hl
-                dots += 4;
-                pc.r16 = hl.r16;
+                gb->dots += 4;
+                gb->pc.r16 = gb->hl.r16;
                 return;
             case 0xCD: { // call imm16
-                uint16_t ret_addr = pc.r16 + 3;
-                sp.r16 -= 2;
-                write_imm16(sp.r16, ret_addr);
-                dots += 24;
-                pc.r16 = read_imm16(pc.r16 + 1);
+                uint16_t ret_addr = gb->pc.r16 + 3;
+                gb->sp.r16 -= 2;
+                write_imm16(gb, gb->sp.r16, ret_addr);
+                gb->dots += 24;
+                gb->pc.r16 = read_imm16(gb, gb->pc.r16 + 1);
                 return;
             }
             case 0xE2: // ldh [c], a
-                write_mem(0xFF00 | bc.r8.l, af.r8.h);
-                dots += 8;
-                pc.r16++;
+                write_mem(gb, 0xFF00 | gb->bc.r8.l, gb->af.r8.h);
+                gb->dots += 8;
+                gb->pc.r16++;
                 return;
             case 0xE0: // ldh [imm8], a
-                write_mem(0xFF00 | read_mem(pc.r16 + 1), af.r8.h);
-                dots += 12;
-                pc.r16 += 2;
+                write_mem(gb, 0xFF00 | read_mem(gb, gb->pc.r16 + 1),
+                          gb->af.r8.h);
+                gb->dots += 12;
+                gb->pc.r16 += 2;
                 return;
             case 0xEA: // ld [imm16], a
-                write_mem(read_imm16(pc.r16 + 1), af.r8.h);
-                dots += 16;
-                pc.r16 += 3;
+                write_mem(gb, read_imm16(gb, gb->pc.r16 + 1), gb->af.r8.h);
+                gb->dots += 16;
+                gb->pc.r16 += 3;
                 return;
             case 0xF2: // ldh a, [c]
-                af.r8.h = read_mem(0xFF00 | bc.r8.l);
-                dots += 8;
-                pc.r16++;
+                gb->af.r8.h = read_mem(gb, 0xFF00 | gb->bc.r8.l);
+                gb->dots += 8;
+                gb->pc.r16++;
                 return;
             case 0xF0: // ldh a, [imm8]
-                af.r8.h = read_mem(0xFF00 | read_mem(pc.r16 + 1));
-                dots += 12;
-                pc.r16 += 2;
+                gb->af.r8.h =
+                    read_mem(gb, 0xFF00 | read_mem(gb, gb->pc.r16 + 1));
+                gb->dots += 12;
+                gb->pc.r16 += 2;
                 return;
             case 0xFA: // ld a, [imm16]
-                af.r8.h = read_mem(read_imm16(pc.r16 + 1));
-                dots += 16;
-                pc.r16 += 3;
+                gb->af.r8.h = read_mem(gb, read_imm16(gb, gb->pc.r16 + 1));
+                gb->dots += 16;
+                gb->pc.r16 += 3;
                 return;
             case 0xE8: { // add sp, imm8
-                uint8_t imm8 = read_mem(pc.r16 + 1);
+                uint8_t imm8 = read_mem(gb, gb->pc.r16 + 1);
                 uint16_t offset = (uint16_t)(int16_t)(int8_t)imm8;
-                uint16_t res = sp.r16 + offset;
-                update_flags(
+                uint16_t res = gb->sp.r16 + offset;
+                update_flags(gb,
                     SET_0,
                     SET_0,
-                    ((res ^ sp.r16 ^ offset) & 0x10) != 0,
-                    ((res ^ sp.r16 ^ offset) & 0x100) != 0
+                    ((res ^ gb->sp.r16 ^ offset) & 0x10) != 0,
+                    ((res ^ gb->sp.r16 ^ offset) & 0x100) != 0
                 );
-                sp.r16 = res;
-                dots += 16;
-                pc.r16 += 2;
+                gb->sp.r16 = res;
+                gb->dots += 16;
+                gb->pc.r16 += 2;
                 return;
             }
             case 0xF8: { // ld hl, sp + imm8
-                uint8_t imm8 = read_mem(pc.r16 + 1);
+                uint8_t imm8 = read_mem(gb, gb->pc.r16 + 1);
                 uint16_t offset = (uint16_t)(int16_t)(int8_t)imm8;
-                uint16_t res = sp.r16 + offset;
-                update_flags(
+                uint16_t res = gb->sp.r16 + offset;
+                update_flags(gb,
                     SET_0,
                     SET_0,
-                    ((res ^ sp.r16 ^ offset) & 0x10) != 0,
-                    ((res ^ sp.r16 ^ offset) & 0x100) != 0
+                    ((res ^ gb->sp.r16 ^ offset) & 0x10) != 0,
+                    ((res ^ gb->sp.r16 ^ offset) & 0x100) != 0
                 );
-                hl.r16 = res;
-                dots += 12;
-                pc.r16 += 2;
+                gb->hl.r16 = res;
+                gb->dots += 12;
+                gb->pc.r16 += 2;
                 return;
             }
             case 0xF9: // ld sp, hl
-                sp.r16 = hl.r16;
-                dots += 8;
-                pc.r16++;
+                gb->sp.r16 = gb->hl.r16;
+                gb->dots += 8;
+                gb->pc.r16++;
                 return;
             case 0xF3: // di
-                ime = false;
-                dots += 4;
-                pc.r16++;
+                gb->ime = false;
+                gb->dots += 4;
+                gb->pc.r16++;
                 return;
             case 0xFB: // ei
-                set_ime = true;
-                dots += 4;
-                pc.r16++;
+                gb->set_ime = true;
+                gb->dots += 4;
+                gb->pc.r16++;
                 return;
             case 0xCB: { // prefix
-            uint8_t inst2 = read_mem(pc.r16 + 1);
+            uint8_t inst2 = read_mem(gb, gb->pc.r16 + 1);
             switch (inst2 & 0xC0) {
             case 0x00: {
                 switch (inst2 & 0x38) {
                     case 0x0: { // rlc r8
                         uint8_t idx = inst2 & 0x7;
-                        uint8_t r8 = read_r8(idx);
+                        uint8_t r8 = read_r8(gb, idx);
                         uint8_t left_set = r8 >> 7;
                         uint8_t res = (r8 << 1) | left_set;
-                        update_flags(res == 0, SET_0, SET_0, left_set);
-                        write_r8(idx, res);
+                        update_flags(gb, res == 0, SET_0, SET_0, left_set);
+                        write_r8(gb, idx, res);
                         if (idx == 6) {
-                            dots += 16;
+                            gb->dots += 16;
                         } else {
-                            dots += 8;
+                            gb->dots += 8;
                         }  
-                        pc.r16 += 2;
+                        gb->pc.r16 += 2;
                         return;
                     }
                     case 0x8: { // rrc r8
                         uint8_t idx = inst2 & 0x7;
-                        uint8_t r8 = read_r8(idx);
+                        uint8_t r8 = read_r8(gb, idx);
                         uint8_t right_set = r8 & 1;
                         uint8_t res = (r8 >> 1) | (right_set << 7);
-                        update_flags(res == 0, SET_0, SET_0, right_set);
-                        write_r8(idx, res);
+                        update_flags(gb, res == 0, SET_0, SET_0, right_set);
+                        write_r8(gb, idx, res);
                         if (idx == 6) {
-                            dots += 16;
+                            gb->dots += 16;
                         } else {
-                            dots += 8;
+                            gb->dots += 8;
                         }  
-                        pc.r16 += 2;
+                        gb->pc.r16 += 2;
                         return;
                     }
                     case 0x10: { // rl r8
                         uint8_t idx = inst2 & 0x7;
-                        uint8_t r8 = read_r8(idx);
-                        uint8_t carry = get_c_flag();
+                        uint8_t r8 = read_r8(gb, idx);
+                        uint8_t carry = get_c_flag(gb);
                         uint8_t left_set = r8 >> 7;
                         uint8_t res = (r8 << 1) | carry;
-                        update_flags(res == 0, SET_0, SET_0, left_set);
-                        write_r8(idx, res);
+                        update_flags(gb, res == 0, SET_0, SET_0, left_set);
+                        write_r8(gb, idx, res);
                         if (idx == 6) {
-                            dots += 16;
+                            gb->dots += 16;
                         } else {
-                            dots += 8;
+                            gb->dots += 8;
                         }  
-                        pc.r16 += 2;
+                        gb->pc.r16 += 2;
                         return;
                     }
                     case 0x18: { // rr r8
                         uint8_t idx = inst2 & 0x7;
-                        uint8_t r8 = read_r8(idx);
-                        uint8_t carry = get_c_flag();
+                        uint8_t r8 = read_r8(gb, idx);
+                        uint8_t carry = get_c_flag(gb);
                         uint8_t right_set = r8 & 1;
                         uint8_t res = (r8 >> 1) | (carry << 7);
-                        update_flags(res == 0, SET_0, SET_0, right_set);
-                        write_r8(idx, res);
+                        update_flags(gb, res == 0, SET_0, SET_0, right_set);
+                        write_r8(gb, idx, res);
                         if (idx == 6) {
-                            dots += 16;
+                            gb->dots += 16;
                         } else {
-                            dots += 8;
+                            gb->dots += 8;
                         }  
-                        pc.r16 += 2;
+                        gb->pc.r16 += 2;
                         return;
                     }
                     case 0x20: { // sla r8
                         uint8_t idx = inst2 & 0x7;
-                        uint8_t r8 = read_r8(idx);
+                        uint8_t r8 = read_r8(gb, idx);
                         uint8_t left_set = r8 >> 7;
                         uint8_t res = r8 << 1;
-                        update_flags(res == 0, SET_0, SET_0, left_set);
-                        write_r8(idx, res);
+                        update_flags(gb, res == 0, SET_0, SET_0, left_set);
+                        write_r8(gb, idx, res);
                         if (idx == 6) {
-                            dots += 16;
+                            gb->dots += 16;
                         } else {
-                            dots += 8;
+                            gb->dots += 8;
                         }  
-                        pc.r16 += 2;
+                        gb->pc.r16 += 2;
                         return;
                     }
                     case 0x28: { // sra r8
                         uint8_t idx = inst2 & 0x7;
-                        uint8_t r8 = read_r8(idx);
+                        uint8_t r8 = read_r8(gb, idx);
                         uint8_t right_set = r8 & 1;
                         uint8_t res = (uint8_t)(((int8_t)r8) >> 1);
-                        update_flags(res == 0, SET_0, SET_0, right_set);
-                        write_r8(idx, res);
+                        update_flags(gb, res == 0, SET_0, SET_0, right_set);
+                        write_r8(gb, idx, res);
                         if (idx == 6) {
-                            dots += 16;
+                            gb->dots += 16;
                         } else {
-                            dots += 8;
+                            gb->dots += 8;
                         }  
-                        pc.r16 += 2;
+                        gb->pc.r16 += 2;
                         return;
                     }
                     case 0x30: { // swap r8
                         uint8_t idx = inst2 & 0x7;
-                        uint8_t r8 = read_r8(idx);
+                        uint8_t r8 = read_r8(gb, idx);
                         uint8_t up = r8 & 0xF0;
                         uint8_t lo = r8 & 0x0F;
                         uint8_t res = (up >> 4) | (lo << 4);
-                        update_flags(res == 0, SET_0, SET_0, SET_0);
-                        write_r8(idx, res);
+                        update_flags(gb, res == 0, SET_0, SET_0, SET_0);
+                        write_r8(gb, idx, res);
                         if (idx == 6) {
-                            dots += 16;
+                            gb->dots += 16;
                         } else {
-                            dots += 8;
+                            gb->dots += 8;
                         }  
-                        pc.r16 += 2;
+                        gb->pc.r16 += 2;
                         return;
                     }
                     case 0x38: { // srl r8
                         uint8_t idx = inst2 & 0x7;
-                        uint8_t r8 = read_r8(idx);
+                        uint8_t r8 = read_r8(gb, idx);
                         uint8_t right_set = r8 & 1;
                         uint8_t res = r8 >> 1;
-                        update_flags(res == 0, SET_0, SET_0, right_set);
-                        write_r8(idx, res);
+                        update_flags(gb, res == 0, SET_0, SET_0, right_set);
+                        write_r8(gb, idx, res);
                         if (idx == 6) {
-                            dots += 16;
+                            gb->dots += 16;
                         } else {
-                            dots += 8;
+                            gb->dots += 8;
                         }  
-                        pc.r16 += 2;
+                        gb->pc.r16 += 2;
                         return;
                     }
                 }
@@ -1108,44 +1981,45 @@ void execute(void) {
             case 0x40: { // bit b3, r8
                 uint8_t idx = inst2 & 0x7;
                 uint8_t bit_idx = (inst2 >> 3) & 0x7;
-                uint8_t r8 = read_r8(idx);
-                update_flags(((r8 >> bit_idx) & 1) == 0, SET_0, SET_1, LEAVE);
+                uint8_t r8 = read_r8(gb, idx);
+                update_flags(gb, ((r8 >> bit_idx) & 1) == 0, SET_0, SET_1,
+                             LEAVE);
                 if (idx == 6) {
-                    dots += 12;
+                    gb->dots += 12;
                 } else {
-                    dots += 8;
+                    gb->dots += 8;
                 }  
-                pc.r16 += 2;
+                gb->pc.r16 += 2;
                 return;
             }
             case 0x80: { // res b3, r8
                 uint8_t idx = inst2 & 0x7;
                 uint8_t bit_idx = (inst2 >> 3) & 0x7;
-                uint8_t r8 = read_r8(idx);
+                uint8_t r8 = read_r8(gb, idx);
                 uint8_t mask = 1 << bit_idx;
                 uint8_t res = r8 & ~(mask);
-                write_r8(idx, res);
+                write_r8(gb, idx, res);
                 if (idx == 6) {
-                    dots += 16;
+                    gb->dots += 16;
                 } else {
-                    dots += 8;
+                    gb->dots += 8;
                 }  
-                pc.r16 += 2;
+                gb->pc.r16 += 2;
                 return;
             }
             case 0xC0: { // set b3, r8
                 uint8_t idx = inst2 & 0x7;
                 uint8_t bit_idx = (inst2 >> 3) & 0x7;
-                uint8_t r8 = read_r8(idx);
+                uint8_t r8 = read_r8(gb, idx);
                 uint8_t mask = 1 << bit_idx;
                 uint8_t res = r8 | mask;
-                write_r8(idx, res);
+                write_r8(gb, idx, res);
                 if (idx == 6) {
-                    dots += 16;
+                    gb->dots += 16;
                 } else {
-                    dots += 8;
+                    gb->dots += 8;
                 }  
-                pc.r16 += 2;
+                gb->pc.r16 += 2;
                 return;
             }
             }
@@ -1155,56 +2029,74 @@ void execute(void) {
     }
     }
 
-    fprintf(stderr, "Invalid opcode 0x%X, exiting...\n", inst);
-    exit(1);
+    fprintf(stderr, "Invalid opcode 0x%X, stopping...\n", inst);
+    stop_on_error(gb);
+#endif // GBEMU_LEGACY_DECODER
 }
 
-void update_timer_regs(void) {
-    // Update DIV register (16384Hz)
-    while (dots - last_div_incr_time >= div_incr_interval) {
-        r_div++;
-        last_div_incr_time += div_incr_interval;
-    }
-    // Update TIMA
-    switch (r_tac & 0x3) {
+uint64_t get_tima_incr_interval(gb_t *gb) {
+    switch (gb->r_tac & 0x3) {
         case 0: // 4096Hz
-            while (dots - last_tima_incr_time >= tima_00_incr_interval) {
-                if ((r_tac & 0x4) && (++r_tima == 0)) { // overflow
-                    r_tima = r_tma;
-                    r_if |= 0x4; // request timer interrupt
-                }
-                last_tima_incr_time += tima_00_incr_interval;
-            }
-            break;
+            return tima_00_incr_interval;
         case 1: // 262144Hz
-            while (dots - last_tima_incr_time >= tima_01_incr_interval) {
-                if ((r_tac & 0x4) && (++r_tima == 0)) { // overflow
-                    r_tima = r_tma;
-                    r_if |= 0x4; // request timer interrupt
-                }
-                last_tima_incr_time += tima_01_incr_interval;
-            }
-            break;
+            return tima_01_incr_interval;
         case 2: // 65536Hz
-            while (dots - last_tima_incr_time >= tima_10_incr_interval) {
-                if ((r_tac & 0x4) && (++r_tima == 0)) { // overflow
-                    r_tima = r_tma;
-                    r_if |= 0x4; // request timer interrupt
-                }
-                last_tima_incr_time += tima_10_incr_interval;
-            }
-            break;
+            return tima_10_incr_interval;
         case 3: // 16384Hz
-            while (dots - last_tima_incr_time >= tima_11_incr_interval) {
-                if ((r_tac & 0x4) && (++r_tima == 0)) { // overflow
-                    r_tima = r_tma;
-                    r_if |= 0x4; // request timer interrupt
-                }
-                last_tima_incr_time += tima_11_incr_interval;
-            }
-            break;
-        default:
-            fprintf(stderr, "Invalid TAC clock setting, exiting...\n");
-            exit(1);
+            return tima_11_incr_interval;
+    }
+    fprintf(stderr, "Invalid TAC clock setting, exiting...\n");
+    exit(1);
+}
+
+// Schedules the first DIV increment and TIMA overflow
+void init_timer(gb_t *gb) {
+    schedule_event(gb, EVENT_DIV, gb->last_div_incr_time + div_incr_interval);
+    schedule_tima_event(gb);
+}
+
+// Update DIV register (16384Hz)
+void div_event(gb_t *gb) {
+    gb->r_div++;
+    gb->last_div_incr_time += div_incr_interval;
+    schedule_event(gb, EVENT_DIV, gb->last_div_incr_time + div_incr_interval);
+}
+
+// TIMA is only brought up to date when it is accessed or overflows
+void sync_timer(gb_t *gb) {
+    uint64_t interval = get_tima_incr_interval(gb);
+    uint64_t incrs = (gb->dots - gb->last_tima_incr_time) / interval;
+    gb->last_tima_incr_time += incrs * interval;
+    if (!(gb->r_tac & 0x4)) {
+        return;
     }
-}
\ No newline at end of file
+    while (incrs > 0) {
+        uint64_t incrs_to_overflow = 0x100 - gb->r_tima;
+        if (incrs < incrs_to_overflow) {
+            gb->r_tima += incrs;
+            return;
+        }
+        incrs -= incrs_to_overflow;
+        gb->r_tima = gb->r_tma;
+        gb->r_if |= 0x4; // request timer interrupt
+    }
+}
+
+// Must be called after sync_timer() whenever TIMA or TAC change
+void schedule_tima_event(gb_t *gb) {
+    if (!(gb->r_tac & 0x4)) {
+        cancel_event(gb, EVENT_TIMA);
+        return;
+    }
+    uint64_t incrs_to_overflow = 0x100 - gb->r_tima;
+    schedule_event(gb,
+        EVENT_TIMA,
+        gb->last_tima_incr_time +
+            (incrs_to_overflow * get_tima_incr_interval(gb))
+    );
+}
+
+void tima_event(gb_t *gb) {
+    sync_timer(gb);
+    schedule_tima_event(gb);
+}
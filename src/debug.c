@@ -205,55 +205,52 @@ void free_debug(void) {
     }
 }
 
-void draw_tile(Uint32 *fb, size_t idx, size_t x, size_t y, size_t width) {
+void draw_tile(gb_t *gb, Uint32 *fb, size_t idx, size_t x, size_t y,
+               size_t width) {
     for (size_t yy = 0; yy < 8; yy++) {
         for (size_t xx = 0; xx < 8; xx++) {
-            size_t idx_offset = yy * 2;
-            size_t shift_offset = 7 - xx;
-            uint8_t lsb = (vram_tiles[idx][idx_offset] >> shift_offset) & 1;
-            uint8_t msb = (vram_tiles[idx][idx_offset + 1] >> shift_offset) & 1;
-            uint8_t pixel_color_index = (msb << 1) | lsb;
+            uint8_t pixel_color_index = gb->decoded_tiles[idx][yy][xx];
             Uint32 color;
             if (use_fixed_palette) {
                 color = palette[pixel_color_index];
             } else {
-                color = palette[(r_bgp >> (pixel_color_index * 2)) & 0x3];
+                color = palette[(gb->r_bgp >> (pixel_color_index * 2)) & 0x3];
             }
             fb[(8 * x) + xx + ((width * 8) * ((8 * y) + yy))] = color;
         }
     }
 }
 
-void draw_tile_map1(void) {
+void draw_tile_map1(gb_t *gb) {
     for (size_t y = 0; y < 32; y++) {
         for (size_t x = 0; x < 32; x++) {
-            size_t tile_idx = vram_maps[0][x + (32 * y)];
-            draw_tile(tile_map1_fb, tile_idx, x, y, 32);
+            size_t tile_idx = gb->vram_maps[0][x + (32 * y)];
+            draw_tile(gb, tile_map1_fb, tile_idx, x, y, 32);
         }
     }
 }
 
-void draw_tile_map2(void) {
+void draw_tile_map2(gb_t *gb) {
     for (size_t y = 0; y < 32; y++) {
         for (size_t x = 0; x < 32; x++) {
-            size_t tile_idx = vram_maps[1][x + (32 * y)];
-            draw_tile(tile_map2_fb, tile_idx, x, y, 32);
+            size_t tile_idx = gb->vram_maps[1][x + (32 * y)];
+            draw_tile(gb, tile_map2_fb, tile_idx, x, y, 32);
         }
     }
 }
 
-void draw_tile_data(void) {
+void draw_tile_data(gb_t *gb) {
     for (size_t y = 0; y < 24; y++) {
         for (size_t x = 0; x < 16; x++) {
-            draw_tile(tile_data_fb, x + (16 * y), x, y, 16);
+            draw_tile(gb, tile_data_fb, x + (16 * y), x, y, 16);
         }
     }
 }
 
-void update_debug(void) {
-    draw_tile_map1();
-    draw_tile_map2();
-    draw_tile_data();
+void update_debug(gb_t *gb) {
+    draw_tile_map1(gb);
+    draw_tile_map2(gb);
+    draw_tile_data(gb);
     SDL_UnlockTexture(tile_map1_texture);
     SDL_UnlockTexture(tile_map2_texture);
     SDL_UnlockTexture(tile_data_texture);
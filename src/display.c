@@ -1,20 +1,23 @@
 #include <display.h>
 #include <mem.h>
 #include <cpu.h>
+#include <scheduler.h>
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_main.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 SDL_Window *window = NULL;
 SDL_Renderer *renderer = NULL;
 SDL_Texture *texture = NULL;
-Uint32 *framebuffer = NULL;
 static const Uint32 palette[4] = 
     {0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555, 0xFF000000};
-size_t last_mode = 2;
-size_t last_pixel = 0;
-bool req_stat_int_already = false;
 
 void init_display(void) {
     if (!SDL_Init(SDL_INIT_VIDEO)) {
@@ -50,18 +53,9 @@ void init_display(void) {
         fprintf(stderr, "SDL init failed: %s\n", SDL_GetError());
         exit(1);
     }
-    void* pixels;
-    int pitch;
-    if (!SDL_LockTexture(texture, NULL, &pixels, &pitch)) {
-        fprintf(stderr, "SDL lock failed: %s\n", SDL_GetError());
-        exit(1);
-    }
-    memset(pixels, 0, DISP_WIDTH * DISP_HEIGHT * sizeof(Uint32));
-    framebuffer = pixels;
 }
 
 void free_display(void) {
-    framebuffer = NULL;
     SDL_DestroyTexture(texture);
     texture = NULL;
     SDL_DestroyRenderer(renderer);
@@ -71,128 +65,398 @@ void free_display(void) {
     SDL_Quit();
 }
 
-// TODO: Incorporate window and OAM draws, as well as disabling these draws
-// TODO: with LCDC.
-void draw_pixels_until(size_t until) {
+// Maps a background tile number to its index in decoded_tiles, following the
+// addressing mode selected by LCDC
+static inline size_t bg_tile_data_index(gb_t *gb, uint8_t tile_index) {
+    if (gb->r_lcdc & LCDC_BG_WIN_TILE_DATA_AREA) {
+        return tile_index;
+    }
+    return 256 + (int8_t)tile_index;
+}
+
+// Picks the first LINE_OBJ_MAX objects in OAM that cover the current line,
+// as the OAM scan in mode 2 does, and sorts them into drawing priority. Off
+// screen X positions still count towards the limit.
+static void scan_oam(gb_t *gb) {
+    size_t height = gb->r_lcdc & LCDC_OBJ_SIZE ? 16 : 8;
+    size_t line = (size_t)gb->r_ly + 16;
+    uint8_t num = 0;
+    for (uint8_t i = 0; i < OBJ_NUM && num < LINE_OBJ_MAX; i++) {
+        uint8_t y = gb->oam[i][0];
+        if (line < y || line >= (size_t)y + height) {
+            continue;
+        }
+        // Insert after any object at the same X, which comes first in OAM
+        uint8_t x = gb->oam[i][1];
+        size_t j = num++;
+        while (j > 0 && gb->oam[gb->line_objs[j - 1]][1] > x) {
+            gb->line_objs[j] = gb->line_objs[j - 1];
+            j--;
+        }
+        gb->line_objs[j] = i;
+    }
+    gb->line_obj_num = num;
+}
+
+// Returns the color index of an object at one of its columns, 0-7 from the
+// left, on the current line, or 0 if it no longer covers the line
+static inline uint8_t obj_color_index(gb_t *gb, const uint8_t *o, size_t col) {
+    size_t height = gb->r_lcdc & LCDC_OBJ_SIZE ? 16 : 8;
+    size_t row = (size_t)gb->r_ly + 16 - o[0];
+    if (row >= height) {
+        return 0;
+    }
+    if (o[3] & OBJ_Y_FLIP) {
+        row = height - 1 - row;
+    }
+    if (o[3] & OBJ_X_FLIP) {
+        col = 7 - col;
+    }
+    // Tall objects ignore bit 0 of the tile number
+    size_t tile_index = height == 16 ? (o[2] & 0xFE) + (row / 8) : o[2];
+    return gb->decoded_tiles[tile_index][row % 8][col];
+}
+
+// Packs an opaque object pixel as its color index plus the attribute bits
+// that decide its palette and whether the background covers it
+static inline uint8_t obj_pixel(const uint8_t *o, uint8_t color_index) {
+    return color_index | (o[3] & (OBJ_BG_PRIORITY | OBJ_PALETTE));
+}
+
+// Returns the object pixel at screen column x, from the objects the OAM scan
+// picked for the line, or 0 if none is opaque there. The first opaque
+// object wins, even if the background then covers it.
+static uint8_t find_obj_pixel(gb_t *gb, size_t x) {
+    for (size_t i = 0; i < gb->line_obj_num; i++) {
+        const uint8_t *o = gb->oam[gb->line_objs[i]];
+        size_t col = x + 8 - o[1];
+        if (col >= 8) {
+            continue;
+        }
+        uint8_t color_index = obj_color_index(gb, o, col);
+        if (color_index) {
+            return obj_pixel(o, color_index);
+        }
+    }
+    return 0;
+}
+
+// Returns true if an object pixel shows over a background color index
+static inline bool obj_pixel_shown(uint8_t pixel, uint8_t bg_color_index) {
+    return pixel && !((pixel & OBJ_BG_PRIORITY) && bg_color_index);
+}
+
+static inline Uint32 obj_pixel_color(gb_t *gb, uint8_t pixel) {
+    uint8_t obp = pixel & OBJ_PALETTE ? gb->r_obp1 : gb->r_obp0;
+    return palette[(obp >> ((pixel & 0x3) * 2)) & 0x3];
+}
+
+// TODO: Incorporate window draws, as well as disabling the background with
+// TODO: LCDC.
+void draw_pixels_until(gb_t *gb, size_t until) {
     // Get y pos of tile and the tile map of the tile
-    uint8_t tile_y = ((r_ly + r_scy) % 256) / 8;
-    uint16_t tile_map = r_lcdc & LCDC_BG_TILE_MAP_AREA ? 1 : 0;
+    uint8_t tile_y = ((gb->r_ly + gb->r_scy) % 256) / 8;
+    uint16_t tile_map = gb->r_lcdc & LCDC_BG_TILE_MAP_AREA ? 1 : 0;
 
-    for (; last_pixel < until; last_pixel++) {
+    for (; gb->last_pixel < until; gb->last_pixel++) {
         // Get x pos and index of the tile
-        uint8_t tile_x = ((last_pixel + r_scx) % 256) / 8;
-        uint8_t tile_index = vram_maps[tile_map][(32 * tile_y) + tile_x];
+        uint8_t tile_x = ((gb->last_pixel + gb->r_scx) % 256) / 8;
+        uint8_t tile_index = gb->vram_maps[tile_map][(32 * tile_y) + tile_x];
 
         // Get the exact pixel
-        uint8_t pixel_x = (last_pixel + r_scx) % 8;
-        uint8_t pixel_y = (r_ly + r_scy) % 8;
+        uint8_t pixel_x = (gb->last_pixel + gb->r_scx) % 8;
+        uint8_t pixel_y = (gb->r_ly + gb->r_scy) % 8;
 
         // Get the color index of the pixel
-        size_t idx_offset = pixel_y * 2;
-        size_t shift_offset = 7 - pixel_x;
-        uint8_t lsb, msb;
-        if (r_lcdc & LCDC_BG_WIN_TILE_DATA_AREA) {
-            lsb = (vram_tiles[tile_index][idx_offset] >> shift_offset) & 1;
-            msb = (vram_tiles[tile_index][idx_offset + 1] >> shift_offset) & 1;
-        } else {
-            size_t new_index = 256 + (int8_t)tile_index;
-            lsb = (vram_tiles[new_index][idx_offset] >> shift_offset) & 1;
-            msb = (vram_tiles[new_index][idx_offset + 1] >> shift_offset) & 1;
+        size_t data_index = bg_tile_data_index(gb, tile_index);
+        uint8_t pixel_color_index =
+            gb->decoded_tiles[data_index][pixel_y][pixel_x];
+
+        // Get the color of the pixel, or of the object over it, and draw it
+        Uint32 color = palette[(gb->r_bgp >> (pixel_color_index * 2)) & 0x3];
+        if (gb->r_lcdc & LCDC_OBJ_ENABLED) {
+            uint8_t object = find_obj_pixel(gb, gb->last_pixel);
+            if (obj_pixel_shown(object, pixel_color_index)) {
+                color = obj_pixel_color(gb, object);
+            }
+        }
+        gb->framebuffer[(160 * gb->r_ly) + gb->last_pixel] = color;
+    }
+}
+
+// Writes the colors for a row of color indices to out. count must be a
+// multiple of 16.
+static void apply_palette(Uint32 *out, const uint8_t *indices, size_t count,
+                          const Uint32 colors[4]) {
+#if defined(__AVX2__)
+    // Look up eight pixels at once with a lane permute
+    __m256i lut = _mm256_setr_epi32(
+        (int)colors[0], (int)colors[1], (int)colors[2], (int)colors[3],
+        (int)colors[0], (int)colors[1], (int)colors[2], (int)colors[3]
+    );
+    for (size_t i = 0; i < count; i += 8) {
+        __m128i bytes = _mm_loadl_epi64((const __m128i *)(indices + i));
+        __m256i idx = _mm256_cvtepu8_epi32(bytes);
+        _mm256_storeu_si256((__m256i *)(out + i),
+                            _mm256_permutevar8x32_epi32(lut, idx));
+    }
+#elif defined(__SSE2__)
+    // Widen sixteen indices to 32 bits and select each color by comparison
+    __m128i zero = _mm_setzero_si128();
+    __m128i one = _mm_set1_epi32(1);
+    __m128i two = _mm_set1_epi32(2);
+    __m128i three = _mm_set1_epi32(3);
+    __m128i c0 = _mm_set1_epi32((int)colors[0]);
+    __m128i c1 = _mm_set1_epi32((int)colors[1]);
+    __m128i c2 = _mm_set1_epi32((int)colors[2]);
+    __m128i c3 = _mm_set1_epi32((int)colors[3]);
+    for (size_t i = 0; i < count; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(indices + i));
+        __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+        __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+        __m128i idx[4] = {
+            _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+            _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)
+        };
+        for (size_t j = 0; j < 4; j++) {
+            __m128i px = _mm_and_si128(_mm_cmpeq_epi32(idx[j], zero), c0);
+            px = _mm_or_si128(px,
+                              _mm_and_si128(_mm_cmpeq_epi32(idx[j], one), c1));
+            px = _mm_or_si128(px,
+                              _mm_and_si128(_mm_cmpeq_epi32(idx[j], two), c2));
+            px = _mm_or_si128(px,
+                              _mm_and_si128(_mm_cmpeq_epi32(idx[j], three),
+                                            c3));
+            _mm_storeu_si128((__m128i *)(out + i + (4 * j)), px);
+        }
+    }
+#else
+    for (size_t i = 0; i < count; i++) {
+        out[i] = colors[indices[i]];
+    }
+#endif
+}
+
+// Draws the objects the OAM scan picked over a line already drawn, given the
+// background color indices of the line. Objects are laid out in priority
+// order first, each only filling columns no opaque object has taken.
+static void draw_objs(gb_t *gb, const uint8_t *bg_line) {
+    // Columns are offset by 8, since objects start 8 pixels left of X
+    uint8_t objs[DISP_WIDTH + 16] = {0};
+    for (size_t i = 0; i < gb->line_obj_num; i++) {
+        const uint8_t *o = gb->oam[gb->line_objs[i]];
+        if (o[1] == 0 || o[1] >= DISP_WIDTH + 8) {
+            continue;
+        }
+        for (size_t col = 0; col < 8; col++) {
+            uint8_t *pixel = &objs[o[1] + col];
+            if (*pixel) {
+                continue;
+            }
+            uint8_t color_index = obj_color_index(gb, o, col);
+            if (color_index) {
+                *pixel = obj_pixel(o, color_index);
+            }
         }
-        uint8_t pixel_color_index = (msb << 1) | lsb;
+    }
 
-        // Get the color of the pixel and draw it
-        Uint32 color = palette[(r_bgp >> (pixel_color_index * 2)) & 0x3];
-        framebuffer[(160 * r_ly) + last_pixel] = color;
+    Uint32 *out = &gb->framebuffer[DISP_WIDTH * gb->r_ly];
+    for (size_t x = 0; x < DISP_WIDTH; x++) {
+        if (obj_pixel_shown(objs[x + 8], bg_line[x])) {
+            out[x] = obj_pixel_color(gb, objs[x + 8]);
+        }
     }
 }
 
-// Returns true if this call updates the renderer. This functionality is used
-// to set a framerate by knowing when a frame was drawn
-bool update_display(double frame_start) {
-    if (!(r_lcdc & LCDC_LCD_PPU_ENABLED)) {
+// Draws the whole background of the current line in one pass, then the
+// objects on it. Used at the start of HBlank unless accurate_ppu is set, so
+// the line is drawn with the register values current at that point and a
+// write during mode 3 changes the whole line. Mid-line changes need -a.
+static void draw_scanline(gb_t *gb) {
+    uint8_t y = gb->r_ly + gb->r_scy;
+    uint16_t tile_map = gb->r_lcdc & LCDC_BG_TILE_MAP_AREA ? 1 : 0;
+    const uint8_t *map_row = &gb->vram_maps[tile_map][32 * (y / 8)];
+
+    // Copy whole tile rows, one extra tile to cover the fine X scroll
+    uint8_t line[DISP_WIDTH + 16];
+    size_t first_tile = gb->r_scx / 8;
+    for (size_t i = 0; i <= DISP_WIDTH / 8; i++) {
+        uint8_t tile_index = map_row[(first_tile + i) % 32];
+        size_t data_index = bg_tile_data_index(gb, tile_index);
+        memcpy(&line[8 * i], gb->decoded_tiles[data_index][y % 8], 8);
+    }
+
+    Uint32 colors[4];
+    for (size_t i = 0; i < 4; i++) {
+        colors[i] = palette[(gb->r_bgp >> (i * 2)) & 0x3];
+    }
+    apply_palette(&gb->framebuffer[DISP_WIDTH * gb->r_ly], &line[gb->r_scx % 8],
+                  DISP_WIDTH, colors);
+
+    if ((gb->r_lcdc & LCDC_OBJ_ENABLED) && gb->line_obj_num) {
+        draw_objs(gb, &line[gb->r_scx % 8]);
+    }
+}
+
+// Brings the PPU state up to the current dot. Returns true if this call
+// enters VBlank, i.e. a frame has been completed.
+bool update_display(gb_t *gb) {
+    if (!(gb->r_lcdc & LCDC_LCD_PPU_ENABLED)) {
         // TODO: Clear display
         return false;
     }
 
-    size_t frame_dots = dots % 70224;
+    size_t frame_dots = gb->dots % DOTS_PER_FRAME;
     size_t scanline_dots = frame_dots % 456;
-    r_ly = frame_dots / 456;
+    gb->r_ly = frame_dots / 456;
 
     // Mode 1 (Vertical Blank)
-    if (144 <= r_ly && r_ly <= 153) {
-        if (last_mode != 1) {
-            last_mode = 1;
-            r_if |= 1; // Send VBlank Interrupt
-            // Draw to the renderer
-            SDL_UnlockTexture(texture);
-            SDL_RenderTexture(renderer, texture, NULL, NULL);
-            SDL_RenderPresent(renderer);
-            void* pixels;
-            int pitch;
-            if (!SDL_LockTexture(texture, NULL, &pixels, &pitch)) {
-                fprintf(stderr, "SDL lock failed: %s\n", SDL_GetError());
-                exit(1);
-            }
-            memset(pixels, 0, DISP_WIDTH * DISP_HEIGHT * sizeof(Uint32));
-            framebuffer = pixels;
-            // Delay to set frame rate at 59.7 fps
-            double fps = 59.7;
-            double frame_duration_ns = 1000000000.0 / fps;
-            double frame_end = (double)SDL_GetPerformanceCounter();
-            double frame_length = frame_end - frame_start;
-            if (frame_length < frame_duration_ns) {
-                SDL_DelayNS((Uint64)(frame_duration_ns - frame_length));
-            }
+    if (144 <= gb->r_ly && gb->r_ly <= 153) {
+        if (gb->last_mode != 1) {
+            gb->last_mode = 1;
+            gb->r_if |= 1; // Send VBlank Interrupt
             return true;
         }
         return false;
     }
 
     // Mode 2 (OAM scan)
-    if (last_mode != 2 && scanline_dots < 80) {
-        last_mode = 2;
-        // TODO: Do the OAM scan
+    if (gb->last_mode != 2 && scanline_dots < 80) {
+        gb->last_mode = 2;
+        if (!gb->skip_draw) {
+            scan_oam(gb);
+        }
         return false;
     }
 
     // Mode 3 (Drawing pixels)
     if (80 <= scanline_dots && scanline_dots < 252) {
-        last_mode = 3;
+        gb->last_mode = 3;
         // Tile fetch (ignore)
-        if (scanline_dots < 92) {
+        if (!gb->accurate_ppu || gb->skip_draw || scanline_dots < 92) {
             return false;
         }
-        draw_pixels_until(scanline_dots - 91);
+        draw_pixels_until(gb, scanline_dots - 91);
         return false;
     }
 
     // Mode 0 (Horizontal Blank)
-    if (last_mode != 0 && 252 <= scanline_dots && scanline_dots < 456) {
-        last_mode = 0;
-        draw_pixels_until(160);
-        last_pixel = 0;
+    if (gb->last_mode != 0 && 252 <= scanline_dots && scanline_dots < 456) {
+        gb->last_mode = 0;
+        if (gb->skip_draw) {
+            gb->last_pixel = 0;
+        } else if (gb->accurate_ppu) {
+            draw_pixels_until(gb, 160);
+            gb->last_pixel = 0;
+        } else {
+            draw_scanline(gb);
+        }
         return false;
     }
     return false;
 }
 
-void update_stat_reg(void) {
+// Hands the frame just drawn to the presenter and moves the core on to the
+// buffer that is neither shown nor waiting to be. Called by the thread that
+// runs the instance.
+void publish_frame(gb_t *gb) {
+    uint8_t middle = __atomic_exchange_n(&gb->frame_middle,
+                                         gb->frame_back | FRAME_FRESH,
+                                         __ATOMIC_ACQ_REL);
+    gb->frame_back = middle & ~FRAME_FRESH;
+    gb->framebuffer = gb->framebuffers[gb->frame_back];
+}
+
+// Returns true while the last published frame hasn't been taken by the
+// presenter, so drawing another one now would likely go unseen
+bool is_frame_pending(gb_t *gb) {
+    return __atomic_load_n(&gb->frame_middle, __ATOMIC_RELAXED) & FRAME_FRESH;
+}
+
+// Takes the newest published frame, or returns NULL if it has been taken
+// already. Called by the presenting thread.
+static const uint32_t *take_frame(gb_t *gb) {
+    uint8_t middle = __atomic_load_n(&gb->frame_middle, __ATOMIC_RELAXED);
+    if (!(middle & FRAME_FRESH)) {
+        return NULL;
+    }
+    middle = __atomic_exchange_n(&gb->frame_middle, gb->frame_front,
+                                 __ATOMIC_ACQ_REL);
+    gb->frame_front = middle & ~FRAME_FRESH;
+    return gb->framebuffers[gb->frame_front];
+}
+
+// Draws the newest frame published by an instance to the window, if it
+// hasn't been drawn yet. Must be called from the main thread.
+void present_display(gb_t *gb) {
+    const uint32_t *frame = take_frame(gb);
+    if (!frame) {
+        return;
+    }
+    if (!SDL_UpdateTexture(texture, NULL, frame,
+                           DISP_WIDTH * sizeof(Uint32))) {
+        fprintf(stderr, "SDL texture update failed: %s\n", SDL_GetError());
+        exit(1);
+    }
+    SDL_RenderTexture(renderer, texture, NULL, NULL);
+    SDL_RenderPresent(renderer);
+}
+
+// Catches the PPU up to the current dot. This is called from the PPU event and
+// before any write that affects rendering, so pixels already drawn this line
+// use the old register values.
+void sync_display(gb_t *gb) {
+    if (update_display(gb)) {
+        gb->frame_ready = true;
+    }
+    update_stat_reg(gb);
+}
+
+// Schedules the PPU event for the next mode transition or LY increment, or
+// cancels it while the LCD is off
+void schedule_ppu_event(gb_t *gb) {
+    if (!(gb->r_lcdc & LCDC_LCD_PPU_ENABLED)) {
+        cancel_event(gb, EVENT_PPU);
+        return;
+    }
+
+    size_t frame_dots = gb->dots % DOTS_PER_FRAME;
+    size_t scanline_dots = frame_dots % 456;
+    size_t next;
+    if (frame_dots >= 144 * 456) {
+        next = 456;
+    } else if (scanline_dots < 80) {
+        next = 80;
+    } else if (scanline_dots < 252) {
+        next = 252;
+    } else {
+        next = 456;
+    }
+    schedule_event(gb, EVENT_PPU, gb->dots + (next - scanline_dots));
+}
+
+void ppu_event(gb_t *gb) {
+    sync_display(gb);
+    schedule_ppu_event(gb);
+}
+
+void update_stat_reg(gb_t *gb) {
     // Set LYC == LY bit and PPU mode in STAT register
-    r_stat = (r_stat & 0xF8) | ((r_lyc == r_ly) << 2) | last_mode;
+    gb->r_stat = (gb->r_stat & 0xF8) | ((gb->r_lyc == gb->r_ly) << 2) |
+                 gb->last_mode;
 
     // Request STAT interrupt
-    bool lyc_ly = (r_stat & 0x40) && (r_lyc == r_ly);
-    bool mode_2 = (r_stat & 0x20) && (last_mode == 2);
-    bool mode_1 = (r_stat & 0x10) && (last_mode == 1);
-    bool mode_0 = (r_stat & 0x08) && (last_mode == 0);
+    bool lyc_ly = (gb->r_stat & 0x40) && (gb->r_lyc == gb->r_ly);
+    bool mode_2 = (gb->r_stat & 0x20) && (gb->last_mode == 2);
+    bool mode_1 = (gb->r_stat & 0x10) && (gb->last_mode == 1);
+    bool mode_0 = (gb->r_stat & 0x08) && (gb->last_mode == 0);
 
     if (lyc_ly || mode_2 || mode_1 || mode_0) {
-        if (!req_stat_int_already) {
-            r_if |= 2;
-            req_stat_int_already = true;
+        if (!gb->req_stat_int_already) {
+            gb->r_if |= 2;
+            gb->req_stat_int_already = true;
         }
     } else {
-        req_stat_int_already = false;
+        gb->req_stat_int_already = false;
     }
 }
\ No newline at end of file
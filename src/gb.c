@@ -0,0 +1,171 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gb.h>
+#include <cpu.h>
+#include <mem.h>
+#include <rom.h>
+#include <mbc.h>
+#include <sav.h>
+#include <display.h>
+#include <apu.h>
+#include <wav.h>
+#include <scheduler.h>
+
+// Sets the registers to the values the DMG boot ROM leaves behind
+static void skip_boot_rom(gb_t *gb) {
+    // Set CPU registers
+    gb->af.r16 = 0x1B0;
+    gb->bc.r16 = 0x13;
+    gb->de.r16 = 0xD8;
+    gb->hl.r16 = 0x14D;
+    gb->pc.r16 = 0x100;
+    gb->sp.r16 = 0xFFFE;
+
+    // Set Hardware registers
+    gb->b_buttons_select = true;
+    gb->b_dpad_select = true;
+    gb->r_sc = 0x7E;
+    gb->r_div = 0xAB;
+    gb->r_tac = 0xF8;
+    gb->r_if = 0xE1;
+    gb->r_nr10 = 0x80;
+    gb->r_nr11 = 0xBF;
+    gb->r_nr12 = 0xF3;
+    gb->r_nr13 = 0xFF;
+    gb->r_nr14 = 0xBF;
+    gb->r_nr21 = 0x3F;
+    gb->r_nr23 = 0xFF;
+    gb->r_nr24 = 0xBF;
+    gb->r_nr30 = 0x7F;
+    gb->r_nr31 = 0xFF;
+    gb->r_nr32 = 0x9F;
+    gb->r_nr33 = 0xFF;
+    gb->r_nr34 = 0xBF;
+    gb->r_nr41 = 0xFF;
+    gb->r_nr44 = 0xBF;
+    gb->r_nr50 = 0x77;
+    gb->r_nr51 = 0xF3;
+    gb->r_nr52 = 0xF1;
+    gb->r_lcdc = 0x91;
+    gb->r_stat = 0x85;
+    gb->r_dma = 0xFF;
+    gb->r_bgp = 0xFC;
+    gb->r_boot_rom_mapped = 1;
+}
+
+// Creates an instance with the given ROM loaded, ready to execute, or returns
+// NULL if the ROM can't be loaded. The instance is aligned to a cache line so
+// the hot fields at its start stay together.
+gb_t *init_gb(const char *rom_path, bool run_boot) {
+    void *mem;
+    if (posix_memalign(&mem, CACHE_LINE_SIZE, sizeof(gb_t)) != 0) {
+        fprintf(stderr, "Failed to allocate emulator state, exiting...\n");
+        exit(1);
+    }
+    gb_t *gb = mem;
+    memset(gb, 0, sizeof(gb_t));
+    gb->flags_op = FLAGS_NONE;
+    gb->next_event_time = UINT64_MAX;
+    gb->last_mode = 2;
+    gb->print_serial = true;
+    gb->framebuffer = gb->framebuffers[0];
+    gb->frame_back = 0;
+    gb->frame_front = 1;
+    gb->frame_middle = 2;
+
+    if (!run_boot) {
+        skip_boot_rom(gb);
+    }
+
+    if (!load_rom(gb, rom_path) || !init_mbc(gb, rom_path)) {
+        free_gb(gb);
+        return NULL;
+    }
+
+    init_mem(gb);
+
+    init_timer(gb);
+
+    init_apu(gb);
+
+    schedule_ppu_event(gb);
+
+    return gb;
+}
+
+void free_gb(gb_t *gb) {
+    close_sav(gb);
+    free_mbc(gb);
+    free_rom(gb);
+    free(gb);
+}
+
+// Stops the instance at the end of the current instruction, for programs that
+// do something the emulator doesn't support. The caller says what. Clearing
+// next_event_time gets run_frame() out of its instruction loop without a
+// check per instruction.
+void stop_on_error(gb_t *gb) {
+    gb->error = true;
+    gb->next_event_time = 0;
+}
+
+// Runs until the PPU completes a frame, or until dot_limit or a frame's worth
+// of dots pass, since no frame completes while the LCD is off. Returns true
+// if a frame was completed. A stopped instance doesn't run.
+bool run_frame(gb_t *gb, uint64_t dot_limit) {
+    uint64_t frame_limit = gb->dots + DOTS_PER_FRAME;
+    if (frame_limit > dot_limit) {
+        frame_limit = dot_limit;
+    }
+    gb->frame_ready = false;
+    while (!gb->frame_ready && gb->dots < frame_limit && !gb->error) {
+        while (gb->dots < gb->next_event_time) {
+            execute(gb);
+        }
+        run_events(gb);
+    }
+    return gb->frame_ready;
+}
+
+// Checks whether a run should end after the given number of frames
+run_result_t check_run_limits(gb_t *gb, const run_limits_t *limits,
+                              uint64_t frames) {
+    if (gb->error) {
+        return RUN_ERROR;
+    }
+    if (limits->fail_match && strstr(gb->serial_out, limits->fail_match)) {
+        return RUN_FAILED;
+    }
+    if (limits->pass_match && strstr(gb->serial_out, limits->pass_match)) {
+        return RUN_PASSED;
+    }
+    if (frames >= limits->max_frames || gb->dots >= limits->max_dots) {
+        return RUN_LIMIT_REACHED;
+    }
+    return RUN_RUNNING;
+}
+
+// Runs as fast as possible until one of the limits is hit, drawing one frame
+// in every frame_skip + 1, and writing the audio to gb->wav if set. The
+// number of completed frames is stored in frames.
+run_result_t run_headless(gb_t *gb, const run_limits_t *limits,
+                          uint64_t *frames) {
+    run_result_t result = RUN_RUNNING;
+    size_t skipped = 0;
+    *frames = 0;
+    while (result == RUN_RUNNING) {
+        gb->skip_draw = skipped < gb->frame_skip;
+        if (run_frame(gb, limits->max_dots)) {
+            (*frames)++;
+            skipped = gb->skip_draw ? skipped + 1 : 0;
+        }
+        if (gb->wav) {
+            capture_audio(gb->wav, gb);
+        }
+        result = check_run_limits(gb, limits, *frames);
+    }
+    return result;
+}
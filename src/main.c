@@ -1,20 +1,93 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <rom.h>
 #include <cpu.h>
 #include <mem.h>
 #include <util.h>
 #include <display.h>
 #include <debug.h>
+#include <scheduler.h>
+#include <batch.h>
+#include <sav.h>
+#include <state.h>
+#include <rewind.h>
+#include <runahead.h>
+#include <pacing.h>
+#include <audio.h>
+#include <wav.h>
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_main.h>
 
+// Instance whose state is dumped on a segfault
+static gb_t *active_gb = NULL;
+
+// Buttons as bits of emulator_t.buttons
+typedef enum {
+    BUTTON_A,
+    BUTTON_B,
+    BUTTON_START,
+    BUTTON_SELECT,
+    BUTTON_LEFT,
+    BUTTON_RIGHT,
+    BUTTON_UP,
+    BUTTON_DOWN,
+    BUTTON_NUM
+} button_t;
+
+static const SDL_Keycode button_keys[BUTTON_NUM] = {
+    [BUTTON_A] = SDLK_A,
+    [BUTTON_B] = SDLK_S,
+    [BUTTON_START] = SDLK_ESCAPE,
+    [BUTTON_SELECT] = SDLK_BACKSPACE,
+    [BUTTON_LEFT] = SDLK_LEFT,
+    [BUTTON_RIGHT] = SDLK_RIGHT,
+    [BUTTON_UP] = SDLK_UP,
+    [BUTTON_DOWN] = SDLK_DOWN,
+};
+
+// Most frames skipped in a row by automatic frame skip
+#define AUTO_FRAME_SKIP_MAX 4
+
+// Hotkey requests, handled by the emulation thread between frames
+#define REQUEST_SAVE_STATE 0x01
+#define REQUEST_LOAD_STATE 0x02
+
+// A windowed run. The emulation thread runs the instance and publishes its
+// frames, while the main thread handles SDL events and draws the frames, so
+// the core never waits on the GPU driver or vsync. The main thread passes
+// input through the atomic fields and only touches the instance itself
+// under gb_lock.
+typedef struct {
+    gb_t *gb;
+    rewind_t *rw;
+    run_ahead_t *ra;
+    pacer_t *pacer;
+    const run_limits_t *limits;
+    const char *state_path;
+    bool auto_frame_skip; // skip frames while behind instead of gb->frame_skip
+    bool audio_sync;      // pace by the audio device instead of the pacer
+    bool late;            // the last frame ended after it was due
+    pthread_mutex_t gb_lock;
+    uint32_t frame_event; // pushed for every published frame
+
+    uint8_t buttons;  // held buttons, one bit per button_t
+    uint8_t requests; // REQUEST_* bits not handled yet
+    bool rewinding;
+    uint8_t speed;    // pacing speed index
+    bool quit;        // ends the emulation thread
+
+    // Set by the emulation thread
+    run_result_t result;
+    uint64_t frames;
+} emulator_t;
+
 void segfault_handler(int sig, siginfo_t *info, void *ucontext) {
     ssize_t sink;
     const char msg1[] = "\nSegmentation fault at address: 0x";
@@ -27,17 +100,262 @@ void segfault_handler(int sig, siginfo_t *info, void *ucontext) {
     const char msg2[] = "\n";
     sink = write(STDERR_FILENO, msg2, sizeof(msg2)-1);
 
-    signal_safe_dump_cpu_state();
+    if (active_gb) {
+        signal_safe_dump_cpu_state(active_gb);
+    }
     sink = sink;
     _exit(EXIT_FAILURE);
 }
 
 void usage(void) {
     printf("Usage: gbemu [OPTIONS]\n");
+    printf("       gbemu -B [OPTIONS] ROM...\n");
     printf("Options:\n");
     printf("  -r PATH    ROM path\n");
     printf("  -b         Run boot rom\n");
+    printf("  -s         Print emulation stats on exit\n");
+    printf("  -a         Draw pixels dot by dot for mid-line raster effects\n");
+    printf("  -H         Run headless, without a window or frame pacing\n");
+    printf("  -f FRAMES  Stop after FRAMES frames\n");
+    printf("  -n DOTS    Stop after DOTS dots\n");
+    printf("  -m TEXT    Pass once the serial output contains TEXT\n");
+    printf("  -F TEXT    Fail once the serial output contains TEXT\n");
+    printf("  -B         Run the ROMs given headlessly, print JSON results\n");
+    printf("  -j THREADS Worker threads for -B (default: one per core)\n");
+    printf("  -l PATH    Load a save state before running\n");
+    printf("  -R MIB     Rewind buffer size (default: 64, 0 disables)\n");
+    printf("  -A FRAMES  Show FRAMES frames ahead to hide input lag\n");
+    printf("  -k N|auto  Draw one frame in N+1, or skip frames while behind\n");
+    printf("  -S         Pace by the audio device rather than a timer\n");
+    printf("  -w PATH    Write the audio to a WAV file, needs -H\n");
     printf("  -h         Display this help message\n");
+    printf("Keys:\n");
+    printf("  F5         Save state next to the ROM\n");
+    printf("  F8         Load the state saved with F5\n");
+    printf("  R          Hold to rewind\n");
+    printf("  - / =      Lower / raise the speed, from 0.25x to uncapped\n");
+}
+
+// Copies the buttons held on the main thread into the instance, requesting
+// the joypad interrupt for new presses
+static void update_buttons(gb_t *gb, uint8_t buttons) {
+    bool *held[BUTTON_NUM] = {
+        [BUTTON_A] = &gb->b_a,
+        [BUTTON_B] = &gb->b_b,
+        [BUTTON_START] = &gb->b_start,
+        [BUTTON_SELECT] = &gb->b_select,
+        [BUTTON_LEFT] = &gb->b_left,
+        [BUTTON_RIGHT] = &gb->b_right,
+        [BUTTON_UP] = &gb->b_up,
+        [BUTTON_DOWN] = &gb->b_down,
+    };
+    for (size_t i = 0; i < BUTTON_NUM; i++) {
+        bool pressed = buttons & (1 << i);
+        if (pressed && !*held[i]) {
+            gb->r_if |= 0x10; // request joypad interrupt
+        }
+        *held[i] = pressed;
+    }
+}
+
+// Decides whether the next frame goes undrawn, given how many were skipped
+// just before it. Automatic frame skip drops frames that are already late,
+// or that would replace one the presenter hasn't taken yet, which is what
+// happens when running uncapped.
+static bool skip_next_frame(emulator_t *emu, size_t skipped) {
+    if (!emu->auto_frame_skip) {
+        return skipped < emu->gb->frame_skip;
+    }
+    return skipped < AUTO_FRAME_SKIP_MAX &&
+           (emu->late || is_frame_pending(emu->gb));
+}
+
+static void *emulation_main(void *arg) {
+    emulator_t *emu = arg;
+    gb_t *gb = emu->gb;
+    run_result_t result = RUN_RUNNING;
+    size_t skipped = 0;
+    bool audio_paced = false;
+
+    while (result == RUN_RUNNING &&
+           !__atomic_load_n(&emu->quit, __ATOMIC_ACQUIRE)) {
+        bool frame_done = false;
+        bool queued_audio = false;
+        bool skip = skip_next_frame(emu, skipped);
+
+        pthread_mutex_lock(&emu->gb_lock);
+        update_buttons(gb, __atomic_load_n(&emu->buttons, __ATOMIC_ACQUIRE));
+        uint8_t requests = __atomic_exchange_n(&emu->requests, 0,
+                                               __ATOMIC_ACQ_REL);
+        if (requests & REQUEST_SAVE_STATE) {
+            save_state_file(gb, emu->state_path);
+        }
+        if (requests & REQUEST_LOAD_STATE) {
+            load_state_file(gb, emu->state_path);
+        }
+
+        bool rewinding = __atomic_load_n(&emu->rewinding, __ATOMIC_ACQUIRE);
+        gb->skip_draw = skip;
+        if (rewinding && emu->rw && rewind_frame(emu->rw, gb)) {
+            frame_done = true;
+        } else {
+            // With run-ahead, only the last frame run ahead is shown
+            gb->skip_draw = skip || emu->ra != NULL;
+            bool completed = run_frame(gb, emu->limits->max_dots);
+            if (gb->output_audio) {
+                queue_audio(gb);
+                queued_audio = true;
+            }
+            if (completed) {
+                emu->frames++;
+                if (emu->rw) {
+                    record_frame(emu->rw, gb);
+                }
+                if (emu->ra) {
+                    gb->skip_draw = skip;
+                    run_ahead(emu->ra, gb);
+                }
+                frame_done = true;
+            }
+        }
+        result = check_run_limits(gb, emu->limits, emu->frames);
+        pthread_mutex_unlock(&emu->gb_lock);
+
+        if (frame_done && skip) {
+            skipped++;
+        } else if (frame_done) {
+            skipped = 0;
+            publish_frame(gb);
+            SDL_Event event = {.type = emu->frame_event};
+            SDL_PushEvent(&event);
+        }
+
+        uint8_t speed = __atomic_load_n(&emu->speed, __ATOMIC_ACQUIRE);
+        if (speed != emu->pacer->speed) {
+            set_pacer_speed(emu->pacer, speed);
+            if (speed == PACING_UNCAPPED_SPEED) {
+                fprintf(stderr, "Speed: uncapped\n");
+            } else {
+                fprintf(stderr, "Speed: %.2fx\n",
+                        get_pacer_speed(emu->pacer));
+            }
+        }
+
+        // The audio device can only pace frames that make sound at normal
+        // speed, so rewinding and other speeds fall back to the pacer
+        bool was_audio_paced = audio_paced;
+        audio_paced = emu->audio_sync && queued_audio &&
+                      speed == PACING_NORMAL_SPEED;
+        if (audio_paced) {
+            emu->late = wait_audio();
+        } else {
+            if (was_audio_paced) {
+                // Start a new schedule rather than catch up on the old one
+                set_pacer_speed(emu->pacer, speed);
+            }
+            pace_frame(emu->pacer);
+            emu->late = emu->pacer->late;
+        }
+    }
+
+    // Closing the window ends the run like reaching a limit
+    emu->result = result == RUN_RUNNING ? RUN_LIMIT_REACHED : result;
+    SDL_Event event = {.type = SDL_EVENT_QUIT};
+    SDL_PushEvent(&event);
+    return NULL;
+}
+
+// Handles an input event on the main thread
+static void handle_event(emulator_t *emu, const SDL_Event *event) {
+    switch (event->type) {
+        case SDL_EVENT_WINDOW_CLOSE_REQUESTED:
+            __atomic_store_n(&emu->quit, true, __ATOMIC_RELEASE);
+            return;
+        case SDL_EVENT_KEY_DOWN:
+        case SDL_EVENT_KEY_UP:
+            break;
+        default:
+            return;
+    }
+
+    bool down = event->type == SDL_EVENT_KEY_DOWN;
+    for (size_t i = 0; i < BUTTON_NUM; i++) {
+        if (event->key.key == button_keys[i]) {
+            if (down) {
+                __atomic_or_fetch(&emu->buttons, 1 << i, __ATOMIC_RELEASE);
+            } else {
+                __atomic_and_fetch(&emu->buttons, ~(1 << i),
+                                   __ATOMIC_RELEASE);
+            }
+            return;
+        }
+    }
+    if (event->key.key == SDLK_R) {
+        __atomic_store_n(&emu->rewinding, down && emu->rw != NULL,
+                         __ATOMIC_RELEASE);
+    } else if (down && event->key.key == SDLK_MINUS) {
+        // Only this thread changes the speed
+        if (emu->speed > 0) {
+            __atomic_store_n(&emu->speed, emu->speed - 1, __ATOMIC_RELEASE);
+        }
+    } else if (down && event->key.key == SDLK_EQUALS) {
+        if (emu->speed < PACING_SPEED_NUM - 1) {
+            __atomic_store_n(&emu->speed, emu->speed + 1, __ATOMIC_RELEASE);
+        }
+    } else if (down && event->key.key == SDLK_F5) {
+        __atomic_or_fetch(&emu->requests, REQUEST_SAVE_STATE,
+                          __ATOMIC_RELEASE);
+    } else if (down && event->key.key == SDLK_F8) {
+        __atomic_or_fetch(&emu->requests, REQUEST_LOAD_STATE,
+                          __ATOMIC_RELEASE);
+    }
+}
+
+// Runs an instance in the window until one of the limits is hit or the
+// window is closed. The instance runs on its own thread; this one draws its
+// frames and the debug views.
+static run_result_t run_window(emulator_t *emu, bool debug_mode) {
+    emu->frame_event = SDL_RegisterEvents(1);
+    if (emu->frame_event == 0) {
+        fprintf(stderr, "SDL event registration failed: %s\n",
+                SDL_GetError());
+        exit(1);
+    }
+    pthread_mutex_init(&emu->gb_lock, NULL);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, emulation_main, emu)) {
+        fprintf(stderr, "Failed to create emulation thread, exiting...\n");
+        exit(1);
+    }
+
+    bool running = true;
+    while (running) {
+        SDL_Event event;
+        if (!SDL_WaitEvent(&event)) {
+            fprintf(stderr, "SDL event wait failed: %s\n", SDL_GetError());
+            exit(1);
+        }
+        do {
+            if (event.type == emu->frame_event) {
+                present_display(emu->gb);
+                if (debug_mode) {
+                    // The debug views read VRAM, so the core has to wait
+                    pthread_mutex_lock(&emu->gb_lock);
+                    update_debug(emu->gb);
+                    pthread_mutex_unlock(&emu->gb_lock);
+                }
+            } else if (event.type == SDL_EVENT_QUIT) {
+                running = false;
+            } else {
+                handle_event(emu, &event);
+            }
+        } while (SDL_PollEvent(&event));
+    }
+
+    __atomic_store_n(&emu->quit, true, __ATOMIC_RELEASE);
+    pthread_join(thread, NULL);
+    pthread_mutex_destroy(&emu->gb_lock);
+    return emu->result;
 }
 
 int main(int argc, char *argv[])
@@ -53,11 +371,30 @@ int main(int argc, char *argv[])
     }
 
     char *rom_path = NULL;
+    char *load_state_path = NULL;
+    char *wav_path = NULL;
+    size_t rewind_size = REWIND_DEFAULT_SIZE;
+    size_t run_ahead_frames = 0;
+    size_t frame_skip = 0;
+    bool auto_frame_skip = false;
+    bool audio_sync = false;
     bool run_boot = false;
     bool debug_mode = false;
+    bool show_stats = false;
+    bool accurate_ppu = false;
+    bool headless = false;
+    bool batch_mode = false;
+    size_t thread_num = 0;
+    run_limits_t limits = {
+        .max_frames = UINT64_MAX,
+        .max_dots = UINT64_MAX,
+        .pass_match = NULL,
+        .fail_match = NULL,
+    };
     int opt;
 
-    while ((opt = getopt(argc, argv, "r:bhd")) != -1) {
+    const char *optstring = "r:bhdsaHf:n:m:F:Bj:l:R:A:k:Sw:";
+    while ((opt = getopt(argc, argv, optstring)) != -1) {
         switch (opt) {
             case 'r':
                 rom_path = optarg;
@@ -68,6 +405,55 @@ int main(int argc, char *argv[])
             case 'd':
                 debug_mode = true;
                 break;
+            case 's':
+                show_stats = true;
+                break;
+            case 'a':
+                accurate_ppu = true;
+                break;
+            case 'H':
+                headless = true;
+                break;
+            case 'f':
+                limits.max_frames = strtoull(optarg, NULL, 0);
+                break;
+            case 'n':
+                limits.max_dots = strtoull(optarg, NULL, 0);
+                break;
+            case 'm':
+                limits.pass_match = optarg;
+                break;
+            case 'F':
+                limits.fail_match = optarg;
+                break;
+            case 'B':
+                batch_mode = true;
+                break;
+            case 'j':
+                thread_num = strtoull(optarg, NULL, 0);
+                break;
+            case 'l':
+                load_state_path = optarg;
+                break;
+            case 'R':
+                rewind_size = strtoull(optarg, NULL, 0) << 20;
+                break;
+            case 'A':
+                run_ahead_frames = strtoull(optarg, NULL, 0);
+                break;
+            case 'k':
+                if (strcmp(optarg, "auto") == 0) {
+                    auto_frame_skip = true;
+                } else {
+                    frame_skip = strtoull(optarg, NULL, 0);
+                }
+                break;
+            case 'S':
+                audio_sync = true;
+                break;
+            case 'w':
+                wav_path = optarg;
+                break;
             case 'h':
                 usage();
                 return 0;
@@ -78,156 +464,158 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (batch_mode) {
+        if (optind >= argc) {
+            fprintf(stderr, "Batch mode needs at least one ROM path\n");
+            usage();
+            return 1;
+        }
+        if (thread_num == 0) {
+            long cores = sysconf(_SC_NPROCESSORS_ONLN);
+            thread_num = cores > 0 ? (size_t)cores : 1;
+        }
+        bool all_passed = run_batch(&argv[optind], argc - optind, thread_num,
+                                    run_boot, accurate_ppu, frame_skip,
+                                    &limits);
+        return all_passed ? 0 : 1;
+    }
+
     if (rom_path == NULL) {
         fprintf(stderr, "ROM path is required\n");
         usage();
         return 1;
     }
 
-    if (!run_boot) {
-        // Set CPU registers
-        af.r16 = 0x1B0;
-        bc.r16 = 0x13;
-        de.r16 = 0xD8;
-        hl.r16 = 0x14D;
-        pc.r16 = 0x100;
-        sp.r16 = 0xFFFE;
-
-        // Set Hardware registers
-        b_buttons_select = true;
-        b_dpad_select = true;
-        r_sc = 0x7E;
-        r_div = 0xAB;
-        r_tac = 0xF8;
-        r_if = 0xE1;
-        r_nr10 = 0x80;
-        r_nr11 = 0xBF;
-        r_nr12 = 0xF3;
-        r_nr13 = 0xFF;
-        r_nr14 = 0xBF;
-        r_nr21 = 0x3F;
-        r_nr23 = 0xFF;
-        r_nr24 = 0xBF;
-        r_nr30 = 0x7F;
-        r_nr31 = 0xFF;
-        r_nr32 = 0x9F;
-        r_nr33 = 0xFF;
-        r_nr34 = 0xBF;
-        r_nr41 = 0xFF;
-        r_nr44 = 0xBF;
-        r_nr50 = 0x77;
-        r_nr51 = 0xF3;
-        r_nr52 = 0xF1;
-        r_lcdc = 0x91;
-        r_stat = 0x85;
-        r_dma = 0xFF;
-        r_bgp = 0xFC;
-        r_boot_rom_mapped = 1;
-    }
-
-    load_rom(rom_path);
-
-    init_display();
+    if (headless && debug_mode) {
+        fprintf(stderr, "Debug mode needs a window and cannot run headless\n");
+        return 1;
+    }
 
-    if (debug_mode) {
-        init_debug();
+    if (wav_path && !headless) {
+        fprintf(stderr, "Audio can only be written to a file headless\n");
+        return 1;
     }
 
-    bool quit = false;
+    gb_t *gb = init_gb(rom_path, run_boot);
+    if (!gb) {
+        return 1;
+    }
+    open_sav(gb, rom_path);
+    if (load_state_path && !load_state_file(gb, load_state_path)) {
+        free_gb(gb);
+        return 1;
+    }
+    gb->accurate_ppu = accurate_ppu;
+    gb->frame_skip = frame_skip;
+    active_gb = gb;
 
-    while (!quit) {
-        double frame_start = (double)SDL_GetPerformanceCounter();
+    char *state_path = replace_extension(rom_path, ".state");
 
-        // Handle SDL events
-        SDL_Event event;
-        while (SDL_PollEvent(&event)) {
-            switch (event.type) {
-                case SDL_EVENT_WINDOW_CLOSE_REQUESTED:
-                    quit = true;
-                    break;
-                case SDL_EVENT_KEY_DOWN:
-                    if (event.key.key == SDLK_A) {
-                        b_a = true;
-                        r_if |= 0x10; // request joypad interrupt
-                        continue;
-                    } else if (event.key.key == SDLK_S) {
-                        b_b = true;
-                        r_if |= 0x10; // request joypad interrupt
-                        continue;
-                    } else if (event.key.key == SDLK_ESCAPE) {
-                        b_start = true;
-                        r_if |= 0x10; // request joypad interrupt
-                        continue;
-                    } else if (event.key.key == SDLK_BACKSPACE) {
-                        b_select = true;
-                        r_if |= 0x10; // request joypad interrupt
-                        continue;
-                    } else if (event.key.key == SDLK_LEFT) {
-                        b_left = true;
-                        r_if |= 0x10; // request joypad interrupt
-                        continue;
-                    } else if (event.key.key == SDLK_RIGHT) {
-                        b_right = true;
-                        r_if |= 0x10; // request joypad interrupt
-                        continue;
-                    } else if (event.key.key == SDLK_UP) {
-                        b_up = true;
-                        r_if |= 0x10; // request joypad interrupt
-                        continue;
-                    } else if (event.key.key == SDLK_DOWN) {
-                        b_down = true;
-                        r_if |= 0x10; // request joypad interrupt
-                        continue;
-                    }
-                    break;
-                case SDL_EVENT_KEY_UP:
-                    if (event.key.key == SDLK_A) {
-                        b_a = false;
-                        continue;
-                    } else if (event.key.key == SDLK_S) {
-                        b_b = false;
-                        continue;
-                    } else if (event.key.key == SDLK_ESCAPE) {
-                        b_start = false;
-                        continue;
-                    } else if (event.key.key == SDLK_BACKSPACE) {
-                        b_select = false;
-                        continue;
-                    } else if (event.key.key == SDLK_LEFT) {
-                        b_left = false;
-                        continue;
-                    } else if (event.key.key == SDLK_RIGHT) {
-                        b_right = false;
-                        continue;
-                    } else if (event.key.key == SDLK_UP) {
-                        b_up = false;
-                        continue;
-                    } else if (event.key.key == SDLK_DOWN) {
-                        b_down = false;
-                        continue;
-                    }
-                    break;
-            }
+    bool audio = false;
+    if (!headless) {
+        init_display();
+        audio = init_audio();
+        gb->output_audio = audio;
+        if (audio_sync && !audio) {
+            fprintf(stderr, "No audio to pace by, using a timer\n");
+            audio_sync = false;
+        }
+    }
+    if (wav_path) {
+        gb->wav = open_wav(wav_path);
+        if (!gb->wav) {
+            free_gb(gb);
+            free(state_path);
+            return 1;
         }
+        gb->output_audio = true;
+    }
+
+    if (debug_mode) {
+        init_debug();
+    }
 
-        // Frame loop
-        while (!update_display(frame_start)) {
-            execute();
-            update_timer_regs();
-            update_stat_reg();
+    run_result_t result;
+    bool wav_written = true;
+    rewind_t *rw = NULL;
+    run_ahead_t *ra = NULL;
+    if (headless) {
+        uint64_t frames;
+        result = run_headless(gb, &limits, &frames);
+        if (gb->wav) {
+            wav_written = close_wav(gb->wav);
+            gb->wav = NULL;
         }
-        if (debug_mode) {
-            update_debug();
+    } else {
+        if (rewind_size) {
+            rw = init_rewind(gb, rewind_size);
         }
+        if (run_ahead_frames) {
+            ra = init_run_ahead(gb, run_ahead_frames);
+        }
+        emulator_t emu = {
+            .gb = gb,
+            .rw = rw,
+            .ra = ra,
+            .limits = &limits,
+            .state_path = state_path,
+            .auto_frame_skip = auto_frame_skip,
+            .audio_sync = audio_sync,
+            .speed = PACING_NORMAL_SPEED,
+        };
+        emu.pacer = init_pacer();
+        result = run_window(&emu, debug_mode);
+        if (show_stats) {
+            print_pacer_stats(emu.pacer);
+            if (audio) {
+                print_audio_stats();
+            }
+        }
+        free_pacer(emu.pacer);
     }
 
     if (debug_mode) {
         free_debug();
     }
 
-    free_display();
+    if (rw) {
+        free_rewind(rw);
+    }
+    if (ra) {
+        free_run_ahead(ra);
+    }
+
+    if (audio) {
+        free_audio();
+    }
+    if (!headless) {
+        free_display();
+    }
 
-    free_rom();
+    if (show_stats) {
+        print_stats(gb);
+    }
+
+    active_gb = NULL;
+    free_gb(gb);
+    free(state_path);
+
+    if (!wav_written) {
+        return 1;
+    }
+    if (result == RUN_ERROR) {
+        // What went wrong was reported when the instance stopped
+        return 1;
+    }
+    if (result == RUN_FAILED) {
+        fprintf(stderr, "Serial output matched \"%s\"\n", limits.fail_match);
+        return 1;
+    }
+    if (limits.pass_match && result != RUN_PASSED) {
+        fprintf(stderr, "Serial output never matched \"%s\"\n",
+                limits.pass_match);
+        return 1;
+    }
 
     return 0;
 }
@@ -0,0 +1,315 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <mbc.h>
+#include <mem.h>
+
+// Picks the memory bank controller from the cartridge type in the header.
+// Returns false if the cartridge type isn't supported.
+bool init_mbc(gb_t *gb, const char *rom_path) {
+    switch (gb->rom_type) {
+        case 0x00: // ROM ONLY
+        case 0x08: // ROM+RAM
+            gb->mbc_type = MBC_NONE;
+            break;
+        case 0x09: // ROM+RAM+BATTERY
+            gb->has_battery = true;
+            gb->mbc_type = MBC_NONE;
+            break;
+        case 0x01: // MBC1
+        case 0x02: // MBC1+RAM
+            gb->mbc_type = MBC_1;
+            break;
+        case 0x03: // MBC1+RAM+BATTERY
+            gb->has_battery = true;
+            gb->mbc_type = MBC_1;
+            break;
+        case 0x0F: // MBC3+TIMER+BATTERY
+        case 0x10: // MBC3+TIMER+RAM+BATTERY
+            gb->has_battery = true;
+            gb->has_rtc = true;
+            gb->mbc_type = MBC_3;
+            break;
+        case 0x11: // MBC3
+        case 0x12: // MBC3+RAM
+            gb->mbc_type = MBC_3;
+            break;
+        case 0x13: // MBC3+RAM+BATTERY
+            gb->has_battery = true;
+            gb->mbc_type = MBC_3;
+            break;
+        case 0x19: // MBC5
+        case 0x1A: // MBC5+RAM
+        case 0x1C: // MBC5+RUMBLE
+        case 0x1D: // MBC5+RUMBLE+RAM
+            gb->mbc_type = MBC_5;
+            break;
+        case 0x1B: // MBC5+RAM+BATTERY
+        case 0x1E: // MBC5+RUMBLE+RAM+BATTERY
+            gb->has_battery = true;
+            gb->mbc_type = MBC_5;
+            break;
+        default:
+            fprintf(stderr, "Unsupported cartridge type 0x%02X: %s\n",
+                    gb->rom_type, rom_path);
+            return false;
+    }
+
+    // Until a save file is attached, RAM only lives as long as the instance
+    if (gb->ram_size) {
+        gb->ext_ram = calloc(gb->ram_size, 1);
+        if (!gb->ext_ram) {
+            fprintf(stderr, "Failed to allocate cart RAM, exiting...\n");
+            exit(1);
+        }
+    }
+
+    // Without an MBC there is no enable register
+    gb->ram_enabled = gb->mbc_type == MBC_NONE;
+
+    gb->rom_bank = 1;
+    return true;
+}
+
+static void map_rom_bank(gb_t *gb, size_t first_page, size_t bank) {
+    uint8_t *base = gb->rom + (bank * ROM_BANK_SIZE);
+    for (size_t i = 0; i < ROM_BANK_SIZE / PAGE_SIZE; i++) {
+        gb->read_pages[first_page + i] = base + (i * PAGE_SIZE);
+    }
+}
+
+void free_mbc(gb_t *gb) {
+    if (!gb->sav_mapped) {
+        free(gb->ext_ram);
+    }
+    gb->ext_ram = NULL;
+}
+
+// Points the ROM read pages at the selected banks of the loaded image.
+// Nothing is copied and reads stay a single indexed load; a bank switch only
+// repoints the 0x4000-0x7FFF pages, plus 0x0000-0x3FFF when MBC1 advanced
+// banking moves it.
+void map_rom_banks(gb_t *gb) {
+    size_t low = 0;
+    size_t high = gb->rom_bank;
+    if (gb->mbc_type == MBC_1) {
+        high |= (size_t)gb->ram_bank << 5;
+        if (gb->mbc1_mode) {
+            low = (size_t)gb->ram_bank << 5;
+        }
+    }
+
+    // Bank numbers wrap at the ROM size, which is always a power of two
+    low &= gb->rom_bank_num - 1;
+    high &= gb->rom_bank_num - 1;
+
+    if (high != gb->rom_high_bank) {
+        map_rom_bank(gb, ROM_BANK_SIZE >> 8, high);
+        gb->rom_high_bank = high;
+    }
+    if (low != gb->rom_low_bank) {
+        map_rom_bank(gb, ROM_A >> 8, low);
+        gb->rom_low_bank = low;
+        update_boot_rom_page(gb);
+    }
+}
+
+static size_t ext_ram_bank(gb_t *gb) {
+    switch (gb->mbc_type) {
+        case MBC_1:
+            return gb->mbc1_mode ? gb->ram_bank : 0;
+        case MBC_3:
+        case MBC_5:
+            return gb->ram_bank;
+        default:
+            return 0;
+    }
+}
+
+// Points the 0xA000-0xBFFF pages at the selected RAM bank. Nothing is mapped
+// while RAM is disabled or the MBC3 clock is selected, so the slow path can
+// handle those. RAM smaller than a bank is mirrored across it.
+void map_ext_ram(gb_t *gb) {
+    bool mapped = gb->ext_ram && gb->ram_enabled && !rtc_selected(gb);
+    size_t base = ext_ram_bank(gb) * EXT_RAM_BANK_SIZE;
+    for (size_t i = 0; i < EXT_RAM_BANK_SIZE / PAGE_SIZE; i++) {
+        size_t page_num = (EXT_RAM_A >> 8) + i;
+        if (!mapped) {
+            gb->read_pages[page_num] = NULL;
+            gb->write_pages[page_num] = NULL;
+            continue;
+        }
+        // RAM sizes are powers of two
+        size_t offset = (base + (i * PAGE_SIZE)) & (gb->ram_size - 1);
+        uint8_t *page = gb->ext_ram + offset;
+        gb->read_pages[page_num] = page;
+        bool writable = !gb->sav_mapped ||
+                        gb->ext_ram_dirty[offset / PAGE_SIZE];
+        gb->write_pages[page_num] = writable ? page : NULL;
+    }
+}
+
+// Handles writes to unmapped external RAM pages: either RAM is disabled or
+// the page is clean and has to be marked dirty before it's written
+void write_ext_ram(gb_t *gb, uint16_t addr, uint8_t val) {
+    uint8_t *page = gb->read_pages[addr >> 8];
+    if (!page) {
+        return;
+    }
+    gb->ext_ram_dirty[(size_t)(page - gb->ext_ram) / PAGE_SIZE] = true;
+    gb->write_pages[addr >> 8] = page;
+    page[addr & 0xFF] = val;
+}
+
+static void write_mbc1(gb_t *gb, uint16_t addr, uint8_t val) {
+    switch (addr >> 13) {
+        case 0: // 0x0000-0x1FFF: RAM enable
+            gb->ram_enabled = (val & 0x0F) == 0x0A;
+            break;
+        case 1: // 0x2000-0x3FFF: lower 5 bits of the ROM bank
+            // Bank 0 can't be selected here, it reads as bank 1
+            gb->rom_bank = (val & 0x1F) ? (val & 0x1F) : 1;
+            break;
+        case 2: // 0x4000-0x5FFF: RAM bank or upper ROM bank bits
+            gb->ram_bank = val & 0x03;
+            break;
+        case 3: // 0x6000-0x7FFF: banking mode
+            gb->mbc1_mode = val & 0x01;
+            break;
+    }
+    map_rom_banks(gb);
+    map_ext_ram(gb);
+}
+
+// Advances the clock to the current dot time, in whole seconds
+static void sync_rtc(gb_t *gb) {
+    uint64_t seconds = (gb->dots - gb->rtc_dots) / DOTS_PER_SECOND;
+    gb->rtc_dots += seconds * DOTS_PER_SECOND;
+    if (seconds == 0 || (gb->rtc[RTC_DH] & RTC_DH_HALT)) {
+        return;
+    }
+
+    uint64_t days = ((gb->rtc[RTC_DH] & RTC_DH_DAY_HIGH) << 8) |
+                    gb->rtc[RTC_DL];
+    uint64_t time = gb->rtc[RTC_S] +
+                    (60 * (gb->rtc[RTC_M] +
+                           (60 * (gb->rtc[RTC_H] + (24 * days))))) +
+                    seconds;
+
+    gb->rtc[RTC_S] = time % 60;
+    time /= 60;
+    gb->rtc[RTC_M] = time % 60;
+    time /= 60;
+    gb->rtc[RTC_H] = time % 24;
+    days = time / 24;
+
+    // The day counter is 9 bits wide; the carry stays set until cleared
+    if (days > 0x1FF) {
+        gb->rtc[RTC_DH] |= RTC_DH_CARRY;
+        days &= 0x1FF;
+    }
+    gb->rtc[RTC_DL] = days & 0xFF;
+    gb->rtc[RTC_DH] = (gb->rtc[RTC_DH] & ~RTC_DH_DAY_HIGH) | (days >> 8);
+}
+
+static void write_mbc3(gb_t *gb, uint16_t addr, uint8_t val) {
+    switch (addr >> 13) {
+        case 0: // 0x0000-0x1FFF: RAM and clock enable
+            gb->ram_enabled = (val & 0x0F) == 0x0A;
+            map_ext_ram(gb);
+            break;
+        case 1: // 0x2000-0x3FFF: ROM bank, 0 reads as 1
+            gb->rom_bank = (val & 0x7F) ? (val & 0x7F) : 1;
+            map_rom_banks(gb);
+            break;
+        case 2: // 0x4000-0x5FFF: RAM bank (0x00-0x03) or clock register
+            gb->ram_bank = val;
+            map_ext_ram(gb);
+            break;
+        case 3: // 0x6000-0x7FFF: writing 0 then 1 latches the clock
+            if (gb->has_rtc && gb->rtc_latch == 0x00 && val == 0x01) {
+                sync_rtc(gb);
+                for (size_t i = 0; i < RTC_REG_NUM; i++) {
+                    gb->rtc_latched[i] = gb->rtc[i];
+                }
+            }
+            gb->rtc_latch = val;
+            break;
+    }
+}
+
+static void write_mbc5(gb_t *gb, uint16_t addr, uint8_t val) {
+    if (addr < 0x2000) {
+        gb->ram_enabled = (val & 0x0F) == 0x0A;
+        map_ext_ram(gb);
+    } else if (addr < 0x3000) {
+        // Lower 8 bits of the ROM bank; unlike MBC1/MBC3, bank 0 is valid
+        gb->rom_bank = (gb->rom_bank & 0x100) | val;
+        map_rom_banks(gb);
+    } else if (addr < 0x4000) {
+        gb->rom_bank = (gb->rom_bank & 0xFF) | ((val & 0x01) << 8);
+        map_rom_banks(gb);
+    } else if (addr < 0x6000) {
+        // Bit 3 drives the rumble motor on rumble carts
+        gb->ram_bank = val & 0x0F;
+        map_ext_ram(gb);
+    }
+}
+
+// Handles writes to the ROM area, which go to the MBC registers
+void write_mbc(gb_t *gb, uint16_t addr, uint8_t val) {
+    switch (gb->mbc_type) {
+        case MBC_NONE:
+            // Some ROM only games (e.g. Tetris) write here anyway
+            break;
+        case MBC_1:
+            write_mbc1(gb, addr, val);
+            break;
+        case MBC_3:
+            write_mbc3(gb, addr, val);
+            break;
+        case MBC_5:
+            write_mbc5(gb, addr, val);
+            break;
+    }
+}
+
+// Whether the external RAM area currently shows a clock register
+bool rtc_selected(gb_t *gb) {
+    return gb->has_rtc && 0x08 <= gb->ram_bank && gb->ram_bank <= 0x0C;
+}
+
+uint8_t read_rtc(gb_t *gb) {
+    if (!gb->ram_enabled) {
+        return 0xFF;
+    }
+    return gb->rtc_latched[gb->ram_bank - 0x08];
+}
+
+void write_rtc(gb_t *gb, uint8_t val) {
+    if (!gb->ram_enabled) {
+        return;
+    }
+    sync_rtc(gb);
+    switch (gb->ram_bank - 0x08) {
+        case RTC_S:
+            // Writing the seconds also resets the sub-second counter
+            gb->rtc[RTC_S] = val & 0x3F;
+            gb->rtc_dots = gb->dots;
+            break;
+        case RTC_M:
+            gb->rtc[RTC_M] = val & 0x3F;
+            break;
+        case RTC_H:
+            gb->rtc[RTC_H] = val & 0x1F;
+            break;
+        case RTC_DL:
+            gb->rtc[RTC_DL] = val;
+            break;
+        case RTC_DH:
+            gb->rtc[RTC_DH] = val & (RTC_DH_CARRY | RTC_DH_HALT |
+                                     RTC_DH_DAY_HIGH);
+            break;
+    }
+}
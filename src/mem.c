@@ -2,503 +2,391 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <rom.h>
 #include <mem.h>
+#include <mbc.h>
 #include <util.h>
 #include <cpu.h>
+#include <display.h>
+#include <apu.h>
 
-// Memory
-tile vram_tiles[VRAM_TILES_NUM];
-map vram_maps[VRAM_MAP_NUM];
-obj oam[OBJ_NUM];
-uint8_t wram[WRAM_SIZE];
-uint8_t io_reg[IO_REG_SIZE];
-uint8_t hram[HRAM_SIZE];
-
-// Serial Data Transfer registers
-uint8_t r_sb = 0;
-uint8_t r_sc = 0;
-
-// Timer registers
-uint8_t r_div = 0;
-uint8_t r_tima = 0;
-uint8_t r_tma = 0;
-uint8_t r_tac = 0;
-
-// Interrupt registers
-uint8_t r_ie = 0;
-uint8_t r_if = 0;
-
-/* Audio registers */
-
-// Global sound registers
-uint8_t r_nr50 = 0; // Master volume & VIN panning
-uint8_t r_nr51 = 0; // Sound panning
-uint8_t r_nr52 = 0; // Audio master control
-
-// Channel 1 registers (Square)
-uint8_t r_nr10 = 0; // Sweep
-uint8_t r_nr11 = 0; // Length timer & duty cycle
-uint8_t r_nr12 = 0; // Volume & envelope
-uint8_t r_nr13 = 0; // Period low
-uint8_t r_nr14 = 0; // Period high & control
-
-// Channel 2 registers (Square)
-uint8_t r_nr21 = 0; // Length timer & duty cycle
-uint8_t r_nr22 = 0; // Volume & envelope
-uint8_t r_nr23 = 0; // Period low
-uint8_t r_nr24 = 0; // Period high & control
+// TODO: Check which regions of memory are accessible in which mode
 
-// Channel 3 registers (Wave)
-uint8_t r_nr30 = 0; // DAC
-uint8_t r_nr31 = 0; // Length timer
-uint8_t r_nr32 = 0; // Output level
-uint8_t r_nr33 = 0; // Period low
-uint8_t r_nr34 = 0; // Period high & control
-uint8_t m_wave[16] = {0}; // Wave pattern
+static void map_pages(uint8_t *pages[], size_t first, size_t count,
+                      uint8_t *base) {
+    for (size_t i = 0; i < count; i++) {
+        pages[first + i] = base + (i * PAGE_SIZE);
+    }
+}
 
-// Channel 4 registers (Noise)
-uint8_t r_nr41 = 0; // Length timer
-uint8_t r_nr42 = 0; // Volume & envelope
-uint8_t r_nr43 = 0; // Frequency & randomness
-uint8_t r_nr44 = 0; // Control
+// Builds the page tables from the current cartridge bank state. Loading a
+// save state uses this to rebuild them.
+void init_mem(gb_t *gb) {
+    for (size_t i = 0; i < PAGE_NUM; i++) {
+        gb->read_pages[i] = NULL;
+        gb->write_pages[i] = NULL;
+    }
+    // Nothing is mapped yet, so both ROM areas get mapped
+    gb->rom_low_bank = SIZE_MAX;
+    gb->rom_high_bank = SIZE_MAX;
 
-// LCD control registers
-uint8_t r_lcdc = 0;
-uint8_t r_ly = 0;
-uint8_t r_lyc = 0;
-uint8_t r_stat = 0;
-uint8_t r_scy = 0;
-uint8_t r_scx = 0;
-uint8_t r_wy = 0;
-uint8_t r_wx = 0; // x pos + 7; i.e. wx = 7 and wy = 0 is flush
+    // ROM (writes go to the slow path, where the MBC handles them)
+    map_rom_banks(gb);
 
-// Palette registers
-uint8_t r_bgp = 0;
-uint8_t r_obp0 = 0;
-uint8_t r_obp1 = 0;
+    // External RAM, if present and enabled
+    map_ext_ram(gb);
 
-// OAM DMA register
-uint8_t r_dma = 0;
+    // VRAM (tile writes go to the slow path to keep decoded_tiles in sync)
+    map_pages(gb->read_pages, VRAM_TILES_A >> 8, 0x18,
+              (uint8_t *)gb->vram_tiles);
+    map_pages(gb->read_pages, VRAM_MAPS_A >> 8, 0x08, (uint8_t *)gb->vram_maps);
+    map_pages(gb->write_pages, VRAM_MAPS_A >> 8, 0x08,
+              (uint8_t *)gb->vram_maps);
 
-// Boot ROM mapped register
-uint8_t r_boot_rom_mapped = 0;
+    // WRAM
+    map_pages(gb->read_pages, WRAM_A >> 8, 0x20, gb->wram);
+    map_pages(gb->write_pages, WRAM_A >> 8, 0x20, gb->wram);
+}
 
-// Button Inputs
-bool b_buttons_select = false;
-bool b_dpad_select = false;
-bool b_left = false;
-bool b_right = false;
-bool b_up = false;
-bool b_down = false;
-bool b_a = false;
-bool b_b = false;
-bool b_start = false;
-bool b_select = false;
+// The boot ROM overlays page 0 until FF50 is written
+void update_boot_rom_page(gb_t *gb) {
+    gb->read_pages[0] = gb->r_boot_rom_mapped ?
+                        gb->rom + (gb->rom_low_bank * ROM_BANK_SIZE) :
+                        dmg_boot_rom;
+}
 
-// TODO: Check which regions of memory are accessible in which mode
+// Writes a byte of tile data and re-decodes the tile row it belongs to
+static void write_tile_data(gb_t *gb, uint16_t addr, uint8_t val) {
+    size_t offset = addr - VRAM_TILES_A;
+    size_t idx = offset / TILE_SIZE;
+    size_t row = (offset % TILE_SIZE) / 2;
+    gb->vram_tiles[idx][offset % TILE_SIZE] = val;
 
-int bin_search(const uint16_t arr[], int size, const uint16_t target) {
-    int left = 0;
-    int right = size - 1;
-    while (left <= right) {
-        int mid = left + (right - left) / 2; // Avoid overflow
-        if (arr[mid] == target) {
-            return mid; // Target found
-        } else if (arr[mid] < target) {
-            left = mid + 1; // Move to the right half
-        } else {
-            right = mid - 1; // Move to the left half
-        }
+    uint8_t lsb = gb->vram_tiles[idx][row * 2];
+    uint8_t msb = gb->vram_tiles[idx][(row * 2) + 1];
+    for (size_t x = 0; x < 8; x++) {
+        size_t shift = 7 - x;
+        gb->decoded_tiles[idx][row][x] =
+            (((msb >> shift) & 1) << 1) | ((lsb >> shift) & 1);
     }
-    // If not found, bias downwards
-    return (right >= 0) ? right : -1;
 }
 
-uint8_t read_mem(uint16_t addr) {
-    const uint16_t mem_ranges[] = {
-        ROM_A, VRAM_TILES_A, VRAM_MAPS_A, EXT_RAM_A, WRAM_A, 
-        ECHO_RAM_A, OAM_A, UNUSED_A, IO_A, HRAM_A, IE_REG_A
-    };
-
-    if (!r_boot_rom_mapped && addr < 0x100) {
-        return dmg_boot_rom[addr];
+// Handles pages that are not directly mapped: external RAM and the MBC3 clock,
+// echo RAM, OAM and the unused area after it, I/O registers, HRAM and IE.
+uint8_t read_mem_slow(gb_t *gb, uint16_t addr) {
+    if (addr == IE_REG_A) {
+        return gb->r_ie;
     }
-
-    switch (bin_search(mem_ranges, 11, addr)) {
-        case 0:
-            return rom[addr];
-        case 1:
-            return ((uint8_t *)vram_tiles)[addr - VRAM_TILES_A];
-        case 2:
-            return ((uint8_t *)vram_maps)[addr - VRAM_MAPS_A];
-        case 3:
-            fprintf(stderr, "Attempted read at addr %d\n", (int)addr);
-            fprintf(stderr, "External RAM unimplemented, exiting...\n");
-            exit(1);
-        case 4:
-            return wram[addr - WRAM_A];
-        case 5:
-            fprintf(stderr, "Attempted read at addr %d\n", (int)addr);
-            fprintf(stderr, "Echo RAM unimplemented, exiting...\n");
-            exit(1);
-        case 6:
-            return ((uint8_t *)oam)[addr - OAM_A];
-        case 7:
-            fprintf(stderr, "Attempted read at addr %d\n", (int)addr);
-            fprintf(stderr, "Unused/Invalid RAM location, exiting...\n");
-            exit(1);
-        case 8:
-            break; // handled after this switch
-        case 9:
-            return hram[addr - HRAM_A];
-        case 10:
-            return r_ie;
-        default:
-            fprintf(stderr, "Attempted read at addr %d\n", (int)addr);
-            fprintf(stderr, "Invalid switch case, exiting...\n");
-            exit(1);
+    if (addr >= HRAM_A) {
+        return gb->hram[addr - HRAM_A];
+    }
+    if (addr >= IO_A) {
+        return read_io(gb, addr);
+    }
+    if (addr >= UNUSED_A) {
+        fprintf(stderr, "Attempted read at addr %d\n", (int)addr);
+        fprintf(stderr, "Unused/Invalid RAM location, stopping...\n");
+        stop_on_error(gb);
+        return 0xFF;
+    }
+    if (addr >= OAM_A) {
+        return ((uint8_t *)gb->oam)[addr - OAM_A];
+    }
+    if (addr >= ECHO_RAM_A) {
+        fprintf(stderr, "Attempted read at addr %d\n", (int)addr);
+        fprintf(stderr, "Echo RAM unimplemented, stopping...\n");
+        stop_on_error(gb);
+        return 0xFF;
     }
+    if (addr >= EXT_RAM_A) {
+        if (rtc_selected(gb)) {
+            return read_rtc(gb);
+        }
+        // Disabled or missing RAM
+        return 0xFF;
+    }
+    fprintf(stderr, "Attempted read at addr %d\n", (int)addr);
+    fprintf(stderr, "Unmapped page in read path, stopping...\n");
+    stop_on_error(gb);
+    return 0xFF;
+}
 
+uint8_t read_io(gb_t *gb, uint16_t addr) {
     // Handle I/O registers
     switch (addr) {
         case 0xFF00: 
-            switch ((b_buttons_select << 1) | b_dpad_select) {
+            switch ((gb->b_buttons_select << 1) | gb->b_dpad_select) {
                 case 0x3:
-                    return ((((((!(b_start || b_down) << 1) |
-                            !(b_select || b_up)) << 1)  |
-                            !(b_b || b_left)) << 1)     |
-                            !(b_a || b_right)) |
+                    return ((((((!(gb->b_start || gb->b_down) << 1) |
+                            !(gb->b_select || gb->b_up)) << 1)  |
+                            !(gb->b_b || gb->b_left)) << 1)     |
+                            !(gb->b_a || gb->b_right)) |
                             0xC0;
                 case 0x2:
-                    return ((((((!b_start << 1) |
-                            !b_select) << 1) |
-                            !b_b) << 1) |
-                            !b_a) |
+                    return ((((((!gb->b_start << 1) |
+                            !gb->b_select) << 1) |
+                            !gb->b_b) << 1) |
+                            !gb->b_a) |
                             0xD0;
                 case 0x1:
-                    return ((((((!b_down << 1) |
-                            !b_up) << 1) |
-                            !b_left) << 1) |
-                            !b_right) |
+                    return ((((((!gb->b_down << 1) |
+                            !gb->b_up) << 1) |
+                            !gb->b_left) << 1) |
+                            !gb->b_right) |
                             0xE0;
                 default:
                     return 0xFF;
         }
         case 0xFF01:
-            return r_sb;
+            return gb->r_sb;
         case 0xFF02:
-            return r_sc;
+            return gb->r_sc;
         case 0xFF04:
-            return r_div;
+            return gb->r_div;
         case 0xFF05:
-            return r_tima;
+            sync_timer(gb);
+            return gb->r_tima;
         case 0xFF06:
-            return r_tma;
+            return gb->r_tma;
         case 0xFF07:
-            return r_tac;
+            return gb->r_tac;
         case 0xFF0F:
-            return r_if;
-        case 0xFF10:
-            return r_nr10;
-        case 0xFF11:
-            return r_nr11;
-        case 0xFF12:
-            return r_nr12;
-        case 0xFF13:
-            return r_nr13;
-        case 0xFF14:
-            return r_nr14;
-        case 0xFF16:
-            return r_nr21;
-        case 0xFF17:
-            return r_nr22;
-        case 0xFF18:
-            return r_nr23;
-        case 0xFF19:
-            return r_nr24;
-        case 0xFF1A:
-            return r_nr30;
-        case 0xFF1B:
-            return r_nr31;
-        case 0xFF1C:
-            return r_nr32;
-        case 0xFF1D:
-            return r_nr33;
-        case 0xFF1E:
-            return r_nr34;
-        case 0xFF20:
-            return r_nr41;
-        case 0xFF21:
-            return r_nr42;
-        case 0xFF22:
-            return r_nr43;
-        case 0xFF23:
-            return r_nr44;
-        case 0xFF24:
-            return r_nr50;
-        case 0xFF25:
-            return r_nr51;
-        case 0xFF26:
-            return r_nr52;
+            return gb->r_if;
         case 0xFF40:
-            return r_lcdc;
+            return gb->r_lcdc;
         case 0xFF41:
-            return r_stat;
+            return gb->r_stat;
         case 0xFF42:
-            return r_scy;
+            return gb->r_scy;
         case 0xFF43:
-            return r_scx;
+            return gb->r_scx;
         case 0xFF44:
-            return r_ly;
+            return gb->r_ly;
         case 0xFF45:
-            return r_lyc;
+            return gb->r_lyc;
         case 0xFF46:
-            return r_dma;
+            return gb->r_dma;
         case 0xFF47:
-            return r_bgp;
+            return gb->r_bgp;
         case 0xFF48:
-            return r_obp0;
+            return gb->r_obp0;
         case 0xFF49:
-            return r_obp1;
+            return gb->r_obp1;
         case 0xFF4A:
-            return r_wy;
+            return gb->r_wy;
         case 0xFF4B:
-            return r_wx;
+            return gb->r_wx;
         case 0xFF50:
-            return r_boot_rom_mapped;
+            return gb->r_boot_rom_mapped;
     }
 
-    // Wave pattern
-    if (0xFF30 <= addr && addr < 0xFF40) {
-        return m_wave[addr - 0xFF30];
+    // Audio registers and wave pattern
+    if (0xFF10 <= addr && addr < 0xFF40) {
+        return read_apu(gb, addr);
     }
 
     // Leftover memory in IO register range
     if (0xFF00 <= addr && addr < 0xFF80) {
-        return io_reg[addr - IO_A];
+        return gb->io_reg[addr - IO_A];
     }
 
     fprintf(stderr, "Attempted read at addr %d\n", (int)addr);
-    fprintf(stderr, "Unused/Invalid RAM location, exiting...\n");
-    exit(1);
+    fprintf(stderr, "Unused/Invalid RAM location, stopping...\n");
+    stop_on_error(gb);
+    return 0xFF;
 }
 
-void write_mem(uint16_t addr, uint8_t val) {
-    const uint16_t mem_ranges[] = {
-        ROM_A, VRAM_TILES_A, VRAM_MAPS_A, EXT_RAM_A, WRAM_A, 
-        ECHO_RAM_A, OAM_A, UNUSED_A, IO_A, HRAM_A, IE_REG_A
-    };
-
-    switch (bin_search(mem_ranges, 11, addr)) {
-        case 0:
-            // fprintf(stderr, "Attempted write at addr %d\n", (int)addr);
-            // fprintf(stderr, "Cannot write to ROM, exiting...\n");
-            // exit(1);
-            // TODO: Handle the case of the tetris rom writing to this range
-            return;
-        case 1:
-            ((uint8_t *)vram_tiles)[addr - VRAM_TILES_A] = val;
-            return;
-        case 2:
-            ((uint8_t *)vram_maps)[addr - VRAM_MAPS_A] = val;
-            return;
-        case 3:
-            fprintf(stderr, "Attempted write at addr %d\n", (int)addr);
-            fprintf(stderr, "External RAM unimplemented, exiting...\n");
-            exit(1);
-        case 4:
-            wram[addr - WRAM_A] = val;
-            return;
-        case 5:
-            fprintf(stderr, "Attempted write at addr %d\n", (int)addr);
-            fprintf(stderr, "Echo RAM unimplemented, exiting...\n");
-            exit(1);
-        case 6:
-            ((uint8_t *)oam)[addr - OAM_A] = val;
-            return;
-        case 7:
-            // fprintf(stderr, "Attempted write at addr %d\n", (int)addr);
-            // fprintf(stderr, "Unused/Invalid RAM location, exiting...\n");
-            // exit(1);
-            // TODO: Handle the case of the tetris rom writing to this range
-            return;
-        case 8:
-            break; // handled after this switch
-        case 9:
-            hram[addr - HRAM_A] = val;
-            return;
-        case 10:
-            r_ie = val;
+// Handles pages that are not directly mapped: ROM, external RAM, echo RAM,
+// OAM and the unused area after it, I/O registers, HRAM and IE.
+void write_mem_slow(gb_t *gb, uint16_t addr, uint8_t val) {
+    if (addr == IE_REG_A) {
+        gb->r_ie = val;
+        return;
+    }
+    if (addr >= HRAM_A) {
+        gb->hram[addr - HRAM_A] = val;
+        return;
+    }
+    if (addr >= IO_A) {
+        write_io(gb, addr, val);
+        return;
+    }
+    if (addr >= UNUSED_A) {
+        // fprintf(stderr, "Attempted write at addr %d\n", (int)addr);
+        // fprintf(stderr, "Unused/Invalid RAM location, exiting...\n");
+        // exit(1);
+        // TODO: Handle the case of the tetris rom writing to this range
+        return;
+    }
+    if (addr >= OAM_A) {
+        ((uint8_t *)gb->oam)[addr - OAM_A] = val;
+        return;
+    }
+    if (addr >= ECHO_RAM_A) {
+        fprintf(stderr, "Attempted write at addr %d\n", (int)addr);
+        fprintf(stderr, "Echo RAM unimplemented, stopping...\n");
+        stop_on_error(gb);
+        return;
+    }
+    if (addr >= EXT_RAM_A) {
+        if (rtc_selected(gb)) {
+            write_rtc(gb, val);
             return;
-        default:
-            fprintf(stderr, "Attempted write at addr %d\n", (int)addr);
-            fprintf(stderr, "Invalid switch case, exiting...\n");
-            exit(1);
+        }
+        write_ext_ram(gb, addr, val);
+        return;
+    }
+    if (VRAM_TILES_A <= addr && addr < VRAM_MAPS_A) {
+        write_tile_data(gb, addr, val);
+        return;
+    }
+    if (addr < VRAM_TILES_A) {
+        write_mbc(gb, addr, val);
+        return;
+    }
+    fprintf(stderr, "Attempted write at addr %d\n", (int)addr);
+    fprintf(stderr, "Unmapped page in write path, stopping...\n");
+    stop_on_error(gb);
+}
+
+// Appends a byte to serial_out. Once the buffer fills up the older half is
+// dropped, since test ROMs print their verdict last.
+static void record_serial_byte(gb_t *gb, uint8_t val) {
+    if (gb->serial_out_len == SERIAL_OUT_SIZE) {
+        size_t keep = SERIAL_OUT_SIZE / 2;
+        memmove(gb->serial_out, gb->serial_out + SERIAL_OUT_SIZE - keep, keep);
+        gb->serial_out_len = keep;
+    }
+    gb->serial_out[gb->serial_out_len++] = (char)val;
+    gb->serial_out[gb->serial_out_len] = '\0';
+}
+
+// Copies a page to OAM. The transfer is done at once instead of over the 160
+// machine cycles it takes, which games spend waiting in HRAM anyway.
+static void start_oam_dma(gb_t *gb) {
+    // Sources past WRAM read its echo
+    uint8_t page = gb->r_dma >= 0xE0 ? gb->r_dma - 0x20 : gb->r_dma;
+    uint8_t *oam = (uint8_t *)gb->oam;
+    for (size_t i = 0; i < OBJ_NUM * OBJ_SIZE; i++) {
+        oam[i] = read_mem(gb, (uint16_t)((page << 8) + i));
+    }
+}
+
+void write_io(gb_t *gb, uint16_t addr, uint8_t val) {
+    // Let the PPU catch up before changing anything that affects rendering
+    if (0xFF40 <= addr && addr <= 0xFF4B) {
+        sync_display(gb);
     }
 
     // Handle I/O registers
     switch (addr) {
         case 0xFF00:
-            b_buttons_select = !!(val & 0x20);
-            b_dpad_select = !!(val & 0x10);
+            gb->b_buttons_select = !!(val & 0x20);
+            gb->b_dpad_select = !!(val & 0x10);
             return;
         case 0xFF01:
-            r_sb = val;
+            gb->r_sb = val;
             return;
         case 0xFF02:
             // TODO: Recheck this logic
             switch (val & 0x81) {
-                case 0x80:
-                    fprintf(stderr, 
-                            "Attempted serial connection as slave at addr %d\n",
-                            (int)addr);
-                    fprintf(stderr, "Not yet implemented, exiting...\n");
-                    exit(1);
                 case 0x81:
                     // Hack to make Blargg's test roms work
-                    printf("%c", r_sb);
+                    if (gb->print_serial) {
+                        printf("%c", gb->r_sb);
+                    }
+                    record_serial_byte(gb, gb->r_sb);
                     break;
                 default:
-                    r_sc = val;
+                    // No link cable is attached, so a transfer on the
+                    // external clock never completes
+                    gb->r_sc = val;
                     return;
             }
-            r_sc = 0;
-            r_if |= 0x8; // request serial interrupt
+            gb->r_sc = 0;
+            gb->r_if |= 0x8; // request serial interrupt
             return;
         case 0xFF04:
-            r_div = 0;
+            gb->r_div = 0;
             return;
         case 0xFF05:
-            r_tima = val;
+            sync_timer(gb);
+            gb->r_tima = val;
+            schedule_tima_event(gb);
             return;
         case 0xFF06:
-            r_tma = val;
+            sync_timer(gb);
+            gb->r_tma = val;
             return;
         case 0xFF07:
-            r_tac = val;
+            sync_timer(gb);
+            gb->r_tac = val;
+            schedule_tima_event(gb);
             return;        
         case 0xFF0F:
-            r_if = val;
-            return;
-        case 0xFF10:
-            r_nr10 = val;
-            return;
-        case 0xFF11:
-            r_nr11 = val;
-            return;
-        case 0xFF12:
-            r_nr12 = val;
-            return;
-        case 0xFF13:
-            r_nr13 = val;
-            return;
-        case 0xFF14:
-            r_nr14 = val;
-            return;
-        case 0xFF16:
-            r_nr21 = val;
-            return;
-        case 0xFF17:
-            r_nr22 = val;
-            return;
-        case 0xFF18:
-            r_nr23 = val;
-            return;
-        case 0xFF19:
-            r_nr24 = val;
-            return;
-        case 0xFF1A:
-            r_nr30 = val;
-            return;
-        case 0xFF1B:
-            r_nr31 = val;
-            return;
-        case 0xFF1C:
-            r_nr32 = val;
-            return;
-        case 0xFF1D:
-            r_nr33 = val;
-            return;
-        case 0xFF1E:
-            r_nr34 = val;
-            return;
-        case 0xFF20:
-            r_nr41 = val;
-            return;
-        case 0xFF21:
-            r_nr42 = val;
-            return;
-        case 0xFF22:
-            r_nr43 = val;
-            return;
-        case 0xFF23:
-            r_nr44 = val;
-            return;
-        case 0xFF24:
-            r_nr50 = val;
-            return;
-        case 0xFF25:
-            r_nr51 = val;
-            return;
-        case 0xFF26:
-            r_nr52 = val;
+            gb->r_if = val;
             return;
         case 0xFF40:
-            r_lcdc = val;
+            gb->r_lcdc = val;
+            schedule_ppu_event(gb);
             return;
         case 0xFF41:
-            r_stat = val;
+            gb->r_stat = val;
+            update_stat_reg(gb);
             return;
         case 0xFF42:
-            r_scy = val;
+            gb->r_scy = val;
             return;
         case 0xFF43:
-            r_scx = val;
+            gb->r_scx = val;
             return;
         case 0xFF44:
             // Ignore writes to LY (read-only)
             return;
         case 0xFF45:
-            r_lyc = val;
+            gb->r_lyc = val;
+            update_stat_reg(gb);
             return;
         case 0xFF46:
-            r_dma = val;
+            gb->r_dma = val;
+            start_oam_dma(gb);
             return;
         case 0xFF47:
-            r_bgp = val;
+            gb->r_bgp = val;
             return;
         case 0xFF48:
-            r_obp0 = val;
+            gb->r_obp0 = val;
             return;
         case 0xFF49:
-            r_obp1 = val;
+            gb->r_obp1 = val;
             return;
         case 0xFF4A:
-            r_wy = val;
+            gb->r_wy = val;
             return;
         case 0xFF4B:
-            r_wx = val;
+            gb->r_wx = val;
             return;
         case 0xFF50:
-            r_boot_rom_mapped = val;
+            gb->r_boot_rom_mapped = val;
+            update_boot_rom_page(gb);
             return;
     }
 
-    // Wave pattern
-    if (0xFF30 <= addr && addr < 0xFF40) {
-        m_wave[addr - 0xFF30] = val;
+    // Audio registers and wave pattern
+    if (0xFF10 <= addr && addr < 0xFF40) {
+        write_apu(gb, addr, val);
         return;
     }
 
     // Leftover memory in IO register range
     if (0xFF00 <= addr && addr < 0xFF80) {
-        io_reg[addr - IO_A] = val;
+        gb->io_reg[addr - IO_A] = val;
         return;
     }
 
     fprintf(stderr, "Attempted write at addr %d\n", (int)addr);
-    fprintf(stderr, "Unused/Invalid RAM location, exiting...\n");
-    exit(1);
+    fprintf(stderr, "Unused/Invalid RAM location, stopping...\n");
+    stop_on_error(gb);
 }
 
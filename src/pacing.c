@@ -0,0 +1,115 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pacing.h>
+#include <display.h>
+#include <mbc.h>
+#include <SDL3/SDL.h>
+
+// Multipliers of the hardware frame rate, 0 for uncapped
+static const double speeds[PACING_SPEED_NUM] = {
+    0.25, 0.5, 1.0, 2.0, 4.0, 0.0
+};
+
+static uint64_t get_time_ns(const pacer_t *pacer) {
+    uint64_t ticks = SDL_GetPerformanceCounter();
+    // Split to keep ticks * 1e9 from overflowing
+    return (ticks / pacer->freq) * 1000000000 +
+           (ticks % pacer->freq) * 1000000000 / pacer->freq;
+}
+
+pacer_t *init_pacer(void) {
+    pacer_t *pacer = calloc(1, sizeof(pacer_t));
+    if (!pacer) {
+        fprintf(stderr, "Failed to allocate pacing state, exiting...\n");
+        exit(1);
+    }
+    pacer->freq = SDL_GetPerformanceFrequency();
+    pacer->spin_ns = PACING_SPIN_NS;
+    set_pacer_speed(pacer, PACING_NORMAL_SPEED);
+    return pacer;
+}
+
+void free_pacer(pacer_t *pacer) {
+    free(pacer);
+}
+
+// Changes the speed, starting a new schedule from now
+void set_pacer_speed(pacer_t *pacer, size_t speed) {
+    pacer->speed = speed;
+    pacer->frame_ns = 0;
+    if (speeds[speed] > 0) {
+        pacer->frame_ns = (uint64_t)(1e9 * DOTS_PER_FRAME / DOTS_PER_SECOND /
+                                     speeds[speed]);
+    }
+    pacer->deadline = get_time_ns(pacer) + pacer->frame_ns;
+    pacer->late = false;
+}
+
+// Returns the speed multiplier, 0 if uncapped
+double get_pacer_speed(const pacer_t *pacer) {
+    return speeds[pacer->speed];
+}
+
+// Sleeps until spin_ns before the deadline, then spins the rest of the way,
+// since a sleep can overshoot by a scheduler quantum. Sleeps that overshoot
+// into the spin window widen it, and it narrows again slowly otherwise.
+static void wait_until(pacer_t *pacer, uint64_t deadline) {
+    uint64_t now = get_time_ns(pacer);
+    if (now + pacer->spin_ns < deadline) {
+        uint64_t wake = deadline - pacer->spin_ns;
+        SDL_DelayNS(wake - now);
+        now = get_time_ns(pacer);
+        uint64_t overshoot = now > wake ? now - wake : 0;
+        if (overshoot + PACING_MIN_SPIN_NS > pacer->spin_ns) {
+            pacer->spin_ns = overshoot + PACING_MIN_SPIN_NS;
+            if (pacer->spin_ns > PACING_MAX_SPIN_NS) {
+                pacer->spin_ns = PACING_MAX_SPIN_NS;
+            }
+        } else if (pacer->spin_ns > PACING_MIN_SPIN_NS) {
+            pacer->spin_ns -= pacer->spin_ns / 64;
+        }
+    }
+    while (now < deadline) {
+        now = get_time_ns(pacer);
+    }
+
+    uint64_t late = now - deadline;
+    pacer->waits++;
+    pacer->late_ns_total += late;
+    if (late > pacer->late_ns_max) {
+        pacer->late_ns_max = late;
+    }
+}
+
+// Waits until the current frame is due and moves on to the next one. A run
+// that lags too far behind, e.g. after the process was suspended, starts a
+// new schedule instead of racing to catch up.
+void pace_frame(pacer_t *pacer) {
+    if (pacer->frame_ns == 0) {
+        // Nothing is ever due when uncapped, so frames are never late
+        pacer->late = false;
+        return;
+    }
+    uint64_t now = get_time_ns(pacer);
+    pacer->late = now > pacer->deadline;
+    if (now > pacer->deadline + PACING_MAX_LAG_NS) {
+        pacer->deadline = now + pacer->frame_ns;
+        pacer->resyncs++;
+        return;
+    }
+    if (now < pacer->deadline) {
+        wait_until(pacer, pacer->deadline);
+    }
+    pacer->deadline += pacer->frame_ns;
+}
+
+void print_pacer_stats(const pacer_t *pacer) {
+    double mean_us = pacer->waits ?
+        pacer->late_ns_total / 1000.0 / pacer->waits : 0.0;
+    fprintf(stderr, "Frame waits: %lu, late by %.1f us on average, "
+            "%.1f us at most\n", pacer->waits, mean_us,
+            pacer->late_ns_max / 1000.0);
+    fprintf(stderr, "Pacing resyncs: %lu\n", pacer->resyncs);
+}
@@ -0,0 +1,264 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <rewind.h>
+#include <state.h>
+
+// Records are 8-byte aligned in the ring buffer: a header, then the delta
+typedef struct {
+    size_t prev;           // offset of the previous record
+    uint32_t size;         // delta size in bytes
+    uint32_t key_distance; // frames since the last keyframe, 0 for keyframes
+} record_t;
+
+#define RECORD_ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+rewind_t *init_rewind(gb_t *gb, size_t capacity) {
+    rewind_t *rw = calloc(1, sizeof(rewind_t));
+    if (!rw) {
+        fprintf(stderr, "Failed to allocate rewind buffer, exiting...\n");
+        exit(1);
+    }
+    rw->capacity = capacity;
+    rw->state_size = get_state_size(gb);
+    rw->buf = malloc(capacity);
+    rw->key = calloc(1, rw->state_size);
+    rw->cur = malloc(rw->state_size);
+    // Worst case, every literal run is a single byte between two tokens
+    rw->delta = malloc(rw->state_size * 2);
+    if (!rw->buf || !rw->key || !rw->cur || !rw->delta) {
+        fprintf(stderr, "Failed to allocate rewind buffer, exiting...\n");
+        exit(1);
+    }
+    return rw;
+}
+
+void free_rewind(rewind_t *rw) {
+    free(rw->delta);
+    free(rw->cur);
+    free(rw->key);
+    free(rw->buf);
+    free(rw);
+}
+
+static size_t put_varint(uint8_t *out, size_t val) {
+    size_t len = 0;
+    while (val >= 0x80) {
+        out[len++] = (uint8_t)(val | 0x80);
+        val >>= 7;
+    }
+    out[len++] = (uint8_t)val;
+    return len;
+}
+
+static size_t get_varint(const uint8_t *in, size_t *pos) {
+    size_t val = 0;
+    for (size_t shift = 0;; shift += 7) {
+        uint8_t byte = in[(*pos)++];
+        val |= (size_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return val;
+        }
+    }
+}
+
+static inline uint64_t load64(const uint8_t *p) {
+    uint64_t val;
+    memcpy(&val, p, sizeof(val));
+    return val;
+}
+
+// Encodes cur XOR key as a list of (unchanged length, changed length,
+// changed bytes XOR key) runs. Unchanged bytes are skipped a word at a time,
+// and unchanged runs shorter than a word stay inside the changed run.
+static size_t encode_delta(const uint8_t *cur, const uint8_t *key,
+                           size_t size, uint8_t *out) {
+    size_t len = 0;
+    size_t i = 0;
+    for (;;) {
+        size_t start = i;
+        while (i + 8 <= size && load64(cur + i) == load64(key + i)) {
+            i += 8;
+        }
+        while (i < size && cur[i] == key[i]) {
+            i++;
+        }
+        if (i == size) {
+            return len;
+        }
+
+        size_t changed = i;
+        while (i < size) {
+            if (cur[i] != key[i]) {
+                i++;
+                continue;
+            }
+            size_t same = i;
+            while (same < size && same - i < 8 && cur[same] == key[same]) {
+                same++;
+            }
+            if (same - i == 8 || same == size) {
+                break;
+            }
+            i = same;
+        }
+
+        len += put_varint(out + len, changed - start);
+        len += put_varint(out + len, i - changed);
+        for (size_t j = changed; j < i; j++) {
+            out[len++] = cur[j] ^ key[j];
+        }
+    }
+}
+
+static void apply_delta(uint8_t *state, const uint8_t *delta, size_t size) {
+    size_t pos = 0;
+    size_t i = 0;
+    while (pos < size) {
+        i += get_varint(delta, &pos);
+        size_t changed = get_varint(delta, &pos);
+        for (size_t j = 0; j < changed; j++) {
+            state[i + j] ^= delta[pos + j];
+        }
+        i += changed;
+        pos += changed;
+    }
+}
+
+static record_t *get_record(rewind_t *rw, size_t offset) {
+    return (record_t *)(rw->buf + offset);
+}
+
+static void drop_oldest(rewind_t *rw) {
+    record_t *record = get_record(rw, rw->head);
+    size_t next = rw->head + RECORD_ALIGN(sizeof(record_t) + record->size);
+    rw->count--;
+    if (rw->count == 0) {
+        rw->head = rw->tail = 0;
+        rw->wrapped = false;
+    } else if (rw->wrapped && next == rw->wrap) {
+        rw->head = 0;
+        rw->wrapped = false;
+    } else {
+        rw->head = next;
+    }
+}
+
+// Makes room for a record of size bytes at tail, dropping the oldest records
+// as needed. Returns false if it can't fit at all.
+static bool reserve_record(rewind_t *rw, size_t size) {
+    if (size > rw->capacity) {
+        return false;
+    }
+    for (;;) {
+        if (!rw->wrapped) {
+            if (rw->tail + size <= rw->capacity) {
+                return true;
+            }
+            if (rw->count == 0) {
+                rw->head = rw->tail = 0;
+                continue;
+            }
+            rw->wrap = rw->tail;
+            rw->tail = 0;
+            rw->wrapped = true;
+        }
+        if (rw->tail + size <= rw->head) {
+            return true;
+        }
+        drop_oldest(rw);
+    }
+}
+
+// Records the state at the end of a frame. Costs a save state and one pass
+// over it to encode the changes since the last keyframe.
+void record_frame(rewind_t *rw, gb_t *gb) {
+    save_state(gb, rw->cur);
+
+    uint32_t key_distance = 0;
+    if (rw->count > 0) {
+        key_distance = get_record(rw, rw->newest)->key_distance + 1;
+        if (key_distance == REWIND_KEY_INTERVAL) {
+            key_distance = 0;
+        }
+    }
+
+    // A keyframe is stored as a delta against the previous keyframe, so that
+    // applying it again while rewinding gets the previous one back
+    size_t delta_size = encode_delta(rw->cur, rw->key, rw->state_size,
+                                     rw->delta);
+    size_t size = RECORD_ALIGN(sizeof(record_t) + delta_size);
+    if (!reserve_record(rw, size)) {
+        // Drop the whole history rather than leave a gap in it
+        while (rw->count > 0) {
+            drop_oldest(rw);
+        }
+        return;
+    }
+
+    record_t *record = get_record(rw, rw->tail);
+    record->prev = rw->newest;
+    record->size = (uint32_t)delta_size;
+    record->key_distance = key_distance;
+    memcpy(record + 1, rw->delta, delta_size);
+    rw->newest = rw->tail;
+    rw->tail += size;
+    rw->count++;
+
+    if (key_distance == 0) {
+        uint8_t *tmp = rw->key;
+        rw->key = rw->cur;
+        rw->cur = tmp;
+    }
+}
+
+// Drops the newest record, going back to the keyframe before it if needed
+static void drop_newest(rewind_t *rw) {
+    record_t *record = get_record(rw, rw->newest);
+    if (record->key_distance == 0) {
+        apply_delta(rw->key, (uint8_t *)(record + 1), record->size);
+    }
+    rw->tail = rw->newest;
+    rw->newest = record->prev;
+    rw->count--;
+    if (rw->wrapped && rw->tail == 0) {
+        rw->tail = rw->wrap;
+        rw->wrapped = false;
+    }
+}
+
+// Goes back to the state at the end of the previous recorded frame, or stays
+// at the oldest one. The frame after it is run silently to redraw the
+// framebuffer. Returns false if nothing has been recorded.
+bool rewind_frame(rewind_t *rw, gb_t *gb) {
+    if (rw->count == 0) {
+        return false;
+    }
+    if (rw->count > 1) {
+        drop_newest(rw);
+    }
+
+    record_t *record = get_record(rw, rw->newest);
+    const uint8_t *state = rw->key;
+    if (record->key_distance != 0) {
+        memcpy(rw->cur, rw->key, rw->state_size);
+        apply_delta(rw->cur, (uint8_t *)(record + 1), record->size);
+        state = rw->cur;
+    }
+    if (!load_state(gb, state, rw->state_size)) {
+        return false;
+    }
+
+    bool print_serial = gb->print_serial;
+    bool output_audio = gb->output_audio;
+    gb->print_serial = false;
+    gb->output_audio = false;
+    run_frame(gb, UINT64_MAX);
+    gb->print_serial = print_serial;
+    gb->output_audio = output_audio;
+
+    load_state(gb, state, rw->state_size);
+    return true;
+}
@@ -2,19 +2,16 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <rom.h>
 
 #define DMG_BOOT_ROM_SIZE 256
 
-bool rom_loaded = false;
-
-uint8_t cgb_flag;
-uint8_t sgb_flag;
-uint8_t rom_type;
-size_t rom_size;
-size_t ram_size;
-uint8_t *rom = NULL;
-
 uint8_t dmg_boot_rom[DMG_BOOT_ROM_SIZE] = {
     0x31, 0xfe, 0xff, 0xaf, 0x21, 0xff, 0x9f, 0x32,
     0xcb, 0x7c, 0x20, 0xfb, 0x21, 0x26, 0xff, 0x0e,
@@ -50,71 +47,207 @@ uint8_t dmg_boot_rom[DMG_BOOT_ROM_SIZE] = {
     0xfb, 0x86, 0x20, 0xfe, 0x3e, 0x01, 0xe0, 0x50
 };
 
-void load_rom_error() {
+// A ROM file loaded into memory. Instances loading the same file share one
+// image, which is released when the last of them is freed.
+struct rom_image {
+    rom_image_t *next;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime; // a rewritten file gets a new image
+    uint8_t *data;
+    size_t size;
+    bool mapped; // mmap'd, otherwise read into the heap
+    size_t refs;
+};
+
+static rom_image_t *rom_cache = NULL;
+static pthread_mutex_t rom_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Reports why the ROM couldn't be loaded. Always returns NULL.
+static rom_image_t *load_rom_error(const char *rom_path, int rom_fd) {
     perror("Error loading ROM");
-    exit(1);
+    fprintf(stderr, "ROM path: %s\n", rom_path);
+    if (rom_fd != -1) {
+        close(rom_fd);
+    }
+    return NULL;
 }
 
-void load_rom(const char *rom_path) {
-    FILE *rom_file = fopen(rom_path, "r");
+// Reads the whole file into the heap, for files that can't be mapped
+static uint8_t *read_rom_file(int rom_fd, size_t size) {
+    uint8_t *data = malloc(size);
+    if (!data) {
+        return NULL;
+    }
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(rom_fd, data + done, size - done, (off_t)done);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (n == 0) {
+                errno = EIO; // the file shrank while being read
+            }
+            free(data);
+            return NULL;
+        }
+        done += (size_t)n;
+    }
+    return data;
+}
 
-    if (!rom_file) {
-        load_rom_error();
+// Returns the cached image of the file, mapping it read-only on first use.
+// Pages are only faulted in as the game touches them, so loading takes the
+// same time whatever the ROM size. Returns NULL if the file can't be loaded.
+static rom_image_t *open_rom_image(const char *rom_path) {
+    int rom_fd = open(rom_path, O_RDONLY);
+    if (rom_fd == -1) {
+        return load_rom_error(rom_path, rom_fd);
     }
 
-    if (fseek(rom_file, 0, SEEK_END) == -1) {
-        load_rom_error();
+    struct stat st;
+    if (fstat(rom_fd, &st) == -1) {
+        return load_rom_error(rom_path, rom_fd);
     }
 
-    if (ftell(rom_file) == -1L) {
-        load_rom_error();
+    if (st.st_size < 0x8000) {
+        fprintf(stderr, "ROM is smaller than 32KiB: %s\n", rom_path);
+        close(rom_fd);
+        return NULL;
     }
 
-    rom_size = (size_t)ftell(rom_file);
+    // Images are loaded with the lock held so that instances starting
+    // together on the same file don't each load a copy
+    pthread_mutex_lock(&rom_cache_lock);
+
+    rom_image_t *image;
+    for (image = rom_cache; image; image = image->next) {
+        if (image->dev == st.st_dev && image->ino == st.st_ino &&
+            image->size == (size_t)st.st_size &&
+            image->mtime.tv_sec == st.st_mtim.tv_sec &&
+            image->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            image->refs++;
+            pthread_mutex_unlock(&rom_cache_lock);
+            close(rom_fd);
+            return image;
+        }
+    }
 
-    if (fseek(rom_file, 0, SEEK_SET) == -1) {
-        load_rom_error();
+    image = calloc(1, sizeof(rom_image_t));
+    if (!image) {
+        pthread_mutex_unlock(&rom_cache_lock);
+        return load_rom_error(rom_path, rom_fd);
+    }
+    image->dev = st.st_dev;
+    image->ino = st.st_ino;
+    image->mtime = st.st_mtim;
+    image->size = (size_t)st.st_size;
+
+    void *data = mmap(NULL, image->size, PROT_READ, MAP_PRIVATE, rom_fd, 0);
+    if (data != MAP_FAILED) {
+        image->data = data;
+        image->mapped = true;
+    } else {
+        image->data = read_rom_file(rom_fd, image->size);
+        if (!image->data) {
+            pthread_mutex_unlock(&rom_cache_lock);
+            free(image);
+            return load_rom_error(rom_path, rom_fd);
+        }
     }
-    
-    rom = malloc(rom_size);
+    close(rom_fd);
 
-    if (rom_size != fread(rom, sizeof(uint8_t), rom_size, rom_file)) {
-        load_rom_error();
+    image->refs = 1;
+    image->next = rom_cache;
+    rom_cache = image;
+
+    pthread_mutex_unlock(&rom_cache_lock);
+    return image;
+}
+
+static void release_rom_image(rom_image_t *image) {
+    pthread_mutex_lock(&rom_cache_lock);
+    if (--image->refs > 0) {
+        pthread_mutex_unlock(&rom_cache_lock);
+        return;
     }
+    for (rom_image_t **link = &rom_cache; *link; link = &(*link)->next) {
+        if (*link == image) {
+            *link = image->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&rom_cache_lock);
 
-    if (ferror(rom_file) != 0) {
-        load_rom_error();
+    if (image->mapped) {
+        munmap(image->data, image->size);
+    } else {
+        free(image->data);
     }
+    free(image);
+}
 
-    cgb_flag = rom[0x143];
-    sgb_flag = rom[0x146];
-    rom_type = rom[0x147];
-    rom_size = 0x8000 * (1 << rom[0x148]);
+// Loads the ROM and parses its header. Returns false if it can't be used.
+bool load_rom(gb_t *gb, const char *rom_path) {
+    gb->rom_image = open_rom_image(rom_path);
+    if (!gb->rom_image) {
+        return false;
+    }
+    gb->rom = gb->rom_image->data;
+    gb->rom_size = gb->rom_image->size;
+
+    gb->cgb_flag = gb->rom[0x143];
+    gb->sgb_flag = gb->rom[0x146];
+    gb->rom_type = gb->rom[0x147];
+
+    // Bank switching indexes the image directly, so it must hold every bank
+    // the header declares
+    if (gb->rom[0x148] > 8) {
+        fprintf(stderr, "Invalid cart ROM size: %s\n", rom_path);
+        return false;
+    }
+    size_t header_rom_size = (size_t)0x8000 << gb->rom[0x148];
+    if (gb->rom_size < header_rom_size) {
+        fprintf(stderr, "ROM is smaller than its header says: %s\n",
+                rom_path);
+        return false;
+    }
+    gb->rom_size = header_rom_size;
+    gb->rom_bank_num = gb->rom_size / ROM_BANK_SIZE;
 
-    switch (rom[0x148]) {
+    switch (gb->rom[0x149]) {
         case 0:
-            ram_size = 0;
+            gb->ram_size = 0;
+            break;
+        case 1:
+            gb->ram_size = 0x800;
             break;
         case 2:
-            ram_size = 0x2000;
+            gb->ram_size = 0x2000;
             break;
         case 3:
-            ram_size = 0x8000;
+            gb->ram_size = 0x8000;
             break;
         case 4:
-            ram_size = 0x20000;
+            gb->ram_size = 0x20000;
             break;
         case 5:
-            ram_size = 0x10000;
+            gb->ram_size = 0x10000;
             break;
         default:
-            fprintf(stderr, "Invalid cart RAM size\n");
-            exit(1);
+            fprintf(stderr, "Invalid cart RAM size: %s\n", rom_path);
+            return false;
     }
 
-    rom_loaded = true;
+    gb->rom_loaded = true;
+    return true;
 }
 
-void free_rom(void) {
-    free(rom);
+void free_rom(gb_t *gb) {
+    if (gb->rom_image) {
+        release_rom_image(gb->rom_image);
+    }
+    gb->rom_image = NULL;
+    gb->rom = NULL;
 }
\ No newline at end of file
@@ -0,0 +1,52 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <runahead.h>
+#include <state.h>
+
+run_ahead_t *init_run_ahead(gb_t *gb, size_t frames) {
+    run_ahead_t *ra = calloc(1, sizeof(run_ahead_t));
+    if (!ra) {
+        fprintf(stderr, "Failed to allocate run-ahead state, exiting...\n");
+        exit(1);
+    }
+    ra->frames = frames;
+    ra->state_size = get_state_size(gb);
+    ra->state = malloc(ra->state_size);
+    if (!ra->state) {
+        fprintf(stderr, "Failed to allocate run-ahead state, exiting...\n");
+        exit(1);
+    }
+    return ra;
+}
+
+void free_run_ahead(run_ahead_t *ra) {
+    free(ra->state);
+    free(ra);
+}
+
+// Replaces the framebuffer with the frame that comes ra->frames frames later
+// if the current input is held, and leaves the rest of the machine as it
+// was. Games that only react to input a frame or two after reading it then
+// show the reaction right away.
+void run_ahead(run_ahead_t *ra, gb_t *gb) {
+    save_state(gb, ra->state);
+
+    bool print_serial = gb->print_serial;
+    bool output_audio = gb->output_audio;
+    bool skip_draw = gb->skip_draw;
+    gb->print_serial = false;
+    gb->output_audio = false;
+    for (size_t i = 0; i < ra->frames; i++) {
+        // Only the last frame is shown
+        gb->skip_draw = skip_draw || i + 1 < ra->frames;
+        run_frame(gb, UINT64_MAX);
+    }
+    gb->print_serial = print_serial;
+    gb->output_audio = output_audio;
+    gb->skip_draw = skip_draw;
+
+    // The framebuffer isn't part of the state, so it keeps the last frame run
+    load_state(gb, ra->state, ra->state_size);
+}
@@ -0,0 +1,118 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sav.h>
+#include <mbc.h>
+#include <scheduler.h>
+#include <util.h>
+
+// Reports why the save file can't be used. Always returns false.
+static bool sav_error(char *sav_path, int sav_fd) {
+    perror("Error opening save file");
+    fprintf(stderr, "Save path: %s\n", sav_path);
+    fprintf(stderr, "Cart RAM won't be saved\n");
+    if (sav_fd != -1) {
+        close(sav_fd);
+    }
+    free(sav_path);
+    return false;
+}
+
+// Backs battery RAM with a shared mapping of the save file next to the ROM,
+// created if it doesn't exist yet. Must be called before the instance runs.
+// Returns false if the file can't be used, in which case RAM stays volatile.
+bool open_sav(gb_t *gb, const char *rom_path) {
+    if (!gb->has_battery || !gb->ram_size) {
+        return true;
+    }
+
+    char *sav_path = replace_extension(rom_path, ".sav");
+    int sav_fd = open(sav_path, O_RDWR | O_CREAT, 0644);
+    if (sav_fd == -1) {
+        return sav_error(sav_path, sav_fd);
+    }
+
+    // A new or short file is zero-filled up to the RAM size
+    struct stat st;
+    if (fstat(sav_fd, &st) == -1) {
+        return sav_error(sav_path, sav_fd);
+    }
+    if ((size_t)st.st_size < gb->ram_size &&
+        ftruncate(sav_fd, (off_t)gb->ram_size) == -1) {
+        return sav_error(sav_path, sav_fd);
+    }
+
+    void *ram = mmap(NULL, gb->ram_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     sav_fd, 0);
+    if (ram == MAP_FAILED) {
+        return sav_error(sav_path, sav_fd);
+    }
+    close(sav_fd);
+    free(sav_path);
+
+    free(gb->ext_ram);
+    gb->ext_ram = ram;
+    gb->sav_mapped = true;
+    memset(gb->ext_ram_dirty, 0, sizeof(gb->ext_ram_dirty));
+    map_ext_ram(gb);
+
+    schedule_event(gb, EVENT_SAV, gb->dots + SAV_FLUSH_DOTS);
+    return true;
+}
+
+// Writes the dirty RAM pages back to the save file, waiting for the writes
+// to complete if wait is set. The pages are unmapped for writing again, so
+// the next write to each marks it dirty.
+void flush_sav(gb_t *gb, bool wait) {
+    if (!gb->sav_mapped) {
+        return;
+    }
+
+    // msync needs an address aligned to the OS page size
+    size_t os_page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t page_num = gb->ram_size / PAGE_SIZE;
+    bool flushed = false;
+    size_t i = 0;
+    while (i < page_num) {
+        if (!gb->ext_ram_dirty[i]) {
+            i++;
+            continue;
+        }
+        size_t start = (i * PAGE_SIZE) & ~(os_page_size - 1);
+        while (i < page_num && gb->ext_ram_dirty[i]) {
+            gb->ext_ram_dirty[i] = false;
+            i++;
+        }
+        if (msync(gb->ext_ram + start, (i * PAGE_SIZE) - start,
+                  wait ? MS_SYNC : MS_ASYNC) == -1) {
+            perror("Error writing save file");
+        }
+        flushed = true;
+    }
+
+    if (flushed) {
+        map_ext_ram(gb);
+    }
+}
+
+// Flushes and unmaps the save file. RAM is unavailable afterwards.
+void close_sav(gb_t *gb) {
+    if (!gb->sav_mapped) {
+        return;
+    }
+    flush_sav(gb, true);
+    munmap(gb->ext_ram, gb->ram_size);
+    gb->ext_ram = NULL;
+    gb->sav_mapped = false;
+}
+
+void sav_event(gb_t *gb) {
+    flush_sav(gb, false);
+    schedule_event(gb, EVENT_SAV, gb->dots + SAV_FLUSH_DOTS);
+}
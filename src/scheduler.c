@@ -0,0 +1,110 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <scheduler.h>
+#include <cpu.h>
+#include <display.h>
+#include <sav.h>
+#include <apu.h>
+
+static void (*const event_handlers[EVENT_NUM])(gb_t *gb) = {
+    [EVENT_DIV] = div_event,
+    [EVENT_TIMA] = tima_event,
+    [EVENT_PPU] = ppu_event,
+    [EVENT_SAV] = sav_event,
+    [EVENT_APU] = apu_event,
+};
+
+static void heap_swap(gb_t *gb, size_t i, size_t j) {
+    event_t tmp = gb->heap[i];
+    gb->heap[i] = gb->heap[j];
+    gb->heap[j] = tmp;
+    gb->heap_slot[gb->heap[i].id] = i + 1;
+    gb->heap_slot[gb->heap[j].id] = j + 1;
+}
+
+static void sift_up(gb_t *gb, size_t i) {
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (gb->heap[parent].time <= gb->heap[i].time) {
+            return;
+        }
+        heap_swap(gb, i, parent);
+        i = parent;
+    }
+}
+
+static void sift_down(gb_t *gb, size_t i) {
+    for (;;) {
+        size_t left = (2 * i) + 1;
+        size_t right = left + 1;
+        size_t min = i;
+        if (left < gb->heap_size && gb->heap[left].time < gb->heap[min].time) {
+            min = left;
+        }
+        if (right < gb->heap_size &&
+            gb->heap[right].time < gb->heap[min].time) {
+            min = right;
+        }
+        if (min == i) {
+            return;
+        }
+        heap_swap(gb, i, min);
+        i = min;
+    }
+}
+
+static void heap_remove(gb_t *gb, size_t i) {
+    gb->heap_slot[gb->heap[i].id] = 0;
+    gb->heap_size--;
+    if (i == gb->heap_size) {
+        return;
+    }
+    gb->heap[i] = gb->heap[gb->heap_size];
+    gb->heap_slot[gb->heap[i].id] = i + 1;
+    sift_down(gb, i);
+    sift_up(gb, i);
+}
+
+// A stopped instance keeps it at 0 (see stop_on_error())
+static void update_next_event_time(gb_t *gb) {
+    if (gb->error) {
+        gb->next_event_time = 0;
+        return;
+    }
+    gb->next_event_time = gb->heap_size ? gb->heap[0].time : UINT64_MAX;
+}
+
+void schedule_event(gb_t *gb, event_id_t id, uint64_t time) {
+    if (gb->heap_slot[id]) {
+        size_t i = gb->heap_slot[id] - 1;
+        gb->heap[i].time = time;
+        sift_down(gb, i);
+        sift_up(gb, i);
+    } else {
+        size_t i = gb->heap_size++;
+        gb->heap[i].time = time;
+        gb->heap[i].id = id;
+        gb->heap_slot[id] = i + 1;
+        sift_up(gb, i);
+    }
+    update_next_event_time(gb);
+}
+
+void cancel_event(gb_t *gb, event_id_t id) {
+    if (gb->heap_slot[id]) {
+        heap_remove(gb, gb->heap_slot[id] - 1);
+        update_next_event_time(gb);
+    }
+}
+
+// Runs every event that is due. Handlers are expected to reschedule
+// themselves if they recur.
+void run_events(gb_t *gb) {
+    while (gb->heap_size && gb->heap[0].time <= gb->dots) {
+        event_id_t id = gb->heap[0].id;
+        heap_remove(gb, 0);
+        event_handlers[id](gb);
+    }
+    update_next_event_time(gb);
+}
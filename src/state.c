@@ -0,0 +1,144 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <state.h>
+#include <mem.h>
+#include <sav.h>
+#include <scheduler.h>
+#include <apu.h>
+
+static void init_header(gb_t *gb, state_header_t *header) {
+    memset(header, 0, sizeof(state_header_t));
+    memcpy(header->magic, STATE_MAGIC, sizeof(header->magic));
+    header->version = STATE_VERSION;
+    header->header_size = sizeof(state_header_t);
+    header->gb_size = STATE_GB_SIZE;
+    header->ram_size = gb->ram_size;
+    memcpy(header->rom_title, &gb->rom[0x134], sizeof(header->rom_title));
+    header->rom_checksum = (uint16_t)((gb->rom[0x14E] << 8) | gb->rom[0x14F]);
+}
+
+size_t get_state_size(gb_t *gb) {
+    return sizeof(state_header_t) + STATE_GB_SIZE + gb->ram_size;
+}
+
+// Writes a save state of get_state_size() bytes. The machine state is copied
+// as is, so this costs about as much as a memcpy of the instance.
+void save_state(gb_t *gb, uint8_t *state) {
+    state_header_t header;
+    init_header(gb, &header);
+    memcpy(state, &header, sizeof(state_header_t));
+    state += sizeof(state_header_t);
+    memcpy(state, gb, STATE_GB_SIZE);
+    state += STATE_GB_SIZE;
+    if (gb->ram_size) {
+        memcpy(state, gb->ext_ram, gb->ram_size);
+    }
+}
+
+// Battery RAM is only written where it differs, so that loading states
+// every frame (run-ahead, rewind) doesn't keep rewriting the save file
+static void load_ext_ram(gb_t *gb, const uint8_t *ram) {
+    if (!gb->ram_size) {
+        return;
+    }
+    if (!gb->sav_mapped) {
+        memcpy(gb->ext_ram, ram, gb->ram_size);
+        return;
+    }
+    for (size_t i = 0; i < gb->ram_size; i += PAGE_SIZE) {
+        if (memcmp(gb->ext_ram + i, ram + i, PAGE_SIZE) != 0) {
+            memcpy(gb->ext_ram + i, ram + i, PAGE_SIZE);
+            gb->ext_ram_dirty[i / PAGE_SIZE] = true;
+        }
+    }
+}
+
+// Restores a save state. Returns false, leaving the instance untouched, if
+// the state is from another version or another ROM.
+bool load_state(gb_t *gb, const uint8_t *state, size_t size) {
+    state_header_t header;
+    init_header(gb, &header);
+    if (size != get_state_size(gb) ||
+        memcmp(state, &header, sizeof(state_header_t)) != 0) {
+        fprintf(stderr, "Save state doesn't match this version or ROM\n");
+        return false;
+    }
+    state += sizeof(state_header_t);
+    memcpy(gb, state, STATE_GB_SIZE);
+    state += STATE_GB_SIZE;
+    load_ext_ram(gb, state);
+
+    // The page tables still point into the saving instance
+    init_mem(gb);
+
+    // The save file flush is only scheduled when there is a save file
+    if (!gb->sav_mapped) {
+        cancel_event(gb, EVENT_SAV);
+    } else if (!gb->heap_slot[EVENT_SAV]) {
+        schedule_event(gb, EVENT_SAV, gb->dots + SAV_FLUSH_DOTS);
+    }
+
+    rebase_audio(gb);
+    return true;
+}
+
+// Reports why the save state file can't be used. Always returns false.
+static bool state_file_error(const char *path, FILE *file, uint8_t *state) {
+    perror("Error accessing save state");
+    fprintf(stderr, "Save state path: %s\n", path);
+    if (file) {
+        fclose(file);
+    }
+    free(state);
+    return false;
+}
+
+bool save_state_file(gb_t *gb, const char *path) {
+    size_t size = get_state_size(gb);
+    uint8_t *state = malloc(size);
+    if (!state) {
+        fprintf(stderr, "Failed to allocate save state, exiting...\n");
+        exit(1);
+    }
+    save_state(gb, state);
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        return state_file_error(path, file, state);
+    }
+    if (fwrite(state, 1, size, file) != size) {
+        return state_file_error(path, file, state);
+    }
+    if (fclose(file) != 0) {
+        return state_file_error(path, NULL, state);
+    }
+    free(state);
+    return true;
+}
+
+bool load_state_file(gb_t *gb, const char *path) {
+    // One byte more than expected, to catch files that are too long
+    size_t size = get_state_size(gb) + 1;
+    uint8_t *state = malloc(size);
+    if (!state) {
+        fprintf(stderr, "Failed to allocate save state, exiting...\n");
+        exit(1);
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return state_file_error(path, file, state);
+    }
+    size = fread(state, 1, size, file);
+    if (ferror(file)) {
+        return state_file_error(path, file, state);
+    }
+    fclose(file);
+
+    bool loaded = load_state(gb, state, size);
+    free(state);
+    return loaded;
+}
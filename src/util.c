@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <stdint.h>
 #include <cpu.h>
@@ -6,26 +8,40 @@
 #include <rom.h>
 #include <util.h>
 
-void dump_cpu_state(void) {
-    printf("AF: %02X\nA: %02X\nF: %02X\n", af.r16, af.r8.h, af.r8.l);
-    printf("BC: %02X\nB: %02X\nC: %02X\n", bc.r16, bc.r8.h, bc.r8.l);
-    printf("DE: %02X\nD: %02X\nE: %02X\n", de.r16, de.r8.h, de.r8.l);
-    printf("HL: %02X\nH: %02X\nL: %02X\n", hl.r16, hl.r8.h, hl.r8.l);
-    printf("SP: %02X\n", sp.r16);
-    printf("PC: %02X\n", pc.r16);
-    printf("Dots: %lu\n", dots);
-    printf("IME: %u\n", ime);
+void dump_cpu_state(gb_t *gb) {
+    sync_flags(gb);
+    printf("AF: %02X\nA: %02X\nF: %02X\n",
+           gb->af.r16, gb->af.r8.h, gb->af.r8.l);
+    printf("BC: %02X\nB: %02X\nC: %02X\n",
+           gb->bc.r16, gb->bc.r8.h, gb->bc.r8.l);
+    printf("DE: %02X\nD: %02X\nE: %02X\n",
+           gb->de.r16, gb->de.r8.h, gb->de.r8.l);
+    printf("HL: %02X\nH: %02X\nL: %02X\n",
+           gb->hl.r16, gb->hl.r8.h, gb->hl.r8.l);
+    printf("SP: %02X\n", gb->sp.r16);
+    printf("PC: %02X\n", gb->pc.r16);
+    printf("Dots: %lu\n", gb->dots);
+    printf("IME: %u\n", gb->ime);
 }
 
-void dump_cpu_state_gameboy_doctor(void) {
+void print_stats(gb_t *gb) {
+    double skipped_pct =
+        gb->dots ? 100.0 * gb->idle_loop_dots_skipped / gb->dots : 0.0;
+    fprintf(stderr, "Dots: %lu\n", gb->dots);
+    fprintf(stderr, "Idle loop dots skipped: %lu (%.1f%%)\n",
+            gb->idle_loop_dots_skipped, skipped_pct);
+}
+
+void dump_cpu_state_gameboy_doctor(gb_t *gb) {
+    sync_flags(gb);
     printf("A:%02X F:%02X B:%02X C:%02X D:%02X E:%02X H:%02X L:%02X\n",
-       af.r8.h, af.r8.l, bc.r8.h, bc.r8.l, de.r8.h, de.r8.l,
-       hl.r8.h, hl.r8.l);
+       gb->af.r8.h, gb->af.r8.l, gb->bc.r8.h, gb->bc.r8.l,
+       gb->de.r8.h, gb->de.r8.l, gb->hl.r8.h, gb->hl.r8.l);
 
     printf("SP:%04X PC:%04X PCMEM:%02X,%02X,%02X,%02X\n",
-       sp.r16, pc.r16,
-       read_mem(pc.r16), read_mem(pc.r16 + 1),
-       read_mem(pc.r16 + 2), read_mem(pc.r16 + 3));
+       gb->sp.r16, gb->pc.r16,
+       read_mem(gb, gb->pc.r16), read_mem(gb, gb->pc.r16 + 1),
+       read_mem(gb, gb->pc.r16 + 2), read_mem(gb, gb->pc.r16 + 3));
 }
 
 // Straight AI because I don't wanna implement async-signal-safe dumping
@@ -82,65 +98,86 @@ int utoa_dec(unsigned int value, char *buf) {
     return ultoa_dec(value, buf);
 }
 
-void signal_safe_dump_cpu_state(void) {
+void signal_safe_dump_cpu_state(gb_t *gb) {
     ssize_t sink;
     char buf[64];
     int n;
 
+    sync_flags(gb);
+
     // AF
     sink = write(2, "AF: ", 4);
-    n = utoa_hex(af.r16, buf); sink = write(2, buf, n);
+    n = utoa_hex(gb->af.r16, buf); sink = write(2, buf, n);
     sink = write(2, "\nA: ", 4);
-    n = utoa_hex(af.r8.h, buf); sink = write(2, buf, n);
+    n = utoa_hex(gb->af.r8.h, buf); sink = write(2, buf, n);
     sink = write(2, "\nF: ", 4);
-    n = utoa_hex(af.r8.l, buf); sink = write(2, buf, n);
+    n = utoa_hex(gb->af.r8.l, buf); sink = write(2, buf, n);
     sink = write(2, "\n", 1);
 
     // BC
     sink = write(2, "BC: ", 4);
-    n = utoa_hex(bc.r16, buf); sink = write(2, buf, n);
+    n = utoa_hex(gb->bc.r16, buf); sink = write(2, buf, n);
     sink = write(2, "\nB: ", 4);
-    n = utoa_hex(bc.r8.h, buf); sink = write(2, buf, n);
+    n = utoa_hex(gb->bc.r8.h, buf); sink = write(2, buf, n);
     sink = write(2, "\nC: ", 4);
-    n = utoa_hex(bc.r8.l, buf); sink = write(2, buf, n);
+    n = utoa_hex(gb->bc.r8.l, buf); sink = write(2, buf, n);
     sink = write(2, "\n", 1);
 
     // DE
     sink = write(2, "DE: ", 4);
-    n = utoa_hex(de.r16, buf); sink = write(2, buf, n);
+    n = utoa_hex(gb->de.r16, buf); sink = write(2, buf, n);
     sink = write(2, "\nD: ", 4);
-    n = utoa_hex(de.r8.h, buf); sink = write(2, buf, n);
+    n = utoa_hex(gb->de.r8.h, buf); sink = write(2, buf, n);
     sink = write(2, "\nE: ", 4);
-    n = utoa_hex(de.r8.l, buf); sink = write(2, buf, n);
+    n = utoa_hex(gb->de.r8.l, buf); sink = write(2, buf, n);
     sink = write(2, "\n", 1);
 
     // HL
     sink = write(2, "HL: ", 4);
-    n = utoa_hex(hl.r16, buf); sink = write(2, buf, n);
+    n = utoa_hex(gb->hl.r16, buf); sink = write(2, buf, n);
     sink = write(2, "\nH: ", 4);
-    n = utoa_hex(hl.r8.h, buf); sink = write(2, buf, n);
+    n = utoa_hex(gb->hl.r8.h, buf); sink = write(2, buf, n);
     sink = write(2, "\nL: ", 4);
-    n = utoa_hex(hl.r8.l, buf); sink = write(2, buf, n);
+    n = utoa_hex(gb->hl.r8.l, buf); sink = write(2, buf, n);
     sink = write(2, "\n", 1);
 
     // SP
     sink = write(2, "SP: ", 4);
-    n = utoa_hex(sp.r16, buf); sink = write(2, buf, n);
+    n = utoa_hex(gb->sp.r16, buf); sink = write(2, buf, n);
     sink = write(2, "\n", 1);
 
     // PC
     sink = write(2, "PC: ", 4);
-    n = utoa_hex(pc.r16, buf); sink = write(2, buf, n);
+    n = utoa_hex(gb->pc.r16, buf); sink = write(2, buf, n);
     sink = write(2, "\n", 1);
 
     // Dots
     sink = write(2, "Dots: ", 6);
-    n = ultoa_dec(dots, buf); sink = write(2, buf, n);
+    n = ultoa_dec(gb->dots, buf); sink = write(2, buf, n);
     sink = write(2, "\n", 1);
 
     // IME
     sink = write(2, "IME: ", 5);
-    n = utoa_dec(ime, buf); sink = write(2, buf, n);
+    n = utoa_dec(gb->ime, buf); sink = write(2, buf, n);
     sink = write(2, "\n\n", 2);
     sink = sink;
-}
\ No newline at end of file
+}
+
+// Returns a copy of path with its extension, if any, replaced by ext
+char *replace_extension(const char *path, const char *ext) {
+    const char *slash = strrchr(path, '/');
+    const char *dot = strrchr(path, '.');
+    size_t len = strlen(path);
+    if (dot && (!slash || dot > slash)) {
+        len = (size_t)(dot - path);
+    }
+
+    char *new_path = malloc(len + strlen(ext) + 1);
+    if (!new_path) {
+        fprintf(stderr, "Failed to allocate path, exiting...\n");
+        exit(1);
+    }
+    memcpy(new_path, path, len);
+    strcpy(new_path + len, ext);
+    return new_path;
+}
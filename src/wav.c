@@ -0,0 +1,222 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <wav.h>
+#include <apu.h>
+
+#define WAV_FRAME_SIZE (AUDIO_CHANNELS * sizeof(int16_t))
+
+typedef struct wav_block {
+    struct wav_block *next;
+    size_t frames;
+    int16_t samples[WAV_BLOCK_FRAMES * AUDIO_CHANNELS];
+} wav_block_t;
+
+// A 16-bit PCM WAV file being written. Samples are collected in blocks, and
+// full blocks go to a thread that writes them out, so a slow disk never
+// holds up the run. Written blocks are reused; more are allocated while the
+// writer is behind.
+struct wav_writer {
+    FILE *file;
+    char *path;
+    uint64_t frames;    // frames passed to write_wav()
+    wav_block_t *block; // block being filled
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t queued; // signaled when a block is queued or on close
+    wav_block_t *queue_head; // full blocks, oldest first
+    wav_block_t *queue_tail;
+    wav_block_t *free_blocks;
+    bool closing;
+    bool failed; // a write failed, set by the writer thread
+};
+
+static void put_le16(uint8_t *dst, uint16_t val) {
+    dst[0] = val & 0xFF;
+    dst[1] = val >> 8;
+}
+
+static void put_le32(uint8_t *dst, uint32_t val) {
+    put_le16(dst, val & 0xFFFF);
+    put_le16(dst + 2, val >> 16);
+}
+
+// Writes the header for a file holding the given number of frames
+static bool write_header(FILE *file, uint64_t frames) {
+    uint32_t data_size = (uint32_t)(frames * WAV_FRAME_SIZE);
+    uint8_t header[WAV_HEADER_SIZE];
+    memcpy(&header[0], "RIFF", 4);
+    put_le32(&header[4], WAV_HEADER_SIZE - 8 + data_size);
+    memcpy(&header[8], "WAVE", 4);
+    memcpy(&header[12], "fmt ", 4);
+    put_le32(&header[16], 16);                 // format chunk size
+    put_le16(&header[20], 1);                  // PCM
+    put_le16(&header[22], AUDIO_CHANNELS);
+    put_le32(&header[24], AUDIO_SAMPLE_RATE);
+    put_le32(&header[28], AUDIO_SAMPLE_RATE * WAV_FRAME_SIZE);
+    put_le16(&header[32], WAV_FRAME_SIZE);     // block align
+    put_le16(&header[34], 16);                 // bits per sample
+    memcpy(&header[36], "data", 4);
+    put_le32(&header[40], data_size);
+    return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
+
+static void *writer_main(void *arg) {
+    wav_writer_t *wav = arg;
+    pthread_mutex_lock(&wav->lock);
+    while (true) {
+        while (!wav->queue_head && !wav->closing) {
+            pthread_cond_wait(&wav->queued, &wav->lock);
+        }
+        wav_block_t *block = wav->queue_head;
+        if (!block) {
+            break;
+        }
+        wav->queue_head = block->next;
+        if (!wav->queue_head) {
+            wav->queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&wav->lock);
+
+        // Samples are little-endian in the file, as they are on the host
+        bool ok = fwrite(block->samples, WAV_FRAME_SIZE, block->frames,
+                         wav->file) == block->frames;
+
+        pthread_mutex_lock(&wav->lock);
+        wav->failed |= !ok;
+        block->next = wav->free_blocks;
+        wav->free_blocks = block;
+    }
+    pthread_mutex_unlock(&wav->lock);
+    return NULL;
+}
+
+// Takes a written block for reuse, or allocates one
+static wav_block_t *take_block(wav_writer_t *wav) {
+    pthread_mutex_lock(&wav->lock);
+    wav_block_t *block = wav->free_blocks;
+    if (block) {
+        wav->free_blocks = block->next;
+    }
+    pthread_mutex_unlock(&wav->lock);
+
+    if (!block) {
+        block = malloc(sizeof(wav_block_t));
+        if (!block) {
+            fprintf(stderr, "Failed to allocate WAV buffer, exiting...\n");
+            exit(1);
+        }
+    }
+    block->next = NULL;
+    block->frames = 0;
+    return block;
+}
+
+static void queue_block(wav_writer_t *wav) {
+    pthread_mutex_lock(&wav->lock);
+    if (wav->queue_tail) {
+        wav->queue_tail->next = wav->block;
+    } else {
+        wav->queue_head = wav->block;
+    }
+    wav->queue_tail = wav->block;
+    pthread_cond_signal(&wav->queued);
+    pthread_mutex_unlock(&wav->lock);
+}
+
+// Creates the file at path and starts its writer thread. Returns NULL,
+// after saying why, if the file can't be created.
+wav_writer_t *open_wav(const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        perror("Error opening WAV file");
+        fprintf(stderr, "WAV path: %s\n", path);
+        return NULL;
+    }
+    // The sizes in the header are filled in by close_wav()
+    if (!write_header(file, 0)) {
+        perror("Error writing WAV file");
+        fclose(file);
+        return NULL;
+    }
+
+    wav_writer_t *wav = calloc(1, sizeof(wav_writer_t));
+    if (!wav) {
+        fprintf(stderr, "Failed to allocate WAV writer, exiting...\n");
+        exit(1);
+    }
+    wav->file = file;
+    wav->path = strdup(path);
+    pthread_mutex_init(&wav->lock, NULL);
+    pthread_cond_init(&wav->queued, NULL);
+    wav->block = take_block(wav);
+    if (pthread_create(&wav->thread, NULL, writer_main, wav)) {
+        fprintf(stderr, "Failed to create WAV writer thread, exiting...\n");
+        exit(1);
+    }
+    return wav;
+}
+
+// Appends interleaved stereo samples to the file
+void write_wav(wav_writer_t *wav, const int16_t *samples, size_t frames) {
+    wav->frames += frames;
+    while (frames > 0) {
+        wav_block_t *block = wav->block;
+        size_t count = WAV_BLOCK_FRAMES - block->frames;
+        if (count > frames) {
+            count = frames;
+        }
+        memcpy(&block->samples[block->frames * AUDIO_CHANNELS], samples,
+               count * WAV_FRAME_SIZE);
+        block->frames += count;
+        samples += count * AUDIO_CHANNELS;
+        frames -= count;
+
+        if (block->frames == WAV_BLOCK_FRAMES) {
+            queue_block(wav);
+            wav->block = take_block(wav);
+        }
+    }
+}
+
+// Appends the samples an instance has made since the last call. Must be
+// called at least once per frame, before the instance's buffer fills.
+void capture_audio(wav_writer_t *wav, gb_t *gb) {
+    int16_t samples[AUDIO_BUF_SIZE * AUDIO_CHANNELS];
+    size_t count = read_audio(gb, samples, AUDIO_BUF_SIZE);
+    write_wav(wav, samples, count);
+}
+
+// Writes out the rest of the samples, completes the header and closes the
+// file. Returns false, after saying why, if any of it couldn't be written.
+bool close_wav(wav_writer_t *wav) {
+    queue_block(wav);
+    pthread_mutex_lock(&wav->lock);
+    wav->closing = true;
+    pthread_cond_signal(&wav->queued);
+    pthread_mutex_unlock(&wav->lock);
+    pthread_join(wav->thread, NULL);
+
+    bool ok = !wav->failed && fseek(wav->file, 0, SEEK_SET) == 0 &&
+              write_header(wav->file, wav->frames);
+    ok &= fclose(wav->file) == 0;
+    if (!ok) {
+        perror("Error writing WAV file");
+        fprintf(stderr, "WAV path: %s\n", wav->path);
+    }
+
+    while (wav->free_blocks) {
+        wav_block_t *block = wav->free_blocks;
+        wav->free_blocks = block->next;
+        free(block);
+    }
+    pthread_cond_destroy(&wav->queued);
+    pthread_mutex_destroy(&wav->lock);
+    free(wav->path);
+    free(wav);
+    return ok;
+}
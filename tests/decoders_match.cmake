@@ -0,0 +1,34 @@
+# Runs the given ROMs on the default and the legacy decoder builds and fails
+# unless every ROM ends on the same dot with the same frame. Wall times are
+# left out of the comparison.
+#
+# cmake -DGBEMU=... -DGBEMU_LEGACY=... -DROMS=a.gb;b.gb -P decoders_match.cmake
+
+set(FRAMES 3000)
+
+function(run_batch binary out_var)
+    set(results "")
+    # One process per ROM, so a ROM that stops the emulator is still compared
+    foreach(rom ${ROMS})
+        execute_process(
+            COMMAND ${binary} -B -j 1 -f ${FRAMES} ${rom}
+            OUTPUT_VARIABLE output
+            ERROR_QUIET
+        )
+        string(REGEX REPLACE ", \"wall_time\": [0-9.]+" "" output "${output}")
+        string(APPEND results "${output}")
+    endforeach()
+    set(${out_var} "${results}" PARENT_SCOPE)
+endfunction()
+
+run_batch(${GBEMU} default)
+run_batch(${GBEMU_LEGACY} legacy)
+
+if(default STREQUAL "")
+    message(FATAL_ERROR "No results from ${GBEMU}")
+endif()
+if(NOT default STREQUAL legacy)
+    message(FATAL_ERROR "Decoders disagree\ndefault:\n${default}\n"
+                        "legacy:\n${legacy}")
+endif()
+message(STATUS "Decoders agree:\n${default}")
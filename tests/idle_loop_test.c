@@ -0,0 +1,81 @@
+// Regression checks for idle loop skipping. A ROM that polls STAT for HBlank
+// must still find the PPU in HBlank right after its loop exits, which breaks
+// if an iteration that straddles a mode change is skipped ahead.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <gb.h>
+
+#define ROM_SIZE 0x8000
+
+static const uint8_t program[] = {
+    0xF3,             //        di
+    0x21, 0x00, 0xC0, //        ld hl, $C000
+    0x06, 0x90,       //        ld b, 144
+    0xF0, 0x41,       // line:  ldh a, [$41]
+    0xE6, 0x03,       //        and 3
+    0x28, 0xFA,       //        jr z, line       ; wait for HBlank to end
+    0xF0, 0x41,       // wait:  ldh a, [$41]
+    0xE6, 0x03,       //        and 3
+    0x20, 0xFA,       //        jr nz, wait      ; wait for HBlank
+    0xF0, 0x41,       //        ldh a, [$41]
+    0xE6, 0x03,       //        and 3
+    0x22,             //        ld [hl+], a      ; the mode right after
+    0x05,             //        dec b
+    0x20, 0xEE,       //        jr nz, line
+    0x18, 0xFE,       // done:  jr done
+};
+
+static bool check_hblank_poll(const char *rom_path) {
+    gb_t *gb = init_gb(rom_path, false);
+    if (!gb) {
+        return false;
+    }
+    gb->print_serial = false;
+    for (size_t i = 0; i < 4; i++) {
+        run_frame(gb, UINT64_MAX);
+    }
+
+    size_t in_hblank = 0;
+    for (size_t i = 0; i < DISP_HEIGHT; i++) {
+        in_hblank += gb->wram[i] == 0;
+    }
+    bool skipped = gb->idle_loop_dots_skipped > 0;
+    free_gb(gb);
+
+    printf("hblank poll: %zu of %d lines in HBlank\n", in_hblank,
+           DISP_HEIGHT);
+    if (!skipped) {
+        printf("hblank poll: no idle loop was skipped\n");
+        return false;
+    }
+    return in_hblank == DISP_HEIGHT;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s SCRATCH_ROM_PATH\n", argv[0]);
+        return 1;
+    }
+
+    static uint8_t rom[ROM_SIZE];
+    rom[0x100] = 0xC3; // jp $150
+    rom[0x101] = 0x50;
+    rom[0x102] = 0x01;
+    for (size_t i = 0; i < sizeof(program); i++) {
+        rom[0x150 + i] = program[i];
+    }
+    FILE *file = fopen(argv[1], "wb");
+    if (!file || fwrite(rom, 1, ROM_SIZE, file) != ROM_SIZE ||
+        fclose(file) != 0) {
+        perror("Error writing test ROM");
+        return 1;
+    }
+
+    bool ok = check_hblank_poll(argv[1]);
+    remove(argv[1]);
+    printf("%s\n", ok ? "Passed" : "Failed");
+    return ok ? 0 : 1;
+}